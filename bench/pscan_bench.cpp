@@ -0,0 +1,344 @@
+#include "smxPscanGenerator.h"
+#include "smxConstants.h"
+#include "smxPscan.h"
+#include "smxScurveFit.h"
+#include "smxCountErrors.h"
+#include "smxLog.h"
+#include <TCanvas.h>
+#include <TROOT.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @file pscan_bench.cpp
+ * @brief Benchmarks the pulse scan hot paths on synthetic scans.
+ *
+ * Generates scans with smxPscanGenerator and times readAsciiFile,
+ * toRooDataSet, fitScurvesSeq, writeRootFile and drawPlot (including the PDF
+ * output). The count errors of every scan are computed point by point
+ * (errorsPerPoint) and with the batch kernel of smxCountErrors (errorsBatch),
+ * and the two are checked to agree exactly. With --eval-backends the RooFit fits are also timed with the
+ * legacy, cpu and codegen evaluation backends (smxEvalBackend) and their
+ * thresholds compared. Every call is one sample; per stage the mean, the 50/90/99th
+ * percentiles, the maximum and the throughput are printed and optionally
+ * written as JSON. With --compare the median of every stage is checked against
+ * a baseline written by an earlier run, and the exit code is 2 if any stage got
+ * slower than the tolerance.
+ */
+
+namespace {
+
+/**
+ * @brief Latency samples of one benchmarked stage.
+ */
+struct Stage {
+    std::string name;               ///< Stage name, the key in the JSON output.
+    std::string unit;               ///< Unit of the throughput.
+    std::vector<double> latencies;  ///< Latency per call in milliseconds.
+    double work = 0;                ///< Processed amount in units of the throughput.
+
+    double percentile(double p) const {
+        if (latencies.empty()) return 0;
+        std::vector<double> sorted(latencies);
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = static_cast<size_t>(std::ceil(p / 100. * sorted.size()));
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    }
+    double total() const {
+        double sum = 0;
+        for (double latency : latencies) sum += latency;
+        return sum;
+    }
+    double mean() const { return latencies.empty() ? 0 : total() / latencies.size(); }
+    double throughput() const { return total() > 0 ? work / (total() / 1000.) : 0; }
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printStage(const Stage& stage) {
+    std::printf("%-14s %6zu %10.3f %10.3f %10.3f %10.3f %10.3f %12.1f %s\n",
+                stage.name.c_str(), stage.latencies.size(), stage.mean(),
+                stage.percentile(50), stage.percentile(90), stage.percentile(99),
+                stage.percentile(100), stage.throughput(), stage.unit.c_str());
+}
+
+bool writeJson(const std::string& filename, const std::vector<Stage>& stages, const smxPscanGeneratorConfig& config,
+               int nFiles, int nRepeat, int nFitChannels, bool native) {
+    std::ofstream out(filename, std::ios::trunc);
+    out << "{\n";
+    out << "  \"version\": \"" << smxLibVersion << "\",\n";
+    out << "  \"config\": {\"files\": " << nFiles << ", \"repeat\": " << nRepeat
+        << ", \"fit_channels\": " << nFitChannels << ", \"backend\": \"" << (native ? "native" : "roofit")
+        << "\", \"channels\": " << config.nChannels << ", \"vp\": [" << config.vpMin << ", " << config.vpMax
+        << ", " << config.vpStep << "], \"n_pulses\": " << config.nPulses << ", \"seed\": " << config.seed << "},\n";
+    out << "  \"stages\": [\n";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const Stage& stage = stages[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": \"%s\", \"n\": %zu, \"mean_ms\": %.6f, \"p50_ms\": %.6f, \"p90_ms\": %.6f, "
+                      "\"p99_ms\": %.6f, \"max_ms\": %.6f, \"throughput\": %.3f, \"unit\": \"%s\"}%s\n",
+                      stage.name.c_str(), stage.latencies.size(), stage.mean(), stage.percentile(50),
+                      stage.percentile(90), stage.percentile(99), stage.percentile(100), stage.throughput(),
+                      stage.unit.c_str(), i + 1 < stages.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+    if (!out) {
+        std::cerr << "Error: Failed to write benchmark results: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads the median latency of every stage from a file written by writeJson
+std::map<std::string, double> readBaseline(const std::string& filename) {
+    std::map<std::string, double> medians;
+    std::ifstream in(filename);
+    if (!in) {
+        std::cerr << "Error: Failed to open baseline: " << filename << std::endl;
+        return medians;
+    }
+    std::stringstream content;
+    content << in.rdbuf();
+    std::string text = content.str();
+    std::regex pattern("\"name\": \"(\\w+)\"[^}]*\"p50_ms\": ([-+0-9.eE]+)");
+    for (std::sregex_iterator it(text.begin(), text.end(), pattern), end; it != end; ++it) {
+        medians[(*it)[1].str()] = std::stod((*it)[2].str());
+    }
+    return medians;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    smxPscanGeneratorConfig config;
+    std::string workDirectory = "bench/work";
+    std::string outputFile;
+    std::string baselineFile;
+    int nFiles = 2;
+    int nRepeat = 3;
+    int nFitChannels = 16;
+    double tolerance = 0.10;
+    bool native = false;
+    bool evalBackends = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--files" && i + 1 < argc) {
+            nFiles = std::stoi(argv[++i]);
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            nRepeat = std::stoi(argv[++i]);
+        } else if (arg == "--fit-channels" && i + 1 < argc) {
+            nFitChannels = std::stoi(argv[++i]);
+        } else if (arg == "--channels" && i + 1 < argc) {
+            config.nChannels = std::stoi(argv[++i]);
+        } else if (arg == "--vp-max" && i + 1 < argc) {
+            config.vpMax = std::stoi(argv[++i]);
+        } else if (arg == "--noise" && i + 1 < argc) {
+            config.noiseRate = std::stod(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            config.seed = std::stoull(argv[++i]);
+        } else if (arg == "--native") {
+            native = true;
+        } else if (arg == "--eval-backends") {
+            evalBackends = true;
+        } else if (arg == "--work-dir" && i + 1 < argc) {
+            workDirectory = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (arg == "--compare" && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = std::stod(argv[++i]) / 100.;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--files N] [--repeat N] [--fit-channels N] [--channels N] [--vp-max VP]"
+                      << " [--noise RATE] [--seed S] [--native] [--eval-backends] [--work-dir DIR] [--output results.json]"
+                      << " [--compare baseline.json] [--tolerance PERCENT]" << std::endl;
+            return 1;
+        }
+    }
+    nFitChannels = std::min(nFitChannels, config.nChannels);
+    gROOT->SetBatch(true);
+    smxLog::setLevel(smxLogLevel::Warning); // the progress messages would dominate the timings
+
+    // Synthetic input, reproducible for a given seed
+    smxPscanGenerator generator(config);
+    std::vector<std::string> files;
+    for (int i = 0; i < nFiles; ++i) {
+        std::string file = generator.write(workDirectory, i);
+        if (file.empty()) return 1;
+        files.push_back(file);
+    }
+    std::cout << "Generated " << nFiles << " scans of " << config.nChannels << " channels in " << workDirectory << std::endl;
+
+    Stage read{"readAsciiFile", "MB/s", {}, 0};
+    Stage convert{"toRooDataSet", "datasets/s", {}, 0};
+    Stage fit{"fitScurvesSeq", "channels/s", {}, 0};
+    Stage write{"writeRootFile", "files/s", {}, 0};
+    Stage draw{"drawPlot", "plots/s", {}, 0};
+    Stage errorsPerPoint{"errorsPerPoint", "Mpoints/s", {}, 0};
+    Stage errorsBatch{"errorsBatch", "Mpoints/s", {}, 0};
+    size_t errorMismatches = 0; // points where the batch kernel differs from willsonErrors
+    const std::pair<smxEvalBackend, const char*> backends[] = {
+        {smxEvalBackend::Legacy, "fitLegacy"}, {smxEvalBackend::Cpu, "fitCpu"}, {smxEvalBackend::Codegen, "fitCodegen"}};
+    std::vector<Stage> backendStages;
+    for (const auto& [backend, name] : backends) backendStages.push_back(Stage{name, "channels/s", {}, 0});
+    double maxBackendPull = 0; // largest threshold difference to the legacy backend in standard errors
+
+    for (int repeat = 0; repeat < nRepeat; ++repeat) {
+        for (const std::string& file : files) {
+            smxPscan* pscan = new smxPscan();
+            auto start = std::chrono::steady_clock::now();
+            pscan->readAsciiFile(file);
+            read.latencies.push_back(millisecondsSince(start));
+            read.work += std::filesystem::file_size(file) / 1048576.;
+
+            // Errors of all counts of the scan, per point and in batches of one channel
+            {
+                const int nPulses = pscan->getNPulses();
+                size_t nPoints = 0;
+                for (int ch = 0; ch < config.nChannels; ++ch) nPoints += pscan->getChannelCounts(ch).size();
+                std::vector<double> lo(nPoints), hi(nPoints), batchLo(nPoints), batchHi(nPoints);
+
+                start = std::chrono::steady_clock::now();
+                size_t k = 0;
+                for (int ch = 0; ch < config.nChannels; ++ch) {
+                    for (uint16_t count : pscan->getChannelCounts(ch)) {
+                        smxCountErrors::willsonErrors(count, nPulses, lo[k], hi[k]);
+                        ++k;
+                    }
+                }
+                errorsPerPoint.latencies.push_back(millisecondsSince(start));
+                errorsPerPoint.work += nPoints / 1e6;
+
+                start = std::chrono::steady_clock::now();
+                smxCountErrors countErrors(nPulses);
+                k = 0;
+                for (int ch = 0; ch < config.nChannels; ++ch) {
+                    std::span<const uint16_t> counts = pscan->getChannelCounts(ch);
+                    countErrors.compute(counts, batchLo.data() + k, batchHi.data() + k);
+                    k += counts.size();
+                }
+                errorsBatch.latencies.push_back(millisecondsSince(start));
+                errorsBatch.work += nPoints / 1e6;
+
+                for (size_t i = 0; i < nPoints; ++i) {
+                    if (lo[i] != batchLo[i] || hi[i] != batchHi[i]) errorMismatches++;
+                }
+            }
+
+            std::vector<RooDataSet*> datasets(nFitChannels);
+            for (int ch = 0; ch < nFitChannels; ++ch) {
+                start = std::chrono::steady_clock::now();
+                datasets[ch] = pscan->toRooDataSet(ch);
+                convert.latencies.push_back(millisecondsSince(start));
+                convert.work += 1;
+            }
+
+            // The same channels with every RooFit evaluation backend
+            if (evalBackends) {
+                std::vector<std::vector<smxFitResult>> reference(nFitChannels);
+                for (size_t b = 0; b < backendStages.size(); ++b) {
+                    for (int ch = 0; ch < nFitChannels; ++ch) {
+                        smxScurveFit scurveFit(datasets[ch], ch);
+                        scurveFit.setEvalBackend(backends[b].first);
+                        start = std::chrono::steady_clock::now();
+                        scurveFit.fitScurvesSeq();
+                        backendStages[b].latencies.push_back(millisecondsSince(start));
+                        backendStages[b].work += 1;
+
+                        const std::vector<smxFitResult>& results = scurveFit.getResults();
+                        if (b == 0) {
+                            reference[ch] = results;
+                            continue;
+                        }
+                        for (size_t k = 0; k < results.size() && k < reference[ch].size(); ++k) {
+                            if (results[k].status < 0 || results[k].status > 1 ||
+                                reference[ch][k].status < 0 || reference[ch][k].status > 1) continue;
+                            double error = std::max(reference[ch][k].thresholdErrHi, 1e-9);
+                            maxBackendPull = std::max(maxBackendPull,
+                                                      std::fabs(results[k].threshold - reference[ch][k].threshold) / error);
+                        }
+                    }
+                }
+            }
+
+            std::string pdfName = workDirectory + "/bench.pdf";
+            TCanvas* canvas = new TCanvas("benchCanvas", "S-Curve Fit", 1000, 400);
+            canvas->Print((pdfName + "[").c_str());
+            for (int ch = 0; ch < nFitChannels; ++ch) {
+                smxScurveFit* scurveFit = new smxScurveFit(datasets[ch], ch);
+                scurveFit->setBackend(native ? smxFitBackend::Native : smxFitBackend::RooFit);
+                start = std::chrono::steady_clock::now();
+                scurveFit->fitScurvesSeq();
+                fit.latencies.push_back(millisecondsSince(start));
+                fit.work += 1;
+
+                start = std::chrono::steady_clock::now();
+                TCanvas* plot = scurveFit->drawPlot();
+                plot->Print(pdfName.c_str());
+                draw.latencies.push_back(millisecondsSince(start));
+                draw.work += 1;
+                delete plot;
+                delete scurveFit;
+            }
+            canvas->Print((pdfName + "]").c_str());
+            delete canvas;
+
+            start = std::chrono::steady_clock::now();
+            pscan->writeRootFile(workDirectory + "/bench.root");
+            write.latencies.push_back(millisecondsSince(start));
+            write.work += 1;
+
+            for (RooDataSet* dataset : datasets) delete dataset;
+            delete pscan;
+        }
+    }
+
+    std::vector<Stage> stages = {read, errorsPerPoint, errorsBatch, convert, fit, write, draw};
+    if (evalBackends) stages.insert(stages.end(), backendStages.begin(), backendStages.end());
+    smxLog::flush();
+    std::printf("%-14s %6s %10s %10s %10s %10s %10s %12s\n",
+                "stage", "n", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "throughput");
+    for (const Stage& stage : stages) printStage(stage);
+    if (errorMismatches > 0) {
+        std::printf("Batch count errors differ from the per-point errors at %zu points\n", errorMismatches);
+    }
+    if (evalBackends) {
+        std::printf("Largest threshold difference to the legacy backend: %.3g standard errors\n", maxBackendPull);
+    }
+
+    if (!outputFile.empty() && !writeJson(outputFile, stages, config, nFiles, nRepeat, nFitChannels, native)) {
+        return 1;
+    }
+
+    if (!baselineFile.empty()) {
+        std::map<std::string, double> baseline = readBaseline(baselineFile);
+        if (baseline.empty()) return 1;
+        bool regression = false;
+        for (const Stage& stage : stages) {
+            auto it = baseline.find(stage.name);
+            if (it == baseline.end() || it->second <= 0) continue;
+            double change = stage.percentile(50) / it->second - 1.;
+            bool slower = change > tolerance;
+            regression = regression || slower;
+            std::printf("%-14s p50 %10.3f ms vs %10.3f ms baseline (%+.1f%%)%s\n", stage.name.c_str(),
+                        stage.percentile(50), it->second, 100. * change, slower ? "  REGRESSION" : "");
+        }
+        if (regression) return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "smxPscanGenerator.h"
+#include "smxLog.h"
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+smxPscanGenerator::smxPscanGenerator(const smxPscanGeneratorConfig& generatorConfig) : config(generatorConfig) {}
+
+const smxPscanGeneratorConfig& smxPscanGenerator::getConfig() const {
+    return config;
+}
+
+std::string smxPscanGenerator::fileName(int day, int time) const {
+    char name[256];
+    std::snprintf(name, sizeof(name), "pscan_%06d_%04d_%s_HW_%d_SET_%d_%d_%d_%d_VP_%d_%d_%d_NP_%d_elect.txt",
+                  day, time, config.asicId.c_str(), config.hardwareId,
+                  config.vrefP, config.vrefN, config.vrefT, config.thr2Glb,
+                  config.vpMin, config.vpMax, config.vpStep, config.nPulses);
+    return name;
+}
+
+std::string smxPscanGenerator::write(const std::string& directory, int index) const {
+    if (config.nChannels <= 0 || config.vpStep <= 0 || config.nPulses <= 0 || config.discList.empty()) {
+        SMX_LOG_ERROR("Invalid pulse scan generator configuration.");
+        return "";
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    std::string path = directory + "/" + fileName(240903, 1400 + index % 60);
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        SMX_LOG_ERROR("Failed to create file: " << path);
+        return "";
+    }
+
+    // Per-channel S-curve parameters
+    std::mt19937_64 random(config.seed + static_cast<uint64_t>(index) * 0x9E3779B97F4A7C15ull);
+    std::normal_distribution<double> unitGauss(0.0, 1.0);
+    size_t nDisc = config.discList.size();
+    std::vector<double> thresholds(config.nChannels * nDisc), sigmas(config.nChannels * nDisc);
+    for (int ch = 0; ch < config.nChannels; ++ch) {
+        double channelShift = config.thresholdSpread * unitGauss(random);
+        for (size_t j = 0; j < nDisc; ++j) {
+            thresholds[ch * nDisc + j] = config.thresholdOffset + config.thresholdSlope * config.discList[j] + channelShift;
+            sigmas[ch * nDisc + j] = std::max(0.3, config.sigmaMean + config.sigmaSpread * unitGauss(random));
+        }
+    }
+
+    // Header line as written by the DAQ
+    out << "# VP: \t CH: \t DISC_LIST:[";
+    for (size_t j = 0; j < nDisc; ++j) {
+        out << (j > 0 ? ", " : "") << config.discList[j];
+    }
+    out << "] \t POL: " << config.pol << " \n";
+
+    // Data lines sorted by pulse amplitude, then by channel
+    std::poisson_distribution<int> noise(config.noiseRate);
+    char line[512];
+    for (int vp = config.vpMin; vp < config.vpMax; vp += config.vpStep) {
+        for (int ch = 0; ch < config.nChannels; ++ch) {
+            int length = std::snprintf(line, sizeof(line), "vp %3d   ch %4d: ", vp, ch);
+            for (size_t j = 0; j < nDisc && length < static_cast<int>(sizeof(line)) - 8; ++j) {
+                double u = (thresholds[ch * nDisc + j] - vp) / (std::sqrt(2.0) * sigmas[ch * nDisc + j]);
+                std::binomial_distribution<int> hits(config.nPulses, 0.5 * std::erfc(u));
+                int count = hits(random) + (config.noiseRate > 0 ? noise(random) : 0);
+                length += std::snprintf(line + length, sizeof(line) - length, "%6d", count);
+            }
+            line[length++] = '\n';
+            out.write(line, length);
+        }
+    }
+    if (!out) {
+        SMX_LOG_ERROR("Failed to write file: " << path);
+        return "";
+    }
+    return path;
+}
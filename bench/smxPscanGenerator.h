@@ -0,0 +1,82 @@
+#ifndef SMX_PSCAN_GENERATOR_H
+#define SMX_PSCAN_GENERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @struct smxPscanGeneratorConfig
+ * @brief Parameters of the synthetic pulse scans written by smxPscanGenerator.
+ * @details The defaults resemble the sample scan in data/.
+ */
+struct smxPscanGeneratorConfig {
+    int nChannels = 128;                        ///< Number of channels written per pulse amplitude.
+    std::vector<int> discList = {5, 10, 16, 24, 30, 31}; ///< Discriminators in file order (DISC_LIST).
+    int vpMin = 0;                              ///< First pulse amplitude.
+    int vpMax = 255;                            ///< Pulse amplitudes are scanned up to, excluding, vpMax.
+    int vpStep = 1;                             ///< Pulse amplitude step.
+    int nPulses = 100;                          ///< Number of pulses per amplitude.
+    int pol = 0;                                ///< Polarity written to the header.
+
+    double thresholdOffset = 240.0;             ///< Mean threshold extrapolated to discriminator 0.
+    double thresholdSlope = -7.0;               ///< Mean threshold change per discriminator.
+    double thresholdSpread = 2.0;               ///< Channel-to-channel threshold spread (Gaussian sigma).
+    double sigmaMean = 3.0;                     ///< Mean S-curve width.
+    double sigmaSpread = 0.4;                   ///< Channel-to-channel width spread (Gaussian sigma).
+    double noiseRate = 0.002;                   ///< Mean number of noise counts per pulse amplitude.
+
+    std::string asicId = "XA-000-08-002-000-006-076-14"; ///< ASIC identifier used in the file name.
+    int hardwareId = 5;                         ///< Value of the HW_ field of the file name.
+    int vrefP = 57;                             ///< Vref_p of the SET_ field.
+    int vrefN = 25;                             ///< Vref_n of the SET_ field.
+    int vrefT = 118;                            ///< Vref_t of the SET_ field.
+    int thr2Glb = 33;                           ///< Thr2_glb of the SET_ field.
+    uint64_t seed = 1;                          ///< Random seed.
+};
+
+/**
+ * @class smxPscanGenerator
+ * @brief Writes synthetic pulse scan files in the exact naming and layout of the DAQ.
+ *
+ * Every S-curve is drawn from a binomial distribution with the probability
+ * 0.5 * erfc((threshold - vp) / (sqrt(2) * sigma)). Thresholds change linearly
+ * with the discriminator number and scatter per channel; sigmas scatter around
+ * a common mean. Noise adds Poisson-distributed counts with a mean of
+ * noiseRate per pulse amplitude. Files are reproducible for a given seed.
+ */
+class smxPscanGenerator {
+private:
+    smxPscanGeneratorConfig config; ///< Generator parameters.
+
+public:
+    /**
+     * @brief Constructor.
+     * @param generatorConfig The generator parameters.
+     */
+    explicit smxPscanGenerator(const smxPscanGeneratorConfig& generatorConfig = smxPscanGeneratorConfig());
+
+    /**
+     * @brief Retrieves the generator parameters.
+     * @return A reference to the parameters.
+     */
+    const smxPscanGeneratorConfig& getConfig() const;
+
+    /**
+     * @brief Builds the DAQ file name for a scan time.
+     * @param day Date as YYMMDD.
+     * @param time Time as HHMM.
+     * @return The file name without directory.
+     */
+    std::string fileName(int day, int time) const;
+
+    /**
+     * @brief Writes one synthetic scan.
+     * @param directory The output directory.
+     * @param index Index of the scan, varies the scan time and the random sequence.
+     * @return The path of the written file, empty on error.
+     */
+    std::string write(const std::string& directory, int index = 0) const;
+};
+
+#endif // SMX_PSCAN_GENERATOR_H
@@ -0,0 +1,53 @@
+#ifndef SMX_ASCII_SCANNER_H
+#define SMX_ASCII_SCANNER_H
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @class smxAsciiScanner
+ * @brief Allocation-free line scanner for pscan ASCII files.
+ *
+ * Walks a contiguous character buffer (typically an smxMappedFile) line by
+ * line and parses data lines of the form `vp <pulse> ch <channel>: <v0> <v1> ...`
+ * with std::from_chars. It accepts exactly the lines matched by the reference
+ * regular expression `vp\s+(\d+)\s+ch\s+(\d+):\s+((\d+\s*)+)`.
+ */
+class smxAsciiScanner {
+private:
+    const char* cursor;  ///< Current read position.
+    const char* end;     ///< One past the last character of the buffer.
+
+public:
+    /**
+     * @brief Maximum number of values stored per data line, further values are only counted.
+     */
+    static constexpr int maxValues = 64;
+
+    /**
+     * @brief Constructor.
+     * @param buffer Pointer to the first character of the buffer.
+     * @param size The buffer size in bytes.
+     */
+    smxAsciiScanner(const char* buffer, std::size_t size);
+
+    /**
+     * @brief Extracts the next line without its terminating newline.
+     * @param line Set to a view of the line on success.
+     * @return False once the end of the buffer has been reached.
+     */
+    bool nextLine(std::string_view& line);
+
+    /**
+     * @brief Parses a single data line.
+     * @param line The line to parse.
+     * @param pulse Set to the pulse amplitude (vp) of the line.
+     * @param channel Set to the channel number of the line.
+     * @param values Array of at least maxValues elements receiving the comparator counts.
+     * @param nValues Set to the total number of counts on the line.
+     * @return True if the line is a well-formed data line.
+     */
+    static bool parseDataLine(std::string_view line, int& pulse, int& channel, int* values, int& nValues);
+};
+
+#endif // SMX_ASCII_SCANNER_H
@@ -0,0 +1,187 @@
+#ifndef SMX_BATCH_H
+#define SMX_BATCH_H
+
+#include "smxFitResult.h"
+#include "smxPscan.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class smxWorkStealingPool;
+
+/**
+ * @struct smxBatchFileResult
+ * @brief Outcome of one input file of a batch run.
+ */
+struct smxBatchFileResult {
+    std::string fileName;           ///< The input file.
+    std::string outputFileName;     ///< The written ROOT file, empty with merged output or on error.
+    std::string error;              ///< Error message, empty on success.
+    std::string asicId;             ///< ASIC identifier of the scan.
+    std::time_t readTime = 0;       ///< Timestamp of the scan.
+    int nFits = 0;                  ///< Fitted comparators.
+    int nFailedFits = 0;            ///< Fits with a minimizer status above 1.
+    double seconds = 0;             ///< Wall time from the start of reading to the end of writing.
+};
+
+/**
+ * @class smxBatch
+ * @brief Processes many pulse scan files concurrently on a work-stealing thread pool.
+ *
+ * Every file is one pool task: it reads the scan and submits its channels in
+ * chunks as subtasks, which are fitted with smxErfcFitter. The worker that
+ * read a file continues with its chunks while idle workers steal the
+ * remaining chunks or the next files, so large and small scans mix without
+ * leaving threads idle; files are started largest first. The worker
+ * finishing the last chunk of a file stores the results and writes the
+ * file's ROOT output, or, with a merged output file, keeps the results for
+ * one file written at the end. A file that cannot be read or fails in any
+ * stage is reported with its error and does not affect the others.
+ */
+class smxBatch {
+private:
+    /**
+     * @brief A scan being fitted.
+     */
+    struct FileJob {
+        size_t index = 0;                       ///< Position in the input list.
+        smxPscan* pscan = nullptr;              ///< The scan, owned by the job.
+        std::vector<smxFitResult> results;      ///< Fit results, [channel * readDiscList size + disc index].
+        std::atomic<int> pendingChunks{0};      ///< Channel chunks not yet fitted.
+        std::chrono::steady_clock::time_point start; ///< Start of reading.
+        std::mutex errorMutex;                  ///< Guards error.
+        std::string error;                      ///< First error of a chunk, empty if none.
+    };
+
+    int nThreads;                               ///< Number of pool threads.
+    int chunkChannels = 16;                     ///< Channels fitted per subtask.
+    smxParseMode parseMode = smxParseMode::Fast; ///< Parser of the ASCII files.
+    bool momentSeeding = true;                  ///< Whether fits are seeded from the S-curve moments.
+    bool classify = true;                       ///< Whether curves are classified before fitting.
+    smxRootOutputOptions outputOptions;         ///< Compression and layout of the per-file ROOT output.
+    std::string mergedFileName;                 ///< Merged output file, empty for one file per input.
+
+    std::mutex resultsMutex;                    ///< Guards fileResults and mergedFits.
+    std::vector<smxBatchFileResult> fileResults; ///< Outcome per input file, in input order.
+    std::vector<std::vector<smxFitResult>> mergedFits; ///< Filled fit results per input file (merged output).
+    double wallTime = 0;                        ///< Wall time of the last run() in seconds.
+    long steals = 0;                            ///< Tasks stolen by idle workers in the last run().
+
+    /**
+     * @brief Pool task of one input file: reads it and submits its channel chunks.
+     * @param pool The pool.
+     * @param index Position of the file in the input list.
+     */
+    void processFile(smxWorkStealingPool& pool, size_t index);
+
+    /**
+     * @brief Pool task of one channel chunk; the last chunk of a file finishes it.
+     * @param job The scan.
+     * @param firstChannel The first channel.
+     * @param lastChannel One past the last channel.
+     */
+    void fitChunk(FileJob* job, int firstChannel, int lastChannel);
+
+    /**
+     * @brief Stores the results of a fitted scan, writes its output and releases it.
+     * @param job The scan, deleted by the call.
+     */
+    void finishFile(FileJob* job);
+
+    /**
+     * @brief Records the outcome of a file.
+     * @param index Position of the file in the input list.
+     * @param result The outcome, fileName is filled in.
+     */
+    void recordResult(size_t index, smxBatchFileResult result);
+
+    /**
+     * @brief Writes batchFilesTree and fitResultsTree of all files to the merged output file.
+     * @return False if the file could not be created.
+     */
+    bool writeMergedFile() const;
+
+public:
+    /**
+     * @brief Constructor.
+     * @param threads Number of pool threads, 0 for the number of hardware threads.
+     */
+    explicit smxBatch(int threads = 0);
+
+    /**
+     * @brief Expands directories, glob patterns and list files into scan files.
+     * @details A directory contributes its pscan_*.txt and *.pscan files, a pattern with *, ? or [
+     *          the matching paths, and @listfile every non-empty line that does not start with #,
+     *          which is expanded in turn. Other arguments are taken as file names. Duplicates are
+     *          dropped, the order is kept.
+     * @param inputs The arguments.
+     * @return The files.
+     */
+    static std::vector<std::string> collectFiles(const std::vector<std::string>& inputs);
+
+    /**
+     * @brief Sets the number of pool threads.
+     * @param threads Number of threads, 0 for the number of hardware threads.
+     */
+    void setThreads(int threads);
+
+    /**
+     * @brief Sets the number of channels fitted per subtask.
+     * @param channels Channels per chunk, at least 1.
+     */
+    void setChunkChannels(int channels);
+
+    /**
+     * @brief Selects the parser of the ASCII files.
+     * @param mode The parser mode.
+     */
+    void setParseMode(smxParseMode mode);
+
+    /**
+     * @brief Enables or disables the moment-based seeding of the fits.
+     * @param enable See smxScurveFit::setMomentSeeding.
+     */
+    void setMomentSeeding(bool enable);
+
+    /**
+     * @brief Enables or disables the classification of the curves before fitting.
+     * @param enable See smxPipeline::setClassify.
+     */
+    void setClassify(bool enable);
+
+    /**
+     * @brief Sets compression and layout of the per-file ROOT output.
+     * @details A fixed fileName would be shared by all files and is ignored.
+     * @param options The output options.
+     */
+    void setOutputOptions(const smxRootOutputOptions& options);
+
+    /**
+     * @brief Writes the fit results of all files to one file instead of one file per input.
+     * @param fileName The merged output file, empty for one file per input.
+     */
+    void setMergedOutput(const std::string& fileName);
+
+    /**
+     * @brief Reads, fits and writes all files.
+     * @param files The ASCII, binary or ROOT scan files.
+     * @return The number of files that failed.
+     */
+    int run(const std::vector<std::string>& files);
+
+    /**
+     * @brief Retrieves the outcome of every file of the last run().
+     * @return The outcomes in input order.
+     */
+    const std::vector<smxBatchFileResult>& getFileResults() const;
+
+    /**
+     * @brief Prints one line per file and the totals of the last run().
+     */
+    void printSummary() const;
+};
+
+#endif // SMX_BATCH_H
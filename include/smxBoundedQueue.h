@@ -0,0 +1,74 @@
+#ifndef SMX_BOUNDED_QUEUE_H
+#define SMX_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * @class smxBoundedQueue
+ * @brief Blocking FIFO queue of fixed capacity connecting two pipeline stages.
+ *
+ * push() blocks while the queue is full, which throttles a fast producer to
+ * the pace of its consumers. After close() no items are accepted any more and
+ * pop() returns false once the remaining items have been taken.
+ */
+template <typename T>
+class smxBoundedQueue {
+private:
+    std::mutex mutex;                   ///< Guards all members below.
+    std::condition_variable notFull;    ///< Signalled when an item was taken or the queue was closed.
+    std::condition_variable notEmpty;   ///< Signalled when an item was added or the queue was closed.
+    std::deque<T> items;                ///< Queued items.
+    size_t capacity;                    ///< Maximum number of queued items.
+    bool closed = false;                ///< Whether close() was called.
+
+public:
+    /**
+     * @brief Constructor.
+     * @param maxItems Maximum number of queued items, at least 1.
+     */
+    explicit smxBoundedQueue(size_t maxItems) : capacity(maxItems > 0 ? maxItems : 1) {}
+
+    /**
+     * @brief Appends an item, waiting while the queue is full.
+     * @param item The item.
+     * @return False if the queue was closed; the item is dropped then.
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Takes the oldest item, waiting while the queue is empty and open.
+     * @param item Receives the item.
+     * @return False if the queue is closed and empty.
+     */
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Closes the queue, waking up all waiting producers and consumers.
+     */
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+};
+
+#endif // SMX_BOUNDED_QUEUE_H
@@ -33,5 +33,12 @@ constexpr double smxEtoFC = 1/0.1602176634;
  */
 constexpr double smxAmCaltoE = 342.7;
 
+/**
+ * @brief Library version, part of the result cache keys.
+ *
+ * Bump it whenever a change alters parsed data or fit results, so that cached results are not reused.
+ */
+constexpr const char* smxLibVersion = "1.1.0";
+
 #endif // SMX_CONSTANTS_H
 
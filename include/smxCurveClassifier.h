@@ -0,0 +1,71 @@
+#ifndef SMX_CURVE_CLASSIFIER_H
+#define SMX_CURVE_CLASSIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/**
+ * @enum smxCurveLabel
+ * @brief Pre-fit label of the S-curve of one channel and comparator, stored as smxFitResult::label.
+ */
+enum class smxCurveLabel : int {
+    Fittable = 0,     ///< Rises from the lower to the upper plateau, passed to the fit.
+    Dead = 1,         ///< All counts zero.
+    Saturated = 2,    ///< All counts at nPulses or above.
+    Noisy = 3,        ///< Counts above nPulses, e.g. a comparator that fires without pulses.
+    NonMonotonic = 4  ///< Counts drop far below an earlier value.
+};
+
+/**
+ * @class smxCurveClassifier
+ * @brief Labels S-curves from their raw counts in a single pass, before any fit.
+ *
+ * A curve whose counts are all zero is dead, one that never drops below
+ * nPulses is saturated. Counts above nPulses times the noise factor cannot
+ * come from the test pulses and mark the curve noisy. A curve that falls more
+ * than the allowed drop below its running maximum is non-monotonic; the
+ * default drop is three binomial standard deviations at 50% efficiency. Only
+ * fittable curves are worth the minimizer and its retries.
+ */
+class smxCurveClassifier {
+private:
+    int nPulses;              ///< Number of pulses per amplitude.
+    double noiseFactor = 1.1; ///< Counts above nPulses * noiseFactor are noise.
+    double maxDrop;           ///< Largest drop below the running maximum of a rising curve.
+
+public:
+    /**
+     * @brief Constructor.
+     * @param pulses Number of pulses per amplitude of the scan.
+     */
+    explicit smxCurveClassifier(int pulses);
+
+    /**
+     * @brief Sets the factor on nPulses above which counts are taken as noise.
+     * @param factor The factor, at least 1.
+     */
+    void setNoiseFactor(double factor);
+
+    /**
+     * @brief Sets the largest drop of the counts below their running maximum.
+     * @param counts The drop in counts.
+     */
+    void setMaxDrop(double counts);
+
+    /**
+     * @brief Labels one S-curve.
+     * @param counts The counts ordered by pulse amplitude.
+     * @return The label; every curve is fittable if nPulses is not positive.
+     */
+    smxCurveLabel classify(std::span<const uint16_t> counts) const;
+
+    /**
+     * @brief Retrieves the name of a label.
+     * @param label The label.
+     * @return The name, e.g. "dead".
+     */
+    static const char* labelName(smxCurveLabel label);
+};
+
+#endif // SMX_CURVE_CLASSIFIER_H
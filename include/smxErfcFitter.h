@@ -0,0 +1,214 @@
+#ifndef SMX_ERFC_FITTER_H
+#define SMX_ERFC_FITTER_H
+
+#include "smxFitResult.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class smxErfcFitter
+ * @brief Self-contained Levenberg-Marquardt chi-square fitter for the S-curve model.
+ *
+ * Fits `offset + 0.5 * erfc((threshold - x) / (sqrt(2) * sigma))` to points with
+ * asymmetric y errors. The chi-square follows RooFit's RooXYChi2Var: the upper
+ * error is used where the model lies above the data point, the lower error
+ * otherwise. Derivatives are analytic and the model is evaluated by a batched
+ * erfc kernel over contiguous arrays. Parameter errors are taken from the
+ * covariance matrix, asymmetric errors from the chi2 + 1 crossings of the
+ * profile, like MINOS. The class uses no ROOT and is thread-safe per instance.
+ */
+class smxErfcFitter {
+public:
+    /**
+     * @brief Parameter indices.
+     */
+    enum Parameter { kOffset = 0, kThreshold = 1, kSigma = 2, kNPar = 3 };
+
+private:
+    std::vector<double> x;        ///< Pulse amplitudes.
+    std::vector<double> y;        ///< Normalized counts.
+    std::vector<double> errLo;    ///< Lower errors of y (positive).
+    std::vector<double> errHi;    ///< Upper errors of y (positive).
+
+    std::vector<double> arg;      ///< Scratch: erfc argument per point.
+    std::vector<double> erfcVal;  ///< Scratch: erfc value per point.
+    std::vector<double> gauss;    ///< Scratch: exp(-arg^2) per point.
+    std::vector<double> weight;   ///< Scratch: inverse error per point.
+    std::vector<double> residual; ///< Scratch: weighted residual per point.
+    std::vector<double> jacobian; ///< Scratch: weighted derivatives, [parameter][point].
+
+    double start[kNPar] = {0., 60., 1.};      ///< Starting values.
+    double lower[kNPar] = {-1., -1., .1};     ///< Lower parameter limits.
+    double upper[kNPar] = {.5, 256., 15.};    ///< Upper parameter limits.
+
+    int maxIterations = 200;      ///< Iteration limit of one minimization.
+    int iterations = 0;           ///< Iterations of the last fit(), summed over attempts.
+    bool computeAsymErrors = true; ///< Whether fit() determines asymmetric errors.
+
+    /**
+     * @brief Evaluates weighted residuals and, optionally, the weighted Jacobian.
+     * @param par The parameter values.
+     * @param withJacobian Whether to fill the Jacobian.
+     * @return The chi-square.
+     */
+    double evaluate(const double* par, bool withJacobian);
+
+    /**
+     * @brief Levenberg-Marquardt minimization with box constraints.
+     * @param par Starting values on input, best values on output.
+     * @param fixedPar Index of a parameter kept constant, -1 for none.
+     * @param chi2 Set to the minimum chi-square.
+     * @param tolerance Relative chi-square decrease below which the minimization stops.
+     * @return Status: 0 converged, 1 iteration limit reached, 3 numerical failure.
+     */
+    int minimize(double* par, int fixedPar, double& chi2, double tolerance);
+
+    /**
+     * @brief Computes the covariance matrix of the free parameters at par.
+     * @param par The parameter values.
+     * @param covariance Set to the kNPar x kNPar covariance matrix.
+     * @return False if the curvature matrix is singular.
+     */
+    bool covarianceMatrix(const double* par, double* covariance);
+
+    /**
+     * @brief Finds the distance from the minimum to the chi2 + 1 crossing of the profile.
+     * @param best The best parameter values.
+     * @param chi2Min The minimum chi-square.
+     * @param parIndex The parameter to scan.
+     * @param direction +1 for the upper, -1 for the lower crossing.
+     * @param stepGuess Initial distance, usually the parabolic error.
+     * @return The distance (positive), limited by the parameter range.
+     */
+    double profileCrossing(const double* best, double chi2Min, int parIndex, int direction, double stepGuess);
+
+public:
+    smxErfcFitter() = default;
+
+    /**
+     * @brief Sets the points to fit, copying them.
+     * @param xValues Pulse amplitudes.
+     * @param yValues Normalized counts.
+     * @param yErrLo Lower errors of the counts (sign is ignored).
+     * @param yErrHi Upper errors of the counts.
+     * @param n Number of points.
+     */
+    void setData(const double* xValues, const double* yValues, const double* yErrLo, const double* yErrHi, std::size_t n);
+
+    /**
+     * @brief Sets the starting values.
+     * @param offset Starting offset.
+     * @param threshold Starting threshold.
+     * @param sigma Starting sigma.
+     */
+    void setStart(double offset, double threshold, double sigma);
+
+    /**
+     * @brief Sets the allowed range of a parameter.
+     * @param parIndex The parameter index (see Parameter).
+     * @param low Lower limit.
+     * @param high Upper limit.
+     */
+    void setLimits(int parIndex, double low, double high);
+
+    /**
+     * @brief Seeds the fit from the moments of the current data (see estimateMoments()).
+     * @details Sets the starting values and narrows the sigma and threshold limits around
+     *          the estimate, keeping generous margins within the current limits.
+     * @return False if the curve has no rising edge; start values and limits are then unchanged.
+     */
+    bool seedFromMoments();
+
+    /**
+     * @brief Retrieves the starting value of a parameter.
+     * @param parIndex The parameter index (see Parameter).
+     * @return The starting value.
+     */
+    double getStart(int parIndex) const;
+
+    /**
+     * @brief Retrieves the lower limit of a parameter.
+     * @param parIndex The parameter index (see Parameter).
+     * @return The lower limit.
+     */
+    double getLower(int parIndex) const;
+
+    /**
+     * @brief Retrieves the upper limit of a parameter.
+     * @param parIndex The parameter index (see Parameter).
+     * @return The upper limit.
+     */
+    double getUpper(int parIndex) const;
+
+    /**
+     * @brief Enables or disables the profile scan for asymmetric errors.
+     * @param enable If false, fit() reports the symmetric covariance errors.
+     */
+    void setAsymErrors(bool enable);
+
+    /**
+     * @brief Fits the model.
+     * @details A failed attempt from the starting values is repeated from the best
+     *          threshold of a coarse scan over the threshold range.
+     * @param result Receives the parameters, errors, chi-square, status and attempts;
+     *               channel and comparator are left untouched.
+     * @return The status of the last attempt, 0 on success.
+     */
+    int fit(smxFitResult& result);
+
+    /**
+     * @brief Retrieves the number of minimizer iterations of the last fit().
+     * @return The iteration count, summed over all attempts.
+     */
+    int getIterations() const;
+
+    /**
+     * @brief Evaluates the chi-square for given parameters.
+     * @param offset Offset.
+     * @param threshold Threshold.
+     * @param sigma Sigma.
+     * @return The chi-square of the current data.
+     */
+    double chi2(double offset, double threshold, double sigma);
+
+    /**
+     * @brief Non-iterative estimate of the S-curve parameters from the discrete derivative.
+     * @details The threshold is the first moment and sigma the square root of the second
+     *          central moment of y[i+1] - y[i] over the interval centres, with Sheppard's
+     *          correction for the sampling step. The moments are taken within a window of
+     *          three 16%-84% widths around the edge, so that single outlying counts far from
+     *          the edge do not bias them. The offset is the first point of the window.
+     * @param xValues Pulse amplitudes in ascending order.
+     * @param yValues Normalized counts.
+     * @param n Number of points.
+     * @param offset Set to the estimated offset.
+     * @param threshold Set to the estimated threshold.
+     * @param sigma Set to the estimated sigma.
+     * @return False if the curve has no rising edge.
+     */
+    static bool estimateMoments(const double* xValues, const double* yValues, std::size_t n,
+                                double& offset, double& threshold, double& sigma);
+
+    /**
+     * @brief Batched erfc kernel.
+     * @details Branch-free polynomial approximation (relative error below 1.2e-7) with an inlined
+     *          exp, written over contiguous arrays. The loop is vectorized with the Makefile flags
+     *          -fopenmp-simd and -fno-trapping-math (check with -fopt-info-vec). u may equal erfcOut.
+     * @param u Arguments.
+     * @param erfcOut Receives erfc(u).
+     * @param gaussOut Receives exp(-u^2), needed for the derivatives.
+     * @param n Number of values.
+     */
+    static void erfcBatch(const double* u, double* erfcOut, double* gaussOut, std::size_t n);
+
+    /**
+     * @brief Solves the n x n system M * s = b in place with partial pivoting.
+     * @param M The row-major matrix, overwritten.
+     * @param b The right-hand side, replaced by the solution.
+     * @param n The dimension.
+     * @return False if the matrix is singular.
+     */
+    static bool solveLinear(double* M, double* b, int n);
+};
+
+#endif // SMX_ERFC_FITTER_H
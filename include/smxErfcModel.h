@@ -0,0 +1,106 @@
+#ifndef SMX_ERFC_MODEL_H
+#define SMX_ERFC_MODEL_H
+
+#include <RooAbsReal.h>
+#include <RooRealProxy.h>
+#include <RVersion.h>
+#include <Rtypes.h>
+#include <cstddef>
+#include <vector>
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 30, 0)
+#include <RooFit/EvalContext.h>
+#endif
+
+/**
+ * @class smxErfcModel
+ * @brief Compiled RooFit function of the S-curve model.
+ *
+ * Evaluates `offset + 0.5 * erfc((threshold - x) / (sqrt(2) * sigma))` without
+ * the formula interpreter of RooFormulaVar. With ROOT 6.30 and later doEval()
+ * computes all points of a dataset in one call with the batched erfc kernel of
+ * smxErfcFitter, so fits with the "cpu" evaluation backend run vectorized. The
+ * scalar evaluate() uses the same kernel, so both paths give identical values.
+ * The dictionary (smxLinkDef.h) provides the ROOT streamer, so the model can be
+ * written to a file, e.g. inside a RooWorkspace; the scratch space is transient.
+ */
+class smxErfcModel : public RooAbsReal {
+private:
+    RooRealProxy x;             ///< Pulse amplitude.
+    RooRealProxy offset;        ///< Offset of the normalized counts.
+    RooRealProxy threshold;     ///< Threshold.
+    RooRealProxy sigma;         ///< Width of the S-curve.
+
+    mutable std::vector<double> scratch; //!< exp(-u^2) of the erfc kernel, transient.
+
+protected:
+    /**
+     * @brief Evaluates the model at the current values.
+     * @return The model value.
+     */
+    double evaluate() const override;
+
+public:
+    /**
+     * @brief Default constructor, used by ROOT I/O.
+     */
+    smxErfcModel() = default;
+
+    /**
+     * @brief Constructor.
+     * @param name Name of the function.
+     * @param title Title of the function.
+     * @param xVar The pulse amplitude.
+     * @param offsetVar The offset.
+     * @param thresholdVar The threshold.
+     * @param sigmaVar The width.
+     */
+    smxErfcModel(const char* name, const char* title, RooAbsReal& xVar, RooAbsReal& offsetVar,
+                 RooAbsReal& thresholdVar, RooAbsReal& sigmaVar);
+
+    /**
+     * @brief Copy constructor used by clone().
+     * @param other The model to copy.
+     * @param name New name, nullptr to keep the name.
+     */
+    smxErfcModel(const smxErfcModel& other, const char* name = nullptr);
+
+    /**
+     * @brief Clones the model.
+     * @param newname New name, nullptr to keep the name.
+     * @return The clone, owned by the caller.
+     */
+    TObject* clone(const char* newname) const override;
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 30, 0)
+    /**
+     * @brief Evaluates the model for all points of the evaluation context.
+     * @param ctx The evaluation context with the spans of x and the parameters.
+     */
+    void doEval(RooFit::EvalContext& ctx) const override;
+#endif
+
+    /**
+     * @brief Evaluates the model for arrays of pulse amplitudes.
+     * @details The values are taken from spans of length 1 (constant) or n (per point).
+     * @param xValues Pulse amplitudes.
+     * @param nX Length of xValues, 1 or n.
+     * @param offsets Offsets.
+     * @param thresholds Thresholds.
+     * @param sigmas Widths.
+     * @param nOffsets Length of offsets, 1 or n.
+     * @param nThresholds Length of thresholds, 1 or n.
+     * @param nSigmas Length of sigmas, 1 or n.
+     * @param output Receives the n model values.
+     * @param gaussScratch At least n values of scratch space.
+     * @param n Number of points.
+     */
+    static void evaluateBatch(const double* xValues, std::size_t nX, const double* offsets,
+                              const double* thresholds, const double* sigmas, std::size_t nOffsets,
+                              std::size_t nThresholds, std::size_t nSigmas, double* output,
+                              double* gaussScratch, std::size_t n);
+
+    ClassDefOverride(smxErfcModel, 1)
+};
+
+#endif // SMX_ERFC_MODEL_H
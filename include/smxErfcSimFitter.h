@@ -0,0 +1,177 @@
+#ifndef SMX_ERFC_SIM_FITTER_H
+#define SMX_ERFC_SIM_FITTER_H
+
+#include "smxFitResult.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class smxErfcSimFitter
+ * @brief Simultaneous Levenberg-Marquardt fit of all S-curves of one channel.
+ *
+ * Every curve k follows `offset_k + 0.5 * erfc((threshold_k - x) / (sqrt(2) * sigma))`
+ * with its own offset and one sigma shared by all curves, since the comparators
+ * of a channel see the same front-end noise. The thresholds are either free per
+ * curve or tied to a linear model `intercept + slope * position_k` of the
+ * comparator position. The chi-square and its treatment of asymmetric errors
+ * are those of smxErfcFitter, summed over the curves, so one minimization
+ * replaces one per comparator. The Jacobian is sparse, every point depends on
+ * sigma and the parameters of its own curve only, and the normal equations are
+ * accumulated from the per-point derivatives. Errors are the symmetric errors
+ * of the covariance matrix; a profile scan over all parameters would cost more
+ * than the fits it replaces. The class uses no ROOT and is thread-safe per instance.
+ */
+class smxErfcSimFitter {
+public:
+    /**
+     * @brief Parametrization of the thresholds.
+     */
+    enum ThresholdModel {
+        kFreeThresholds = 0,   ///< One threshold per curve.
+        kLinearThresholds = 1  ///< threshold_k = intercept + slope * position_k.
+    };
+
+private:
+    /**
+     * @brief The points and starting values of one curve.
+     */
+    struct Curve {
+        double position = 0;        ///< Comparator position for the linear threshold model.
+        std::size_t first = 0;      ///< Index of the first point in the point arrays.
+        std::size_t n = 0;          ///< Number of points.
+        double offsetStart = 0;     ///< Starting offset.
+        double thresholdStart = 60; ///< Starting threshold.
+        double thresholdLow = -1;   ///< Lower threshold limit (free thresholds).
+        double thresholdHigh = 256; ///< Upper threshold limit (free thresholds).
+    };
+
+    std::vector<Curve> curves;    ///< The curves in the order of addCurve().
+    std::vector<double> x;        ///< Pulse amplitudes of all curves.
+    std::vector<double> y;        ///< Normalized counts of all curves.
+    std::vector<double> errLo;    ///< Lower errors of y (positive).
+    std::vector<double> errHi;    ///< Upper errors of y (positive).
+
+    std::vector<double> arg;      ///< Scratch: erfc argument per point.
+    std::vector<double> erfcVal;  ///< Scratch: erfc value per point.
+    std::vector<double> gauss;    ///< Scratch: exp(-arg^2) per point.
+    std::vector<double> curveChi2; ///< Chi-square per curve of the last evaluation.
+
+    std::vector<double> lower;    ///< Lower parameter limits.
+    std::vector<double> upper;    ///< Upper parameter limits.
+
+    ThresholdModel thresholdModel = kFreeThresholds; ///< Parametrization of the thresholds.
+    double sigmaStart = 1.0;      ///< Starting value of the shared sigma.
+    double sigmaLow = .1;         ///< Lower limit of sigma.
+    double sigmaHigh = 15.;       ///< Upper limit of sigma.
+    double offsetLow = -1.;       ///< Lower limit of the offsets.
+    double offsetHigh = .5;       ///< Upper limit of the offsets.
+    int maxIterations = 200;      ///< Iteration limit of the minimization.
+    int iterations = 0;           ///< Iterations of the last fit().
+
+    /**
+     * @brief Number of parameters: sigma, the threshold parameters and one offset per curve.
+     * @return The parameter count.
+     */
+    int nPar() const;
+
+    /**
+     * @brief Index of the first offset in the parameter vector.
+     * @return The index.
+     */
+    int offsetIndex() const;
+
+    /**
+     * @brief Threshold of a curve for the given parameters.
+     * @param par The parameter values.
+     * @param k The curve.
+     * @return The threshold.
+     */
+    double curveThreshold(const double* par, std::size_t k) const;
+
+    /**
+     * @brief Evaluates the chi-square and, optionally, the normal equations.
+     * @param par The parameter values.
+     * @param A If not null, receives J^T J (nPar x nPar, row-major).
+     * @param g If not null, receives -J^T r.
+     * @return The chi-square.
+     */
+    double evaluate(const double* par, double* A, double* g);
+
+    /**
+     * @brief Levenberg-Marquardt minimization with box constraints.
+     * @param par Starting values on input, best values on output.
+     * @param chi2 Set to the minimum chi-square.
+     * @return Status: 0 converged, 1 iteration limit reached, 3 numerical failure.
+     */
+    int minimize(std::vector<double>& par, double& chi2);
+
+public:
+    smxErfcSimFitter() = default;
+
+    /**
+     * @brief Removes all curves.
+     */
+    void clear();
+
+    /**
+     * @brief Selects the parametrization of the thresholds.
+     * @param model The threshold model.
+     */
+    void setThresholdModel(ThresholdModel model);
+
+    /**
+     * @brief Adds the points of one comparator, copying them.
+     * @param position Comparator position, used by the linear threshold model.
+     * @param xValues Pulse amplitudes.
+     * @param yValues Normalized counts.
+     * @param yErrLo Lower errors of the counts (sign is ignored).
+     * @param yErrHi Upper errors of the counts.
+     * @param n Number of points.
+     * @param offset Starting offset.
+     * @param threshold Starting threshold.
+     * @param thresholdLow Lower threshold limit, used with free thresholds.
+     * @param thresholdHigh Upper threshold limit, used with free thresholds.
+     */
+    void addCurve(double position, const double* xValues, const double* yValues, const double* yErrLo,
+                  const double* yErrHi, std::size_t n, double offset, double threshold,
+                  double thresholdLow, double thresholdHigh);
+
+    /**
+     * @brief Sets starting value and range of the shared sigma.
+     * @param start Starting value.
+     * @param low Lower limit.
+     * @param high Upper limit.
+     */
+    void setSigma(double start, double low, double high);
+
+    /**
+     * @brief Sets the range of the offsets.
+     * @param low Lower limit.
+     * @param high Upper limit.
+     */
+    void setOffsetLimits(double low, double high);
+
+    /**
+     * @brief Fits all curves at once.
+     * @param results Receives one result per curve in the order of addCurve(), with the
+     *                chi-square contribution of the curve; channel and comparator are left
+     *                untouched, the vector is resized if needed.
+     * @return The status: 0 converged, 1 iteration limit reached, 3 numerical failure,
+     *         4 singular covariance matrix.
+     */
+    int fit(std::vector<smxFitResult>& results);
+
+    /**
+     * @brief Retrieves the number of minimizer iterations of the last fit().
+     * @return The iteration count.
+     */
+    int getIterations() const;
+
+    /**
+     * @brief Retrieves the number of curves.
+     * @return The curve count.
+     */
+    std::size_t getNCurves() const;
+};
+
+#endif // SMX_ERFC_SIM_FITTER_H
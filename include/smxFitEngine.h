@@ -0,0 +1,252 @@
+#ifndef SMX_FIT_ENGINE_H
+#define SMX_FIT_ENGINE_H
+
+#include "smxFitResult.h"
+#include "smxScurveFit.h"
+#include <RooDataSet.h>
+#include <vector>
+
+class smxResultCache;
+class smxFitResultTable;
+
+/**
+ * @class smxFitEngine
+ * @brief Distributes the (channel, comparator) S-curve fits of an ASIC over several worker processes.
+ *
+ * RooFit keeps global state and is not safe to use from several threads, so
+ * the engine uses a fork-based worker pool instead: the datasets are built
+ * once in the parent and shared copy-on-write, every worker owns its own
+ * smxScurveFit variables and model, and the results are written into an
+ * anonymous shared-memory array. Workers take the next (channel, comparator)
+ * task from a shared atomic counter, which balances fits of different cost.
+ * In a simultaneous fit mode or with a warm start a task covers all comparators
+ * of a channel. Warm-starting from the previous channel fits the channels in
+ * one contiguous chain per worker. With a single worker everything runs in the
+ * calling process.
+ */
+class smxFitEngine {
+private:
+    int nWorkers;                        ///< Number of worker processes.
+    smxFitBackend backend = smxFitBackend::RooFit; ///< Minimizer used for every fit.
+    bool momentSeeding = true;           ///< Whether fits are seeded from the S-curve moments.
+    smxFitMode fitMode = smxFitMode::Independent; ///< Independent or simultaneous comparator fits.
+    smxEvalBackend evalBackend = smxEvalBackend::Cpu; ///< Model and evaluation backend of the RooFit fits.
+    int fitWindowMargin = -1;            ///< Plateau points kept around the transition, -1 for all points.
+    double wallTime = 0;                 ///< Wall time of the last fit() call in seconds.
+    std::vector<smxFitResult> results;   ///< Results of the last fit() call, in task order.
+    smxResultCache* resultCache = nullptr; ///< Cache consulted by fit(), not owned.
+    const smxFitResultTable* curveLabels = nullptr; ///< Pre-fit labels of the curves, not owned.
+    smxWarmStart warmStart = smxWarmStart::Off; ///< Source of the starting values of the fits.
+    std::vector<smxFitResult> startValues; ///< Results of a previous scan for smxWarmStart::PreviousScan.
+
+    /**
+     * @brief Looks up the pre-fit label of a channel and comparator.
+     * @param channel The channel number.
+     * @param comparator The comparator number.
+     * @return The smxCurveLabel value, 0 (fittable) without labels.
+     */
+    int curveLabel(int channel, int comparator) const;
+
+    /**
+     * @brief Fits a range of (channel, comparator) pairs of one channel with the engine settings.
+     * @details One comparator in the independent mode without warm start, all comparators of the channel otherwise.
+     *          Pairs labelled as not fittable are left out of the fit and keep their label.
+     * @param datasets The per-channel datasets.
+     * @param tasks The (channel, comparator) pairs.
+     * @param first Index of the first pair of the range.
+     * @param count Number of pairs in the range.
+     * @param out Receives count results.
+     * @param starts Converged results to warm-start from, see smxScurveFit::setStartValues.
+     */
+    void fitUnit(const std::vector<RooDataSet*>& datasets, const std::vector<std::pair<int, int>>& tasks,
+                 size_t first, size_t count, smxFitResult* out, const std::vector<smxFitResult>& starts) const;
+
+    /**
+     * @brief Fits a contiguous range of units in order, passing the start values of the warm start.
+     * @param datasets The per-channel datasets.
+     * @param tasks The (channel, comparator) pairs.
+     * @param units The (first pair, number of pairs) ranges fitted together.
+     * @param chain The (first unit, end unit) range to fit.
+     * @param out The results of all tasks, indexed like tasks.
+     */
+    void fitChain(const std::vector<RooDataSet*>& datasets, const std::vector<std::pair<int, int>>& tasks,
+                  const std::vector<std::pair<size_t, size_t>>& units, std::pair<size_t, size_t> chain,
+                  smxFitResult* out) const;
+
+    /**
+     * @brief Runs all tasks in the calling process.
+     * @param datasets The per-channel datasets.
+     * @param tasks The (channel, comparator) pairs to fit.
+     * @param units The (first pair, number of pairs) ranges fitted together.
+     * @param chains The (first unit, end unit) ranges fitted in order.
+     */
+    void fitInProcess(const std::vector<RooDataSet*>& datasets, const std::vector<std::pair<int, int>>& tasks,
+                      const std::vector<std::pair<size_t, size_t>>& units,
+                      const std::vector<std::pair<size_t, size_t>>& chains);
+
+    /**
+     * @brief Runs all tasks on forked worker processes.
+     * @param datasets The per-channel datasets.
+     * @param tasks The (channel, comparator) pairs to fit.
+     * @param units The (first pair, number of pairs) ranges fitted together.
+     * @param chains The (first unit, end unit) ranges fitted in order, taken one at a time by the workers.
+     * @return False if the shared memory could not be set up or a worker failed.
+     */
+    bool fitForked(const std::vector<RooDataSet*>& datasets, const std::vector<std::pair<int, int>>& tasks,
+                   const std::vector<std::pair<size_t, size_t>>& units,
+                   const std::vector<std::pair<size_t, size_t>>& chains);
+
+public:
+    /**
+     * @brief Constructor.
+     * @param workers Number of worker processes, 0 for the number of hardware threads.
+     */
+    explicit smxFitEngine(int workers = 0);
+
+    /**
+     * @brief Sets the number of worker processes.
+     * @param workers Number of worker processes, 0 for the number of hardware threads.
+     */
+    void setWorkers(int workers);
+
+    /**
+     * @brief Retrieves the number of worker processes.
+     * @return The number of workers.
+     */
+    int getWorkers() const;
+
+    /**
+     * @brief Selects the minimizer used for every fit.
+     * @param fitBackend The backend.
+     */
+    void setBackend(smxFitBackend fitBackend);
+
+    /**
+     * @brief Enables or disables the moment-based seeding of the fits.
+     * @param enable See smxScurveFit::setMomentSeeding.
+     */
+    void setMomentSeeding(bool enable);
+
+    /**
+     * @brief Selects independent or simultaneous comparator fits.
+     * @param mode See smxScurveFit::setFitMode.
+     */
+    void setFitMode(smxFitMode mode);
+
+    /**
+     * @brief Selects the model and the RooFit evaluation backend of the RooFit fits.
+     * @param backendType See smxScurveFit::setEvalBackend.
+     */
+    void setEvalBackend(smxEvalBackend backendType);
+
+    /**
+     * @brief Limits the fits to the transition region of every S-curve.
+     * @param marginPoints See smxScurveFit::setFitWindow.
+     */
+    void setFitWindow(int marginPoints);
+
+    /**
+     * @brief Sets the cache that fit() consults before fitting and fills after fitting.
+     * @details The key covers the points of all datasets, the backend, the seeding and
+     *          smxLibVersion, but not the number of workers, which does not change the results.
+     * @param cache The cache, not owned; nullptr disables caching.
+     */
+    void setResultCache(smxResultCache* cache);
+
+    /**
+     * @brief Sets the pre-fit labels of smxPscan::classifyCurves().
+     * @details Curves that are not fittable are not fitted; their results carry the label,
+     *          status -1 and no fit attempts, and simultaneous fits leave them out.
+     * @param labels The table with the labels, not owned; nullptr fits every curve.
+     */
+    void setCurveLabels(const smxFitResultTable* labels);
+
+    /**
+     * @brief Selects where the starting values of the comparator fits come from.
+     * @details With smxWarmStart::Channel the results depend slightly on the number of workers,
+     *          since the first channel of every worker's chain starts from the seeds.
+     * @param policy The warm-start policy; see smxScurveFit::setWarmStart.
+     */
+    void setWarmStart(smxWarmStart policy);
+
+    /**
+     * @brief Sets the results of a previous scan of the ASIC for smxWarmStart::PreviousScan.
+     * @param previous The results, matched by channel and comparator.
+     */
+    void setStartValues(const std::vector<smxFitResult>& previous);
+
+    /**
+     * @brief Fits all comparators of all given channels.
+     * @param datasets Per-channel datasets as built by smxPscan, indexed by channel; nullptr entries are skipped.
+     * @return The results, ordered by channel and then by comparator.
+     */
+    const std::vector<smxFitResult>& fit(const std::vector<RooDataSet*>& datasets);
+
+    /**
+     * @brief Retrieves the results of the last fit() call.
+     * @return The results, ordered by channel and then by comparator.
+     */
+    const std::vector<smxFitResult>& getResults() const;
+
+    /**
+     * @brief Retrieves the wall time of the last fit() call.
+     * @return The wall time in seconds.
+     */
+    double getWallTime() const;
+
+    /**
+     * @brief Fits the datasets with 1 to maxWorkers workers and reports the speedup.
+     * @details Also checks that every worker count reproduces the single-worker results exactly.
+     * @param datasets Per-channel datasets, indexed by channel.
+     * @param maxWorkers The largest number of workers to try.
+     * @param fitBackend The minimizer to use.
+     * @return Wall times in seconds, index 0 for one worker.
+     */
+    static std::vector<double> measureScaling(const std::vector<RooDataSet*>& datasets, int maxWorkers,
+                                              smxFitBackend fitBackend = smxFitBackend::RooFit);
+
+    /**
+     * @brief Fits the datasets with the RooFit and the native backend and prints the differences.
+     * @param datasets Per-channel datasets, indexed by channel.
+     * @return The largest threshold difference in units of the RooFit threshold error.
+     */
+    static double compareBackends(const std::vector<RooDataSet*>& datasets);
+
+    /**
+     * @brief Fits the datasets with and without moment-based seeding and prints retries and fit times.
+     * @param datasets Per-channel datasets, indexed by channel.
+     * @param fitBackend The minimizer to use.
+     */
+    static void compareSeeding(const std::vector<RooDataSet*>& datasets, smxFitBackend fitBackend = smxFitBackend::RooFit);
+
+    /**
+     * @brief Fits the datasets in every fit mode and prints time, failures and threshold errors.
+     * @param datasets Per-channel datasets, indexed by channel.
+     * @param fitBackend The minimizer to use.
+     */
+    static void compareFitModes(const std::vector<RooDataSet*>& datasets, smxFitBackend fitBackend = smxFitBackend::RooFit);
+
+    /**
+     * @brief Fits every channel with all points and within the fit window and prints, per channel,
+     *        the dropped points, the time saved and the threshold and sigma differences.
+     * @param datasets Per-channel datasets, indexed by channel.
+     * @param marginPoints See smxScurveFit::setFitWindow.
+     * @param fitBackend The minimizer to use.
+     */
+    static void compareFitWindow(const std::vector<RooDataSet*>& datasets, int marginPoints,
+                                 smxFitBackend fitBackend = smxFitBackend::RooFit);
+
+    /**
+     * @brief Fits the datasets from the seeds and with a warm start and prints attempts,
+     *        iterations (native backend), failures, fit times and threshold differences.
+     * @param datasets Per-channel datasets, indexed by channel.
+     * @param policy The warm-start policy.
+     * @param previous Results of a previous scan for smxWarmStart::PreviousScan.
+     * @param fitBackend The minimizer to use.
+     */
+    static void compareWarmStart(const std::vector<RooDataSet*>& datasets, smxWarmStart policy,
+                                 const std::vector<smxFitResult>& previous = {},
+                                 smxFitBackend fitBackend = smxFitBackend::RooFit);
+};
+
+#endif // SMX_FIT_ENGINE_H
@@ -0,0 +1,30 @@
+#ifndef SMX_FIT_RESULT_H
+#define SMX_FIT_RESULT_H
+
+/**
+ * @struct smxFitResult
+ * @brief Result of the S-curve fit of one channel and comparator.
+ * @details Plain data without pointers, so results can be exchanged through shared memory.
+ *          Lower errors are negative, following the RooRealVar::getAsymErrorLo() convention.
+ */
+struct smxFitResult {
+    int channel = -1;            ///< Channel number, -1 if unknown.
+    int comparator = -1;         ///< Comparator (discriminator) number.
+    double offset = 0;           ///< Fitted offset of the normalized counts.
+    double offsetErrLo = 0;      ///< Lower error of the offset.
+    double offsetErrHi = 0;      ///< Upper error of the offset.
+    double threshold = 0;        ///< Fitted threshold in pulse amplitude units.
+    double thresholdErrLo = 0;   ///< Lower error of the threshold.
+    double thresholdErrHi = 0;   ///< Upper error of the threshold.
+    double sigma = 0;            ///< Fitted S-curve width in pulse amplitude units.
+    double sigmaErrLo = 0;       ///< Lower error of sigma.
+    double sigmaErrHi = 0;       ///< Upper error of sigma.
+    double chi2 = -1;            ///< Minimum chi-square, -1 if the fit was not performed.
+    int status = -1;             ///< Minimizer status of the last attempt, -1 if the fit was not performed.
+    int retries = 0;             ///< Number of fit attempts.
+    int label = 0;               ///< smxCurveLabel of the pre-fit classification, 0 (fittable) if not classified.
+    int iterations = 0;          ///< Levenberg-Marquardt iterations of a native comparator fit over all attempts, 0 otherwise.
+    double wallTime = 0;         ///< Wall time of the fit including all attempts, in seconds.
+};
+
+#endif // SMX_FIT_RESULT_H
@@ -0,0 +1,113 @@
+#ifndef SMX_FIT_RESULT_TABLE_H
+#define SMX_FIT_RESULT_TABLE_H
+
+#include "smxConstants.h"
+#include "smxFitResult.h"
+#include <TTree.h>
+#include <vector>
+
+/**
+ * @class smxFitResultTable
+ * @brief Preallocated table of S-curve fit results with one row per (channel, comparator).
+ *
+ * Rows are stored contiguously, ordered by channel and then by the position of the
+ * comparator in the comparator list. Rows that were never fitted keep status -1
+ * and zero attempts and are skipped when the table is written to a TTree, unless
+ * the pre-fit classification labelled them (see smxCurveClassifier).
+ */
+class smxFitResultTable {
+private:
+    std::vector<int> comparators;      ///< Comparator numbers, one column block each.
+    int nChannels = 0;                 ///< Number of channels.
+    std::vector<smxFitResult> rows;    ///< The rows, [channel][comparator index].
+
+    /**
+     * @brief Computes the row index of a channel and comparator.
+     * @param channel The channel number.
+     * @param comparator The comparator number.
+     * @return The index in rows, or -1 if it is not part of the table.
+     */
+    long rowIndex(int channel, int comparator) const;
+
+public:
+    smxFitResultTable() = default;
+
+    /**
+     * @brief Constructor that allocates all rows.
+     * @param compList The comparators of every channel (e.g. the DISC_LIST of the scan).
+     * @param channels The number of channels.
+     */
+    explicit smxFitResultTable(const std::vector<int>& compList, int channels = smxNCh);
+
+    /**
+     * @brief Reallocates the table and marks all rows as not fitted.
+     * @param compList The comparators of every channel.
+     * @param channels The number of channels.
+     */
+    void reset(const std::vector<int>& compList, int channels = smxNCh);
+
+    /**
+     * @brief Stores a result in the row of its channel and comparator.
+     * @param result The fit result.
+     * @return False if the channel or comparator is not part of the table.
+     */
+    bool set(const smxFitResult& result);
+
+    /**
+     * @brief Stores several results.
+     * @param results The fit results.
+     * @return The number of results that could not be stored.
+     */
+    int set(const std::vector<smxFitResult>& results);
+
+    /**
+     * @brief Stores the pre-fit label of a channel and comparator.
+     * @param channel The channel number.
+     * @param comparator The comparator number.
+     * @param label The smxCurveLabel value.
+     * @return False if the channel or comparator is not part of the table.
+     */
+    bool setLabel(int channel, int comparator, int label);
+
+    /**
+     * @brief Checks whether a row holds a fit result or a pre-fit label.
+     * @param row The row.
+     * @return True if the row was fitted or labelled as not fittable.
+     */
+    static bool isFilled(const smxFitResult& row);
+
+    /**
+     * @brief Finds the row of a channel and comparator.
+     * @param channel The channel number.
+     * @param comparator The comparator number.
+     * @return Pointer to the row, or nullptr if it is not part of the table.
+     */
+    const smxFitResult* find(int channel, int comparator) const;
+
+    /**
+     * @brief Retrieves all rows.
+     * @return The rows ordered by channel and comparator.
+     */
+    const std::vector<smxFitResult>& getRows() const;
+
+    /**
+     * @brief Retrieves the comparator list of the table.
+     * @return The comparator numbers.
+     */
+    const std::vector<int>& getComparators() const;
+
+    /**
+     * @brief Counts the rows that hold a fit result or a pre-fit label.
+     * @return The number of filled rows (see isFilled()).
+     */
+    int getNFilled() const;
+
+    /**
+     * @brief Creates a TTree with one entry per filled row and one branch per column.
+     * @param treeName The name of the TTree.
+     * @return Pointer to the new TTree, owned by the caller (or the current directory).
+     */
+    TTree* toTree(const char* treeName = "fitResultsTree") const;
+};
+
+#endif // SMX_FIT_RESULT_TABLE_H
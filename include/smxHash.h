@@ -0,0 +1,70 @@
+#ifndef SMX_HASH_H
+#define SMX_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+/**
+ * @class smxHash
+ * @brief Incremental 64-bit FNV-1a hash used for content-addressed cache keys.
+ */
+class smxHash {
+private:
+    uint64_t state = 14695981039346656037ull; ///< Current hash value (FNV offset basis).
+
+public:
+    /**
+     * @brief Adds raw bytes.
+     * @param data The bytes.
+     * @param size The number of bytes.
+     * @return This hash.
+     */
+    smxHash& add(const void* data, std::size_t size) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            state = (state ^ bytes[i]) * 1099511628211ull;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Adds a string, including its length.
+     * @param text The string.
+     * @return This hash.
+     */
+    smxHash& add(const std::string& text) {
+        add(text.size());
+        return add(text.data(), text.size());
+    }
+
+    /**
+     * @brief Adds a null-terminated string, including its length.
+     * @param text The string.
+     * @return This hash.
+     */
+    smxHash& add(const char* text) {
+        return add(std::string(text));
+    }
+
+    /**
+     * @brief Adds the object representation of a trivially copyable value.
+     * @param value The value.
+     * @return This hash.
+     */
+    template <typename T, typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
+    smxHash& add(const T& value) {
+        return add(&value, sizeof(T));
+    }
+
+    /**
+     * @brief Retrieves the hash value.
+     * @return The 64-bit hash.
+     */
+    uint64_t value() const {
+        return state;
+    }
+};
+
+#endif // SMX_HASH_H
@@ -0,0 +1,188 @@
+#ifndef SMX_INSTRUMENT_H
+#define SMX_INSTRUMENT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * @file smxInstrument.h
+ * @brief Counters and scoped stage timers for the hot paths, compiled out unless SMX_INSTRUMENT is defined.
+ *
+ * Instrumentation sites use the macros below. Without SMX_INSTRUMENT (build
+ * with `make INSTRUMENT=1` to enable it) they expand to nothing and their
+ * arguments are not evaluated. With it, every site looks up its counter once
+ * (function-local static) and then only does a relaxed atomic add, so the
+ * sites are safe in multi-threaded code. The values accumulate over the
+ * process and are written as a JSON summary next to every ROOT file.
+ */
+
+/**
+ * @class smxCounter
+ * @brief Event counter, also used as call counter and time sum of a stage timer.
+ */
+class smxCounter {
+private:
+    std::atomic<int64_t> value{0};       ///< Counted events.
+    std::atomic<int64_t> nanoseconds{0}; ///< Summed time of a stage timer.
+    std::atomic<int64_t> maxNanoseconds{0}; ///< Longest single interval of a stage timer.
+
+public:
+    /**
+     * @brief Adds events.
+     * @param n The number of events.
+     */
+    void add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+
+    /**
+     * @brief Adds one timed interval.
+     * @param ns The interval in nanoseconds.
+     */
+    void addTime(int64_t ns) {
+        value.fetch_add(1, std::memory_order_relaxed);
+        nanoseconds.fetch_add(ns, std::memory_order_relaxed);
+        int64_t longest = maxNanoseconds.load(std::memory_order_relaxed);
+        while (ns > longest && !maxNanoseconds.compare_exchange_weak(longest, ns, std::memory_order_relaxed)) {}
+    }
+
+    int64_t getValue() const { return value.load(std::memory_order_relaxed); }             ///< Counted events or calls.
+    int64_t getNanoseconds() const { return nanoseconds.load(std::memory_order_relaxed); } ///< Summed time.
+    int64_t getMaxNanoseconds() const { return maxNanoseconds.load(std::memory_order_relaxed); } ///< Longest interval.
+
+    /**
+     * @brief Sets all values to zero.
+     */
+    void reset() {
+        value = 0;
+        nanoseconds = 0;
+        maxNanoseconds = 0;
+    }
+};
+
+/**
+ * @class smxIndexedCounter
+ * @brief Array of counters indexed by a small integer, e.g. the channel or the minimizer strategy.
+ */
+class smxIndexedCounter {
+public:
+    static constexpr int maxIndex = 256; ///< Number of slots, events with larger indices are counted as overflow.
+
+private:
+    std::atomic<int64_t> values[maxIndex + 1] = {}; ///< Counts per index, the last slot holds the overflow.
+
+public:
+    /**
+     * @brief Adds events to one index.
+     * @param index The index.
+     * @param n The number of events.
+     */
+    void add(int index, int64_t n) {
+        values[(index >= 0 && index < maxIndex) ? index : maxIndex].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Retrieves the count of one index.
+     * @param index The index, maxIndex for the overflow.
+     * @return The count.
+     */
+    int64_t getValue(int index) const { return values[index].load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Sets all counts to zero.
+     */
+    void reset() {
+        for (auto& value : values) value = 0;
+    }
+};
+
+/**
+ * @class smxScopedTimer
+ * @brief Adds the lifetime of the object to a stage timer.
+ */
+class smxScopedTimer {
+private:
+    smxCounter& timer;                                 ///< The stage timer.
+    std::chrono::steady_clock::time_point start;       ///< Construction time.
+
+public:
+    explicit smxScopedTimer(smxCounter& stageTimer) : timer(stageTimer), start(std::chrono::steady_clock::now()) {}
+    ~smxScopedTimer() {
+        timer.addTime(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    smxScopedTimer(const smxScopedTimer&) = delete;
+    smxScopedTimer& operator=(const smxScopedTimer&) = delete;
+};
+
+/**
+ * @class smxInstrumentation
+ * @brief Process-wide registry of the named counters and timers.
+ */
+class smxInstrumentation {
+private:
+    static std::mutex mutex;                                                  ///< Guards the maps.
+    static std::map<std::string, std::unique_ptr<smxCounter>> counters;       ///< Event counters by name.
+    static std::map<std::string, std::unique_ptr<smxIndexedCounter>> indexedCounters; ///< Indexed counters by name.
+    static std::map<std::string, std::unique_ptr<smxCounter>> timers;         ///< Stage timers by name.
+
+public:
+    /**
+     * @brief Retrieves an event counter, creating it on first use.
+     * @param name The counter name.
+     * @return The counter, valid for the lifetime of the process.
+     */
+    static smxCounter& counter(const std::string& name);
+
+    /**
+     * @brief Retrieves an indexed counter, creating it on first use.
+     * @param name The counter name.
+     * @return The counter, valid for the lifetime of the process.
+     */
+    static smxIndexedCounter& indexedCounter(const std::string& name);
+
+    /**
+     * @brief Retrieves a stage timer, creating it on first use.
+     * @param name The stage name.
+     * @return The timer, valid for the lifetime of the process.
+     */
+    static smxCounter& timer(const std::string& name);
+
+    /**
+     * @brief Sets all counters and timers to zero.
+     */
+    static void reset();
+
+    /**
+     * @brief Writes all counters and timers as JSON.
+     * @param filename The output file.
+     * @return False if the file could not be written.
+     */
+    static bool writeSummary(const std::string& filename);
+};
+
+#ifdef SMX_INSTRUMENT
+#define SMX_INSTRUMENT_CONCAT_(a, b) a##b
+#define SMX_INSTRUMENT_CONCAT(a, b) SMX_INSTRUMENT_CONCAT_(a, b)
+/// Adds n events to the counter name.
+#define SMX_COUNT(name, n) \
+    do { static smxCounter& smxSite = smxInstrumentation::counter(name); smxSite.add(n); } while (0)
+/// Adds n events to slot index of the indexed counter name.
+#define SMX_COUNT_AT(name, index, n) \
+    do { static smxIndexedCounter& smxSite = smxInstrumentation::indexedCounter(name); smxSite.add(index, n); } while (0)
+/// Times the rest of the enclosing scope as stage name.
+#define SMX_TIMER(name) \
+    static smxCounter& SMX_INSTRUMENT_CONCAT(smxTimerSite, __LINE__) = smxInstrumentation::timer(name); \
+    smxScopedTimer SMX_INSTRUMENT_CONCAT(smxTimer, __LINE__)(SMX_INSTRUMENT_CONCAT(smxTimerSite, __LINE__))
+/// Writes the summary of all counters and timers.
+#define SMX_WRITE_SUMMARY(filename) smxInstrumentation::writeSummary(filename)
+#else
+#define SMX_COUNT(name, n) do {} while (0)
+#define SMX_COUNT_AT(name, index, n) do {} while (0)
+#define SMX_TIMER(name) do {} while (0)
+#define SMX_WRITE_SUMMARY(filename) do {} while (0)
+#endif
+
+#endif // SMX_INSTRUMENT_H
@@ -0,0 +1,10 @@
+#ifdef __CLING__
+
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+
+// Compiled RooFit model, cloned and written by RooFit through its dictionary
+#pragma link C++ class smxErfcModel+;
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef SMX_LOG_H
+#define SMX_LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @file smxLog.h
+ * @brief Leveled logging with compile-time removal of low-level sites and an asynchronous sink.
+ *
+ * Log sites use the SMX_LOG_* macros with stream syntax, e.g.
+ * `SMX_LOG_INFO("Parsed " << n << " lines")`. Sites below SMX_LOG_MIN_LEVEL
+ * (0 = debug, 1 = info, the default, 2 = warning, 3 = error; set with
+ * `make LOG_LEVEL=0`) are discarded at compile time. The remaining sites check
+ * the run-time level before formatting anything, so a disabled message costs
+ * one relaxed atomic load.
+ *
+ * Formatted messages are appended to a buffer that a background thread writes
+ * to the terminal in batches, errors and warnings to std::cerr and the rest to
+ * std::cout, in the order they were logged. A process forked from the logging
+ * process writes synchronously, since it has no writer thread.
+ */
+
+/**
+ * @brief Severity of a log message.
+ */
+enum class smxLogLevel : int {
+    Debug = 0,   ///< Per-item diagnostics, e.g. every fit attempt.
+    Info = 1,    ///< Progress and summaries.
+    Warning = 2, ///< Recoverable problems.
+    Error = 3,   ///< Failed operations.
+    Off = 4      ///< Disables all messages (run-time level only).
+};
+
+#ifndef SMX_LOG_MIN_LEVEL
+#define SMX_LOG_MIN_LEVEL 1
+#endif
+
+/**
+ * @class smxLog
+ * @brief Process-wide log sink with a run-time level and a buffered writer thread.
+ */
+class smxLog {
+private:
+    static constexpr size_t maxPending = 65536;          ///< Buffered messages before loggers wait for the writer.
+
+    static std::atomic<int> level;                       ///< Run-time level, messages below it are dropped.
+    static std::atomic<bool> async;                      ///< Whether messages are written by the writer thread.
+
+    std::mutex mutex;                                    ///< Guards the members below.
+    std::condition_variable pendingAdded;                ///< Signalled when messages were added or on shutdown.
+    std::condition_variable pendingWritten;              ///< Signalled when the writer finished a batch.
+    std::vector<std::pair<smxLogLevel, std::string>> pending; ///< Messages not yet written.
+    bool writing = false;                                ///< Whether the writer is writing a batch.
+    bool stopping = false;                               ///< Set by the destructor.
+    std::thread writer;                                  ///< Writer thread, started with the first message.
+    pid_t ownerPid = 0;                                  ///< Process that started the writer thread.
+
+    smxLog() = default;
+    ~smxLog();
+
+    /**
+     * @brief Retrieves the sink.
+     * @return The process-wide instance.
+     */
+    static smxLog& instance();
+
+    /**
+     * @brief Writer thread: writes the buffered messages until shutdown.
+     */
+    void writeLoop();
+
+    /**
+     * @brief Writes messages to the terminal.
+     * @param messages The messages.
+     */
+    static void output(const std::vector<std::pair<smxLogLevel, std::string>>& messages);
+
+public:
+    smxLog(const smxLog&) = delete;
+    smxLog& operator=(const smxLog&) = delete;
+
+    /**
+     * @brief Sets the run-time level.
+     * @param minLevel Messages below this level are dropped.
+     */
+    static void setLevel(smxLogLevel minLevel);
+
+    /**
+     * @brief Retrieves the run-time level.
+     * @return The level.
+     */
+    static smxLogLevel getLevel();
+
+    /**
+     * @brief Checks whether messages of a level are written.
+     * @param messageLevel The level.
+     * @return True if messageLevel is at or above the run-time level.
+     */
+    static bool enabled(smxLogLevel messageLevel) {
+        return static_cast<int>(messageLevel) >= level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Selects the asynchronous (default) or synchronous output.
+     * @param enable If false, every message is written before write() returns.
+     */
+    static void setAsync(bool enable);
+
+    /**
+     * @brief Logs a formatted message; use the SMX_LOG_* macros instead.
+     * @param messageLevel The level.
+     * @param message The message without trailing newline.
+     */
+    static void write(smxLogLevel messageLevel, std::string message);
+
+    /**
+     * @brief Waits until all buffered messages are written, e.g. before printing directly or fork().
+     */
+    static void flush();
+};
+
+/// True if messages of the level are compiled in and enabled at run time.
+#define SMX_LOG_ENABLED(level) \
+    (static_cast<int>(smxLogLevel::level) >= SMX_LOG_MIN_LEVEL && smxLog::enabled(smxLogLevel::level))
+
+/// Logs a message at the given level (Debug, Info, Warning or Error).
+#define SMX_LOG(level, message)                                                     \
+    do {                                                                            \
+        if constexpr (static_cast<int>(smxLogLevel::level) >= SMX_LOG_MIN_LEVEL) {  \
+            if (smxLog::enabled(smxLogLevel::level)) {                              \
+                std::ostringstream smxLogStream;                                    \
+                smxLogStream << message;                                            \
+                smxLog::write(smxLogLevel::level, smxLogStream.str());              \
+            }                                                                       \
+        }                                                                           \
+    } while (0)
+
+#define SMX_LOG_DEBUG(message) SMX_LOG(Debug, message)
+#define SMX_LOG_INFO(message) SMX_LOG(Info, message)
+#define SMX_LOG_WARNING(message) SMX_LOG(Warning, message)
+#define SMX_LOG_ERROR(message) SMX_LOG(Error, message)
+
+#endif // SMX_LOG_H
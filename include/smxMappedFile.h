@@ -0,0 +1,70 @@
+#ifndef SMX_MAPPED_FILE_H
+#define SMX_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @class smxMappedFile
+ * @brief Read-only memory mapping of a whole file (RAII wrapper around mmap).
+ *
+ * The mapping stays valid for the lifetime of the object. Empty files are
+ * reported as open with a null data pointer and zero size.
+ */
+class smxMappedFile {
+private:
+    const char* mapData = nullptr;  ///< Start of the mapped region.
+    std::size_t mapSize = 0;        ///< Size of the mapped region in bytes.
+    bool opened = false;            ///< True if the last open() succeeded.
+
+public:
+    smxMappedFile() = default;
+
+    /**
+     * @brief Constructor that maps the given file immediately.
+     * @param filename The path to the file to map.
+     */
+    explicit smxMappedFile(const std::string& filename);
+
+    /**
+     * @brief Destructor, unmaps the file.
+     */
+    ~smxMappedFile();
+
+    smxMappedFile(const smxMappedFile&) = delete;
+    smxMappedFile& operator=(const smxMappedFile&) = delete;
+    smxMappedFile(smxMappedFile&& other) noexcept;
+    smxMappedFile& operator=(smxMappedFile&& other) noexcept;
+
+    /**
+     * @brief Maps a file, releasing any previous mapping first.
+     * @param filename The path to the file to map.
+     * @return True on success.
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * @brief Releases the mapping.
+     */
+    void close();
+
+    /**
+     * @brief Checks whether a file is currently mapped.
+     * @return True if open() succeeded.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Retrieves the start of the mapped bytes.
+     * @return Pointer to the first byte, or nullptr for empty files.
+     */
+    const char* data() const;
+
+    /**
+     * @brief Retrieves the size of the mapped file.
+     * @return The size in bytes.
+     */
+    std::size_t size() const;
+};
+
+#endif // SMX_MAPPED_FILE_H
@@ -0,0 +1,187 @@
+#ifndef SMX_PIPELINE_H
+#define SMX_PIPELINE_H
+
+#include "smxBoundedQueue.h"
+#include "smxFitResult.h"
+#include "smxPscan.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class smxPipeline
+ * @brief Streams a list of pulse scan files through concurrent parse, fit and write stages.
+ *
+ * A reader thread reads one file after the other into an smxPscan. Since the
+ * files are sorted by pulse amplitude and then by channel, every S-curve is
+ * final once the last line has been read; at that moment the reader hands all
+ * channels of the scan to the fit workers through a bounded queue and starts
+ * on the next file. The fit workers assemble the points of each comparator
+ * straight from the count cube and fit them with smxErfcFitter, which unlike
+ * RooFit is safe to run on several threads. When the last channel of a scan
+ * is fitted, the scan is queued for the writer thread, which stores the
+ * results and writes the ROOT file next to the input. Parsing of file n+1,
+ * fitting of file n and writing of file n-1 thus overlap.
+ *
+ * Peak memory is kept within a budget: before parsing a file the reader
+ * reserves an estimate of the memory the scan will hold until it is written,
+ * and waits while the scans in flight would exceed the budget. A single scan
+ * larger than the budget is still processed, on its own.
+ */
+class smxPipeline {
+private:
+    /**
+     * @brief A parsed scan travelling through the fit and write stages.
+     */
+    struct ScanJob {
+        smxPscan* pscan = nullptr;              ///< The scan, owned by the job.
+        std::vector<smxFitResult> results;      ///< Fit results, [channel * readDiscList size + disc index].
+        std::atomic<int> pendingChannels{0};    ///< Channels not yet fitted.
+        size_t memoryCost = 0;                  ///< Bytes reserved from the budget.
+        double fitTime = 0;                     ///< Summed fit time of all channels in seconds.
+    };
+
+    /**
+     * @brief One channel of a scan to be fitted.
+     */
+    struct ChannelTask {
+        ScanJob* job = nullptr;  ///< The scan.
+        int channel = -1;        ///< The channel number.
+    };
+
+    int nFitWorkers;                         ///< Number of fit threads.
+    size_t memoryBudget;                     ///< Memory budget of the scans in flight in bytes.
+    smxParseMode parseMode = smxParseMode::Fast; ///< Parser used by the reader.
+    bool momentSeeding = true;               ///< Whether fits are seeded from the S-curve moments.
+    bool classify = true;                    ///< Whether curves are classified before fitting.
+    smxRootOutputOptions outputOptions;      ///< Compression and layout of the written ROOT files.
+
+    std::mutex budgetMutex;                  ///< Guards memoryInFlight and peakMemory.
+    std::condition_variable budgetFreed;     ///< Signalled when a scan released its memory.
+    size_t memoryInFlight = 0;               ///< Bytes reserved by the scans in flight.
+    size_t peakMemory = 0;                   ///< Largest memoryInFlight of the last run().
+
+    std::mutex statsMutex;                   ///< Guards the stage times below.
+    double parseTime = 0;                    ///< Busy time of the reader in seconds.
+    double fitTime = 0;                      ///< Busy time of all fit workers in seconds.
+    double writeTime = 0;                    ///< Busy time of the writer in seconds.
+    double wallTime = 0;                     ///< Wall time of the last run() in seconds.
+    int nWritten = 0;                        ///< Scans written by the last run().
+
+    /**
+     * @brief Reader stage: parses the files and queues their channels.
+     * @param files The ASCII or binary scan files.
+     * @param fitQueue Queue of the fit stage.
+     */
+    void readStage(const std::vector<std::string>& files, smxBoundedQueue<ChannelTask>& fitQueue);
+
+    /**
+     * @brief Fit stage: fits queued channels and queues completed scans.
+     * @param fitQueue Queue of the fit stage.
+     * @param writeQueue Queue of the write stage.
+     */
+    void fitStage(smxBoundedQueue<ChannelTask>& fitQueue, smxBoundedQueue<ScanJob*>& writeQueue);
+
+    /**
+     * @brief Write stage: stores the results of completed scans, writes and releases them.
+     * @param writeQueue Queue of the write stage.
+     */
+    void writeStage(smxBoundedQueue<ScanJob*>& writeQueue);
+
+    /**
+     * @brief Reserves memory from the budget, waiting while other scans hold too much.
+     * @param bytes The bytes to reserve.
+     */
+    void acquireMemory(size_t bytes);
+
+    /**
+     * @brief Returns memory to the budget.
+     * @param bytes The bytes to release.
+     */
+    void releaseMemory(size_t bytes);
+
+    /**
+     * @brief Estimates the memory a scan holds from parsing until it is written.
+     * @param filename The ASCII or binary scan file.
+     * @return The estimate in bytes.
+     */
+    static size_t estimateMemory(const std::string& filename);
+
+public:
+    /**
+     * @brief Constructor.
+     * @param fitWorkers Number of fit threads, 0 for the number of hardware threads.
+     * @param memoryBudgetMB Memory budget of the scans in flight in MB.
+     */
+    explicit smxPipeline(int fitWorkers = 0, size_t memoryBudgetMB = 256);
+
+    /**
+     * @brief Fits all ADC comparators of one channel with smxErfcFitter.
+     * @details Uses no RooFit, so different channels may be fitted from several threads at once.
+     *          With classify, curves that smxCurveClassifier does not label fittable only get their label.
+     * @param pscan The scan.
+     * @param channel The channel number.
+     * @param momentSeeding Whether the fits are seeded from the S-curve moments.
+     * @param classify Whether the curves are classified before fitting.
+     * @param results The results of the channel, one per readDiscList entry; comparators without
+     *                points are left untouched.
+     */
+    static void fitChannel(const smxPscan& pscan, int channel, bool momentSeeding, bool classify,
+                           smxFitResult* results);
+
+    /**
+     * @brief Sets the number of fit threads.
+     * @param fitWorkers Number of fit threads, 0 for the number of hardware threads.
+     */
+    void setFitWorkers(int fitWorkers);
+
+    /**
+     * @brief Sets the memory budget of the scans in flight.
+     * @param memoryBudgetMB The budget in MB.
+     */
+    void setMemoryBudget(size_t memoryBudgetMB);
+
+    /**
+     * @brief Selects the parser of the reader stage.
+     * @param mode The parser mode.
+     */
+    void setParseMode(smxParseMode mode);
+
+    /**
+     * @brief Enables or disables the moment-based seeding of the fits.
+     * @param enable See smxScurveFit::setMomentSeeding.
+     */
+    void setMomentSeeding(bool enable);
+
+    /**
+     * @brief Enables or disables the classification of the curves before fitting.
+     * @param enable If false, every curve with points is fitted.
+     */
+    void setClassify(bool enable);
+
+    /**
+     * @brief Sets compression and layout of the written ROOT files.
+     * @details With directToFile the reader creates each data tree in its output file, the
+     *          writer then only adds the remaining baskets and the metadata. A fixed fileName
+     *          would be shared by all scans and is ignored.
+     * @param options The output options.
+     */
+    void setOutputOptions(const smxRootOutputOptions& options);
+
+    /**
+     * @brief Parses, fits and writes all files.
+     * @param files The ASCII or binary scan files, processed in order.
+     * @return The number of ROOT files written.
+     */
+    int run(const std::vector<std::string>& files);
+
+    /**
+     * @brief Retrieves the wall time of the last run().
+     * @return The wall time in seconds.
+     */
+    double getWallTime() const;
+};
+
+#endif // SMX_PIPELINE_H
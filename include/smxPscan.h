@@ -9,8 +9,60 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <span>
+#include <cstdint>
 #include <ctime>
+#include <memory>
 #include "smxAsicSettings.h"
+#include "smxFitResultTable.h"
+#include "smxPscanFile.h"
+
+class smxResultCache;
+class TFile;
+
+/**
+ * @enum smxParseMode
+ * @brief Selects the parser used by smxPscan::readAsciiFile.
+ */
+enum class smxParseMode {
+    Fast,   ///< Memory-mapped, allocation-free line scanner (default).
+    Regex   ///< Reference std::regex parser.
+};
+
+/**
+ * @enum smxCompression
+ * @brief Compression algorithm of the ROOT files written by smxPscan::writeRootFile.
+ */
+enum class smxCompression {
+    Default, ///< ROOT's default algorithm and level.
+    Zlib,    ///< ZLIB.
+    LZ4,     ///< LZ4, fastest to write and read.
+    Zstd     ///< ZSTD, best ratio at moderate speed.
+};
+
+/**
+ * @enum smxOutputFormat
+ * @brief Storage layout of the ROOT files written by smxPscan::writeRootFile.
+ */
+enum class smxOutputFormat {
+    TTree,   ///< pscanTree, pscanSettingsTree, asicSettingsTree and fitResultsTree (default).
+    RNTuple  ///< The same data as the RNTuples pscan, pscanSettings, asicSettings and fitResults.
+};
+
+/**
+ * @struct smxRootOutputOptions
+ * @brief Compression and layout of the ROOT files written by smxPscan::writeRootFile.
+ */
+struct smxRootOutputOptions {
+    smxOutputFormat format = smxOutputFormat::TTree; ///< Storage layout.
+    smxCompression compression = smxCompression::Default; ///< Compression algorithm.
+    int compressionLevel = 5;           ///< Compression level, 0 (none) to 9; ignored for Default.
+    int basketSize = 32000;             ///< Basket size of the data branches in bytes.
+    Long64_t autoFlush = -30000000;     ///< TTree::SetAutoFlush: entries if positive, bytes if negative.
+    bool splitAdc = false;              ///< One ADC_<nn> branch per read ADC discriminator instead of the ADC[31] array.
+    bool directToFile = false;          ///< Create the data tree in the output file before parsing, so baskets are written while parsing (TTree only).
+    std::string fileName;               ///< Output file, empty for <input>_output.root next to the input.
+};
 
 /**
  * @class smxPscan
@@ -19,6 +71,8 @@
  * This class provides functionality for:
  * - Reading ASCII files containing pulse scan data.
  * - Storing data in a ROOT TTree.
+ * - Holding the counts in a dense channel x discriminator x pulse cube of 16-bit counts.
+ * - Reading and writing the compact binary scan format (smxPscanFile), whose counts are used in place.
  * - Converting data into a RooDataSet for statistical analysis.
  * - Managing ASIC settings related to the scan.
  */
@@ -27,12 +81,28 @@ private:
     TTree* pscanTree;                   ///< Internal TTree to store parsed data.
     std::string asciiFileName;          ///< Name of the ASCII file being read.
     std::string asciiFileAddress;       ///< Path to the ASCII file.
+    std::string outputSuffix = "_output"; ///< Appended to the source name for the default output file, "_refit" for re-read ROOT files.
+    bool channelSubset = false;         ///< Whether only some channels were read, the others are zero in the count cube.
     std::vector<int> readDiscList;      ///< Positions of discriminators from the DISC_LIST.
 
     std::time_t readTime;               ///< Timestamp of the scan (epoch time).
     TString asicId;                     ///< ASIC identifier string (e.g., "XA-000-...").
     int nPulses = 100;                  ///< Number of pulses used in the scan.
     smxAsicSettings asicSettings;       ///< Settings for the ASIC used in the scan.
+    smxParseMode parseMode = smxParseMode::Fast; ///< Parser used by readAsciiFile.
+
+    int vpMin = 0;                      ///< First pulse amplitude of the scan (VP_<min>_ in the file name).
+    int vpMax = smxNApmCalU + 1;        ///< Upper bound of the pulse amplitude scan (VP_<max>_ in the file name).
+    int vpStep = 1;                     ///< Pulse amplitude step (VP_<step>_ in the file name).
+    int nVp = 0;                        ///< Number of pulse amplitudes held per S-curve in countCube.
+    int vpStride = 0;                   ///< Number of pulse amplitudes allocated per S-curve in countCube.
+    std::vector<uint16_t> countCube;    ///< Counts, channel-major: [channel][readDiscList index][pulse index].
+    std::shared_ptr<smxPscanFile> binaryFile; ///< Mapped binary scan holding the counts instead of countCube after readBinaryFile().
+    std::vector<RooDataSet*> dataSetCache; ///< Memoized per-channel datasets, owned by smxPscan.
+    smxFitResultTable fitResults;       ///< S-curve fit results, one row per channel and read discriminator.
+    smxResultCache* resultCache = nullptr; ///< Cache consulted by readAsciiFile, not owned.
+    smxRootOutputOptions outputOptions; ///< Compression and layout of the ROOT output.
+    TFile* outputFile = nullptr;        ///< Output file pscanTree is attached to while parsing (directToFile), owned.
 
     /**
      * @brief Creates a TTree representing the settings of the scan.
@@ -51,6 +121,108 @@ private:
      */
     void parseAsciiFileName();
 
+    /**
+     * @brief Creates the data branches of the internal TTree.
+     * @param pulse Buffer for the pulse amplitude.
+     * @param channel Buffer for the channel number.
+     * @param adc Buffer for the smxNAdc comparator counts.
+     * @param tcomp Buffer for the timing comparator.
+     */
+    void setupDataBranches(int& pulse, int& channel, int* adc, int& tcomp);
+
+    /**
+     * @brief Sets the addresses of the data branches of the internal TTree, with the ADC array or split.
+     * @param pulse Buffer for the pulse amplitude.
+     * @param channel Buffer for the channel number.
+     * @param adc Buffer for the smxNAdc comparator counts.
+     * @param tcomp Buffer for the timing comparator.
+     */
+    void setDataBranchAddresses(int& pulse, int& channel, int* adc, int& tcomp) const;
+
+    /**
+     * @brief Checks whether the internal TTree has all data branches.
+     * @return True if pulse, channel, tcomp and either ADC or the ADC_<nn> branches of readDiscList exist.
+     */
+    bool hasDataBranches() const;
+
+    /**
+     * @brief Creates a ROOT file with the compression of the output options.
+     * @param fileName The file name.
+     * @return The file, owned by the caller, or nullptr on error.
+     */
+    TFile* openOutputFile(const std::string& fileName) const;
+
+    /**
+     * @brief Computes the ROOT compression settings of the output options.
+     * @return The algorithm * 100 + level, or -1 for ROOT's default.
+     */
+    int compressionSettings() const;
+
+    /**
+     * @brief Opens the output file and creates an empty pscanTree in it (directToFile).
+     * @return False if the file could not be created; pscanTree stays in memory then.
+     */
+    bool attachTreeToOutput();
+
+    /**
+     * @brief Closes an output file that was attached but not written, e.g. when another file is read.
+     */
+    void discardOutputFile();
+
+    /**
+     * @brief Distributes the counts of one data line over the ADC array and tcomp following readDiscList.
+     * @param values The counts in file order.
+     * @param nValues The number of counts.
+     * @param adc The smxNAdc comparator array to fill, reset to zero first.
+     * @param tcomp Set to the timing comparator if present.
+     */
+    void fillDataEntry(const int* values, int nValues, int* adc, int& tcomp) const;
+
+    /**
+     * @brief Allocates countCube for smxNCh channels, the read discriminators and the VP range.
+     */
+    void allocateCountCube();
+
+    /**
+     * @brief Stores the counts of one data line in countCube.
+     * @param pulse The pulse amplitude of the line.
+     * @param channel The channel number of the line.
+     * @param values The counts in file order.
+     * @param nValues The number of counts.
+     */
+    void fillCountCube(int pulse, int channel, const int* values, int nValues);
+
+    /**
+     * @brief Trims countCube to the pulse amplitudes actually present in the file.
+     */
+    void finalizeCountCube();
+
+    /**
+     * @brief Retrieves the counts of the scan, from the mapped binary file or from countCube.
+     * @return The counts, ordered [channel][readDiscList index][pulse index], empty if nothing was read.
+     */
+    std::span<const uint16_t> cubeCounts() const;
+
+    /**
+     * @brief Describes the scan in the header of the binary format.
+     * @return The header, without size and offset fields.
+     */
+    smxPscanFileHeader makeFileHeader() const;
+
+    /**
+     * @brief Reads the data lines with the reference regex parser.
+     * @param filename The path to the ASCII file.
+     * @return Number of data lines read, or -1 if the file could not be opened.
+     */
+    Long64_t readAsciiFileRegex(const std::string& filename);
+
+    /**
+     * @brief Reads the data lines with the memory-mapped scanner.
+     * @param filename The path to the ASCII file.
+     * @return Number of data lines read, or -1 if the file could not be opened.
+     */
+    Long64_t readAsciiFileFast(const std::string& filename);
+
     /**
      * @brief Formats the read time into a human-readable string.
      * @return A formatted string representing the read time.
@@ -70,17 +242,13 @@ private:
     std::string generateDefaultOutputFileName() const;
 
     /**
-     * @brief Applies asymmetric Poissonian errors to a RooRealVar.
-     * @param countN Pointer to the variable to modify.
-     * @param count The count value used to calculate the errors.
+     * @brief Builds the RooDataSets of one or all channels in a single pass over the data.
+     * @details Reads the count cube if it is filled, otherwise traverses pscanTree once.
+     * @param channelN The channel number, or -1 for all smxNCh channels.
+     * @param splitComparators If true, one dataset per channel and read discriminator.
+     * @return The datasets (see toRooDataSets() for the ordering), empty on error.
      */
-    void applyAsymmetricPoissonianErrors(RooRealVar* countN) const;
-
-    /**
-     * @brief Applies Wilson score confidence interval errors to a RooRealVar.
-     * @param countN Pointer to the variable to modify.
-     */
-    void applyWillsonErrors(RooRealVar* countN) const;
+    std::vector<RooDataSet*> buildDataSets(int channelN, bool splitComparators) const;
 
 public:
     /**
@@ -101,19 +269,192 @@ public:
      */
     RooDataSet* toRooDataSet(int channelN) const;
 
+    /**
+     * @brief Converts the pulse scan data of all channels to RooDataSets in a single pass.
+     * @param splitComparators If true, one dataset per channel and read discriminator.
+     * @return Datasets indexed by channel, or by channel * readDiscList.size() + discriminator index
+     *         if split. Ownership passes to the caller.
+     */
+    std::vector<RooDataSet*> toRooDataSets(bool splitComparators = false) const;
+
+    /**
+     * @brief Retrieves the RooDataSet of one channel, building the datasets of all channels on first access.
+     * @param channelN The channel number.
+     * @return A pointer to the dataset owned by smxPscan, or nullptr on error.
+     */
+    RooDataSet* getRooDataSet(int channelN);
+
+    /**
+     * @brief Deletes the memoized datasets, e.g. after the data was re-read.
+     */
+    void clearDataSetCache();
+
     /**
      * @brief Reads an ASCII file and populates the internal TTree.
+     * @details With a result cache set, an unchanged file is loaded from its cached binary
+     *          conversion instead (see readBinaryFile), and a parsed file is added to the cache.
      * @param filename The path to the ASCII file.
      * @return A pointer to the populated TTree.
      */
     TTree* readAsciiFile(const std::string& filename);
 
+    /**
+     * @brief Loads a binary pulse scan file written by writeBinaryFile.
+     * @details The file is memory-mapped and its counts are used in place, nothing is parsed
+     *          or copied. pscanTree stays empty until fillTreeFromCube() or writeRootFile().
+     * @param filename The path to the binary file.
+     * @return A pointer to the (empty) TTree.
+     */
+    TTree* readBinaryFile(const std::string& filename);
+
+    /**
+     * @brief Reads a binary, a ROOT (TTree or RNTuple) or an ASCII pulse scan file, depending on its magic bytes and extension.
+     * @param filename The path to the file.
+     * @return A pointer to the TTree.
+     */
+    TTree* readFile(const std::string& filename);
+
+    /**
+     * @brief Reconstructs the scan from a ROOT file written by writeRootFile in the TTree layout.
+     * @details Reads pscanSettingsTree and asicSettingsTree, the counts into the count cube and the
+     *          fit results of fitResultsTree. Of pscanTree only pulse, channel and the ADC or
+     *          ADC_<nn> branches are enabled; the channel branch is read for every entry, the others
+     *          only for the entries of the requested channels, so the remaining channels stay zero and
+     *          are not unpacked. Counts of discriminators beyond the ADC array are not stored in the
+     *          tree and read as zero. pscanTree stays empty until fillTreeFromCube() or writeRootFile().
+     *          The default output file becomes <source>_refit.root, so the input is not overwritten,
+     *          and writeRootFile() refuses to write a scan read with a channel selection.
+     * @param filename The path to the ROOT file.
+     * @param channels The channels to read, empty for all.
+     * @return A pointer to the (empty) TTree.
+     */
+    TTree* readRootFile(const std::string& filename, const std::vector<int>& channels = {});
+
+    /**
+     * @brief Loads a ROOT file with the RNTuples written by writeRNTupleFile.
+     * @details The settings, the counts and the stored fit results are read back into the
+     *          count cube and the fit results table. pscanTree stays empty until
+     *          fillTreeFromCube() or writeRootFile(). The default output file becomes
+     *          <source>_refit.root, so the input is not overwritten.
+     * @param filename The path to the ROOT file.
+     * @return A pointer to the (empty) TTree.
+     */
+    TTree* readRNTupleFile(const std::string& filename);
+
+    /**
+     * @brief Checks whether a ROOT file holds the pscan RNTuple.
+     * @param filename The path to the file.
+     * @return True if the file opens and has a key named pscan.
+     */
+    static bool isRNTupleFile(const std::string& filename);
+
+    /**
+     * @brief Writes the scan in the binary format.
+     * @param outputFileName The name of the output file, by default the ASCII file name with the extension .pscan.
+     * @return False if nothing was read or the file could not be written.
+     */
+    bool writeBinaryFile(const std::string& outputFileName = "") const;
+
+    /**
+     * @brief Writes the scan in the ASCII format of the DAQ.
+     * @param outputFileName The name of the output file.
+     * @return False if nothing was read or the file could not be written.
+     */
+    bool writeAsciiFile(const std::string& outputFileName) const;
+
+    /**
+     * @brief Fills the internal TTree from the count cube, e.g. after readBinaryFile.
+     * @return A pointer to the TTree.
+     */
+    TTree* fillTreeFromCube();
+
+    /**
+     * @brief Sets the cache that readAsciiFile consults before parsing and fills after parsing.
+     * @param cache The cache, not owned; nullptr disables caching.
+     */
+    void setResultCache(smxResultCache* cache);
+
+    /**
+     * @brief Selects the parser used by readAsciiFile.
+     * @param mode The parser mode.
+     */
+    void setParseMode(smxParseMode mode);
+
+    /**
+     * @brief Retrieves the parser used by readAsciiFile.
+     * @return The parser mode.
+     */
+    smxParseMode getParseMode() const;
+
+    /**
+     * @brief Retrieves the fit results table, written by writeRootFile as fitResultsTree.
+     * @return A reference to the table, laid out for smxNCh channels and readDiscList after reading.
+     */
+    smxFitResultTable& getFitResults();
+
+    /**
+     * @brief Labels the S-curve of every channel and comparator with smxCurveClassifier.
+     * @details One pass over the count cube; the labels are stored in the fit results table,
+     *          where smxFitEngine::setCurveLabels picks them up to skip the curves that are not fittable.
+     * @return The number of curves that are not fittable.
+     */
+    int classifyCurves();
+
+    /**
+     * @brief Sets compression, basket size, auto-flush and branch layout of the ROOT output.
+     * @details Takes effect for the next readAsciiFile (branch layout, directToFile) and writeRootFile.
+     * @param options The output options.
+     */
+    void setOutputOptions(const smxRootOutputOptions& options);
+
+    /**
+     * @brief Retrieves the output options.
+     * @return The options.
+     */
+    const smxRootOutputOptions& getOutputOptions() const;
+
     /**
      * @brief Writes the TTree to a ROOT file.
-     * @param outputFileName The name of the output file (optional).
+     * @details If the tree was created in its output file while parsing (directToFile), only the
+     *          remaining baskets are written and the tree is empty afterwards; the counts stay
+     *          available from the count cube. Otherwise the in-memory tree is copied to the file.
+     *          With the RNTuple format of the output options, writeRNTupleFile() is used instead.
+     * @param outputFileName The name of the output file (optional, see smxRootOutputOptions::fileName).
      */
     void writeRootFile(const std::string& outputFileName = "");
 
+    /**
+     * @brief Writes the scan, its settings and the filled fit results as RNTuples.
+     * @details Writes the RNTuples pscan (pulse, channel and one 16-bit ADC_<nn> column per
+     *          discriminator of readDiscList, in the entry order of the ASCII file), pscanSettings,
+     *          asicSettings and, if any fit was stored, fitResults (columns named like the branches
+     *          of fitResultsTree) with the compression of the output options.
+     * @param outputFileName The name of the output file (optional, see smxRootOutputOptions::fileName).
+     * @return False if nothing was read or the file could not be written.
+     */
+    bool writeRNTupleFile(const std::string& outputFileName = "") const;
+
+    /**
+     * @brief Parses and writes a file with several output options and prints time, throughput and file size.
+     * @param filename The ASCII file.
+     * @param configurations Pairs of a label and the options; the files are written to the temporary
+     *                       directory and deleted after measuring their size.
+     */
+    static void measureOutputOptions(const std::string& filename,
+                                     const std::vector<std::pair<std::string, smxRootOutputOptions>>& configurations);
+
+    /**
+     * @brief Compares reading a scan back from the TTree and the RNTuple layout.
+     * @details Parses the ASCII file, writes it in both layouts to the temporary directory and
+     *          reads all counts back several times: through the branches of pscanTree, through
+     *          the columns of the pscan RNTuple and with readRNTupleFile(). Prints the file size,
+     *          the mean read time and the throughput in entries and file MB per second, and
+     *          checks that all paths read the same counts.
+     * @param filename The ASCII file.
+     * @param repeats The number of reads per layout.
+     */
+    static void measureReadThroughput(const std::string& filename, int repeats = 5);
+
     /**
      * @brief Retrieves the internal TTree.
      * @return A pointer to the TTree.
@@ -132,12 +473,76 @@ public:
      */
     std::string getAsciiFileAddress() const;
 
+    /**
+     * @brief Retrieves the file writeRootFile() writes to when no name is passed.
+     * @return smxRootOutputOptions::fileName, or <input>_output.root (<input>_refit.root for a
+     *         re-read ROOT file) next to the input.
+     */
+    std::string getOutputFileName() const;
+
+    /**
+     * @brief Builds the name of the instrumentation summary (see smxInstrument.h) written next to a ROOT file.
+     * @param rootFileName The ROOT file, empty for the default output file name.
+     * @return The ROOT file name with the extension .stats.json.
+     */
+    std::string getSummaryFileName(const std::string& rootFileName = "") const;
+
     /**
      * @brief Retrieves the discriminator list positions.
      * @return A reference to the vector containing the positions.
      */
     const std::vector<int>& getReadDiscList() const;
 
+    /**
+     * @brief Retrieves the index of a discriminator in the read discriminator list.
+     * @param comparator The discriminator number (0-31).
+     * @return The index in readDiscList, or -1 if it was not read.
+     */
+    int getDiscIndex(int comparator) const;
+
+    /**
+     * @brief Retrieves the number of pulse amplitudes per S-curve in the count cube.
+     * @return The number of pulse amplitudes.
+     */
+    int getNVp() const;
+
+    /**
+     * @brief Converts a pulse index of the count cube into a pulse amplitude.
+     * @param vpIndex The pulse index (0 to getNVp()-1).
+     * @return The pulse amplitude in a.u.
+     */
+    int getPulseAmplitude(int vpIndex) const;
+
+    /**
+     * @brief Retrieves all counts of one channel.
+     * @param channelN The channel number.
+     * @return Contiguous counts ordered [readDiscList index][pulse index], empty if out of range.
+     */
+    std::span<const uint16_t> getChannelCounts(int channelN) const;
+
+    /**
+     * @brief Retrieves the S-curve of one channel and discriminator.
+     * @param channelN The channel number.
+     * @param discIndex The index in readDiscList (see getDiscIndex()).
+     * @return Contiguous counts ordered by pulse index, empty if out of range.
+     */
+    std::span<const uint16_t> getComparatorCounts(int channelN, int discIndex) const;
+
+    /**
+     * @brief Computes the normalized S-curve points of one channel and discriminator from the count cube.
+     * @details Gives the pulseAmp and countNorm values and errors of the dataset points without
+     *          using RooFit, so it may be called from several threads at once.
+     * @param channelN The channel number.
+     * @param discIndex The index in readDiscList (see getDiscIndex()).
+     * @param x Filled with the pulse amplitudes.
+     * @param y Filled with the normalized counts.
+     * @param yErrLo Filled with the lower errors (negative).
+     * @param yErrHi Filled with the upper errors.
+     * @return The number of points, 0 if out of range or not an ADC comparator.
+     */
+    size_t getComparatorPoints(int channelN, int discIndex, std::vector<double>& x, std::vector<double>& y,
+                               std::vector<double>& yErrLo, std::vector<double>& yErrHi) const;
+
     /**
      * @brief Retrieves the read time as epoch time.
      * @return The read time.
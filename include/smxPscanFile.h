@@ -0,0 +1,149 @@
+#ifndef SMX_PSCAN_FILE_H
+#define SMX_PSCAN_FILE_H
+
+#include "smxMappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <type_traits>
+
+/**
+ * @brief Magic bytes at the start of a binary pulse scan file.
+ */
+constexpr char smxPscanFileMagic[8] = {'S', 'M', 'X', 'P', 'S', 'C', 'A', 'N'};
+
+/**
+ * @brief Current version of the binary pulse scan format.
+ */
+constexpr uint32_t smxPscanFileVersion = 1;
+
+/**
+ * @brief Byte order marker, written as a native uint32_t.
+ */
+constexpr uint32_t smxPscanFileByteOrder = 0x01020304;
+
+/**
+ * @brief Maximum number of read discriminators stored in the header.
+ */
+constexpr int smxPscanFileMaxDisc = 32;
+
+/**
+ * @struct smxPscanFileHeader
+ * @brief Fixed-size header of a binary pulse scan file (version 1).
+ * @details The header is followed, at cubeOffset, by the counts as packed uint16_t in
+ *          the order [channel][discList index][pulse index], the layout of the smxPscan
+ *          count cube. All fields are stored in the byte order of the writer.
+ */
+struct smxPscanFileHeader {
+    char magic[8];                      ///< smxPscanFileMagic.
+    uint32_t version;                   ///< Format version.
+    uint32_t headerSize;                ///< Size of the header in bytes.
+    uint32_t byteOrder;                 ///< smxPscanFileByteOrder.
+    int32_t nPulses;                    ///< Number of pulses per amplitude.
+    int64_t readTime;                   ///< Timestamp of the scan (epoch time).
+    char asicId[64];                    ///< ASIC identifier, null-terminated.
+    char sourceName[256];               ///< Name of the ASCII file the scan was read from, null-terminated.
+    int32_t pol;                        ///< Polarity setting.
+    int32_t vrefP;                      ///< Vref_p setting.
+    int32_t vrefN;                      ///< Vref_n setting.
+    int32_t thr2Glb;                    ///< Thr2_glb setting.
+    int32_t vrefT;                      ///< Vref_t setting.
+    int32_t vrefTRange;                 ///< Vref_t_range setting.
+    int32_t vpMin;                      ///< First pulse amplitude.
+    int32_t vpMax;                      ///< Upper bound of the pulse amplitude scan.
+    int32_t vpStep;                     ///< Pulse amplitude step.
+    int32_t nVp;                        ///< Number of pulse amplitudes per S-curve.
+    int32_t nChannels;                  ///< Number of channels.
+    int32_t nDisc;                      ///< Number of read discriminators.
+    int32_t discList[smxPscanFileMaxDisc]; ///< Read discriminators in file order (DISC_LIST).
+    uint64_t cubeOffset;                ///< Byte offset of the counts from the start of the file.
+    uint64_t cubeCount;                 ///< Number of counts, nChannels * nDisc * nVp.
+};
+
+static_assert(std::is_trivially_copyable_v<smxPscanFileHeader> && std::is_standard_layout_v<smxPscanFileHeader>,
+              "smxPscanFileHeader is read by a pointer cast");
+static_assert(sizeof(smxPscanFileHeader) == 544, "Changing the header layout requires a new format version");
+
+/**
+ * @class smxPscanFile
+ * @brief Reader and writers of the binary pulse scan format.
+ *
+ * open() maps the file read-only and validates the header; the header and the
+ * counts are then accessed in place, without copying or parsing. The class
+ * does not depend on ROOT.
+ */
+class smxPscanFile {
+private:
+    smxMappedFile file;                         ///< The mapped file.
+    const smxPscanFileHeader* header = nullptr; ///< Header in the mapping, nullptr if not open.
+    std::span<const uint16_t> counts;           ///< Counts in the mapping.
+
+public:
+    smxPscanFile() = default;
+
+    /**
+     * @brief Maps a binary pulse scan file and validates its header.
+     * @param filename The path to the file.
+     * @return False if the file could not be mapped or is not a valid version 1 file.
+     */
+    bool open(const std::string& filename);
+
+    /**
+     * @brief Unmaps the file.
+     */
+    void close();
+
+    /**
+     * @brief Checks whether a file is mapped.
+     * @return True if open() succeeded.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Retrieves the header of the mapped file.
+     * @return A reference into the mapping, valid until close().
+     */
+    const smxPscanFileHeader& getHeader() const;
+
+    /**
+     * @brief Retrieves the counts of the mapped file.
+     * @return The counts, ordered [channel][discList index][pulse index].
+     */
+    std::span<const uint16_t> getCounts() const;
+
+    /**
+     * @brief Checks the magic bytes of a file.
+     * @param filename The path to the file.
+     * @return True if the file starts with smxPscanFileMagic.
+     */
+    static bool isPscanFile(const std::string& filename);
+
+    /**
+     * @brief Prepares a header with magic, version and byte order set and all other fields zeroed.
+     * @return The header.
+     */
+    static smxPscanFileHeader makeHeader();
+
+    /**
+     * @brief Writes a binary pulse scan file.
+     * @param filename The path to the output file.
+     * @param fileHeader The header; size, offset and count fields are filled in.
+     * @param cubeCounts The counts, nChannels * nDisc * nVp values.
+     * @return False on inconsistent input or if the file could not be written.
+     */
+    static bool write(const std::string& filename, const smxPscanFileHeader& fileHeader,
+                      std::span<const uint16_t> cubeCounts);
+
+    /**
+     * @brief Writes the scan in the ASCII format of the DAQ.
+     * @param filename The path to the output file.
+     * @param fileHeader The header.
+     * @param cubeCounts The counts, nChannels * nDisc * nVp values.
+     * @return False on inconsistent input or if the file could not be written.
+     */
+    static bool writeAscii(const std::string& filename, const smxPscanFileHeader& fileHeader,
+                           std::span<const uint16_t> cubeCounts);
+};
+
+#endif // SMX_PSCAN_FILE_H
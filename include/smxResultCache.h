@@ -0,0 +1,149 @@
+#ifndef SMX_RESULT_CACHE_H
+#define SMX_RESULT_CACHE_H
+
+#include "smxFitResult.h"
+#include "smxHash.h"
+#include <RooDataSet.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class smxPscan;
+
+/**
+ * @class smxResultCache
+ * @brief Local on-disk cache of converted scans and fit results, keyed by content hashes.
+ *
+ * Scans are keyed by the hash of the input file contents and smxLibVersion and
+ * stored in the binary .pscan format, so a cached scan is loaded by mapping it.
+ * Fit results are keyed by the hash of the fitted points, the fit configuration
+ * and smxLibVersion, and stored as a flat smxFitResult array. Changing any of
+ * these inputs changes the key, so stale entries are never returned; they age
+ * out instead: entries are files whose modification time is refreshed on every
+ * hit, and the least recently used ones are deleted when the cache grows beyond
+ * its size limit. Entries are written to a temporary file and renamed, so
+ * several processes can share one cache directory.
+ */
+class smxResultCache {
+private:
+    std::string directory;          ///< Cache directory.
+    uint64_t maxBytes;              ///< Size limit of the cache directory.
+    uint64_t currentBytes = 0;      ///< Size of all entries, as of the last scan of the directory plus stores.
+    long hits = 0;                  ///< Successful lookups.
+    long misses = 0;                ///< Failed lookups.
+    long stores = 0;                ///< Entries written.
+    long evictions = 0;             ///< Entries deleted to respect the size limit.
+    mutable std::mutex mutex;       ///< Guards the statistics and currentBytes.
+
+    /**
+     * @brief Builds the path of an entry.
+     * @param key The entry key.
+     * @param extension The file extension including the dot.
+     * @return The path.
+     */
+    std::string entryPath(uint64_t key, const char* extension) const;
+
+    /**
+     * @brief Looks up an entry, counting the hit or miss and marking it as recently used.
+     * @param path The entry path.
+     * @return True if the entry exists.
+     */
+    bool lookup(const std::string& path);
+
+    /**
+     * @brief Accounts for a new entry and evicts the least recently used entries if needed.
+     * @param path The entry path.
+     */
+    void commit(const std::string& path);
+
+    /**
+     * @brief Sums the sizes of all entries in the cache directory.
+     * @return The size in bytes.
+     */
+    uint64_t directorySize() const;
+
+public:
+    /**
+     * @brief Constructor, creates the cache directory if needed.
+     * @param cacheDirectory The directory, empty for defaultDirectory().
+     * @param maxMegaBytes The size limit in MB.
+     */
+    explicit smxResultCache(const std::string& cacheDirectory = "", uint64_t maxMegaBytes = 2048);
+
+    /**
+     * @brief Retrieves the default cache directory.
+     * @return $SMX_CACHE_DIR if set, otherwise $HOME/.cache/smx_pscan.
+     */
+    static std::string defaultDirectory();
+
+    /**
+     * @brief Computes the key of a scan file from its contents.
+     * @param filename The path to the ASCII file.
+     * @return The key, 0 if the file could not be read.
+     */
+    static uint64_t scanKey(const std::string& filename);
+
+    /**
+     * @brief Adds the points of a dataset (pulseAmp, countNorm with its errors, adcComp) to a hash.
+     * @param hash The hash to update.
+     * @param dataset The dataset, nullptr adds a marker.
+     */
+    static void addDataSet(smxHash& hash, RooDataSet* dataset);
+
+    /**
+     * @brief Looks up a converted scan.
+     * @param key The scan key (see scanKey()).
+     * @return The path of the cached binary scan, empty on a miss.
+     */
+    std::string lookupScan(uint64_t key);
+
+    /**
+     * @brief Stores a converted scan.
+     * @param key The scan key (see scanKey()).
+     * @param pscan The scan to store.
+     * @return False if the entry could not be written.
+     */
+    bool storeScan(uint64_t key, const smxPscan& pscan);
+
+    /**
+     * @brief Looks up fit results.
+     * @param key The key of the fitted data and fit configuration.
+     * @param results Receives the results on a hit.
+     * @return True on a hit.
+     */
+    bool loadFits(uint64_t key, std::vector<smxFitResult>& results);
+
+    /**
+     * @brief Stores fit results.
+     * @param key The key of the fitted data and fit configuration.
+     * @param results The results.
+     * @return False if the entry could not be written.
+     */
+    bool storeFits(uint64_t key, const std::vector<smxFitResult>& results);
+
+    /**
+     * @brief Retrieves the number of successful lookups.
+     * @return The hit count.
+     */
+    long getHits() const;
+
+    /**
+     * @brief Retrieves the number of failed lookups.
+     * @return The miss count.
+     */
+    long getMisses() const;
+
+    /**
+     * @brief Retrieves the number of entries deleted to respect the size limit.
+     * @return The eviction count.
+     */
+    long getEvictions() const;
+
+    /**
+     * @brief Prints hits, misses, stores, evictions and the cache size.
+     */
+    void printStatistics() const;
+};
+
+#endif // SMX_RESULT_CACHE_H
@@ -6,17 +6,85 @@
 #include <RooCategory.h>
 #include <RooFormulaVar.h>
 #include <RooFitResult.h>
+#include "smxFitResult.h"
 #include <TString.h>
 #include <TCanvas.h>
 #include <iostream>
 #include <vector>
 
+class smxResultCache;
+
+/**
+ * @enum smxFitBackend
+ * @brief Selects the minimizer used by smxScurveFit::fitScurvesSeq.
+ */
+enum class smxFitBackend {
+    RooFit,   ///< Model minimized with chi2FitTo (default): compiled smxErfcModel with the cpu and legacy
+              ///< evaluation backends, a RooFormulaVar with the codegen backend, see smxEvalBackend.
+    Native    ///< Analytic Levenberg-Marquardt fit, see smxErfcFitter.
+};
+
+/**
+ * @enum smxEvalBackend
+ * @brief Selects the S-curve model and RooFit evaluation backend of the RooFit fits.
+ */
+enum class smxEvalBackend {
+    Legacy,   ///< smxErfcModel evaluated point by point with evaluate() (RooFit "legacy").
+    Cpu,      ///< Compiled smxErfcModel evaluated in batches (RooFit "cpu", default).
+    Codegen   ///< RooFormulaVar model translated to generated code (RooFit "codegen").
+};
+
+/**
+ * @enum smxFitMode
+ * @brief Selects whether the comparators of a channel are fitted one by one or together.
+ */
+enum class smxFitMode {
+    Independent,      ///< One fit per comparator (default).
+    SharedSigma,      ///< One fit per channel with a shared sigma and one threshold per comparator.
+    LinearThresholds  ///< One fit per channel with a shared sigma and thresholds linear in the comparator number.
+};
+
+/**
+ * @enum smxWarmStart
+ * @brief Selects where the starting values of the independent comparator fits come from.
+ */
+enum class smxWarmStart {
+    Off,          ///< Moment seeds or fixed defaults for every fit (default).
+    Comparator,   ///< Converged result of the previous comparators of the channel.
+    Channel,      ///< Converged result of the same comparator on the previous channel.
+    PreviousScan  ///< Converged result of the same channel and comparator in a previous scan of the ASIC.
+};
+
 /**
  * @class smxScurveFit
  * @brief Class for fitting S-curve data using RooFit, specifically with an error function (erfc) model.
  */
 class smxScurveFit {
 private:
+    /**
+     * @brief The points of one comparator, split from the dataset once at construction.
+     */
+    struct ComparatorPartition {
+        std::vector<double> x;      ///< Pulse amplitudes.
+        std::vector<double> y;      ///< Normalized counts.
+        std::vector<double> yErrLo; ///< Lower errors of the normalized counts.
+        std::vector<double> yErrHi; ///< Upper errors of the normalized counts.
+        RooDataSet* dataSet = nullptr; ///< pulseAmp and countNorm of the comparator for chi2FitTo, built on first use.
+    };
+
+    /**
+     * @brief Starting values and ranges of one comparator for a simultaneous fit.
+     */
+    struct ComparatorSeed {
+        double offset = 0;          ///< Starting offset.
+        double threshold = 60;      ///< Starting threshold.
+        double thresholdLow = -1;   ///< Lower threshold limit.
+        double thresholdHigh = 256; ///< Upper threshold limit.
+        double sigma = 1;           ///< Starting sigma.
+        double sigmaLow = .1;       ///< Lower sigma limit.
+        double sigmaHigh = 15;      ///< Upper sigma limit.
+    };
+
     RooDataSet* data;           ///< Pointer to the RooDataSet for fitting.
     int channel;                ///< Channel number, -1 if unknown.
     int comparator;             ///< Comparator number, -1 if unknown.
@@ -31,9 +99,26 @@ private:
     RooRealVar* threshold;      ///< Pointer to the threshold parameter.
     RooRealVar* sigma;          ///< Pointer to the sigma parameter.
 
-    RooFormulaVar* fitModel;    ///< Pointer to the error function model used for fitting.
+    RooAbsReal* fitModel;       ///< Pointer to the error function model used for fitting.
 
-    RooDataSet* fitResults;     ///< Pointer to the resulted variables of the fits.
+    std::vector<smxFitResult> results; ///< Results of the last fitScurvesSeq() call, one per comparator.
+    smxFitBackend backend = smxFitBackend::RooFit; ///< Minimizer used by fitScurvesSeq().
+    smxFitMode fitMode = smxFitMode::Independent; ///< Independent or simultaneous comparator fits.
+    smxEvalBackend evalBackend = smxEvalBackend::Cpu; ///< Model and evaluation backend of the RooFit fits.
+    bool momentSeeding = true;  ///< Seed each fit from the moments of the S-curve derivative.
+    smxResultCache* resultCache = nullptr; ///< Cache consulted by fitScurvesSeq(), not owned.
+    std::vector<ComparatorPartition> partitions; ///< Points per comparator, in the order of readDiscList.
+    int fitWindowMargin = -1;   ///< Saturated points kept on each side of the transition, -1 for all points.
+    int droppedPoints = 0;      ///< Points removed from the partitions by the fit window.
+    std::vector<int> skippedComparators; ///< Comparators left out by fitScurvesSeq(), e.g. dead curves.
+    bool warmStart = false;     ///< Start the independent fits from converged results instead of the seeds.
+    std::vector<smxFitResult> startValues; ///< Converged results to start from, matched by comparator.
+
+    /**
+     * @brief Computes the cache key of fitScurvesSeq() from the data and the fit configuration.
+     * @return The key.
+     */
+    uint64_t cacheKey() const;
 
     /**
      * @brief Initialize all variables and the model for the error function fit.
@@ -43,10 +128,115 @@ private:
 
     /**
      * @brief Initialize the error function model.
-     * @details Sets up the `fitModel` using `RooFormulaVar` and the initialized variables.
+     * @details Sets up the `fitModel` with createModel() and the initialized variables.
      */
     void setupFitModel();
 
+    /**
+     * @brief Creates the S-curve model of pulseAmp for the selected evaluation backend.
+     * @details smxErfcModel for the cpu and legacy backends, a RooFormulaVar for codegen.
+     * @param name Name of the model.
+     * @param offsetVar The offset.
+     * @param thresholdVar The threshold.
+     * @param sigmaVar The width.
+     * @return The model, owned by the caller.
+     */
+    RooAbsReal* createModel(const char* name, RooAbsReal& offsetVar, RooAbsReal& thresholdVar, RooAbsReal& sigmaVar) const;
+
+    /**
+     * @brief Resets offset, threshold and sigma to their starting values and ranges.
+     * @details Called before every comparator fit, so each fit is independent of the fitting order.
+     */
+    void resetParameters();
+
+    /**
+     * @brief Seeds offset, threshold and sigma from smxErfcFitter::estimateMoments and narrows their ranges.
+     * @param selectedDisc The comparator to be fitted.
+     * @return False if no estimate was possible, the defaults are kept then.
+     */
+    bool seedParameters(int selectedDisc);
+
+    /**
+     * @brief Starts offset, threshold and sigma from a converged result, keeping the full ranges.
+     * @details Takes the start value of the comparator if there is one, otherwise the last converged
+     *          comparator of this fitScurvesSeq() call with the threshold extrapolated linearly from
+     *          the two last converged comparators. Falling back from given start values is counted
+     *          as "warmStartFallbacks".
+     * @param selectedDisc The comparator to be fitted.
+     * @return False if there is no converged result to start from, the parameters are unchanged then.
+     */
+    bool warmStartParameters(int selectedDisc);
+
+    /**
+     * @brief Splits the dataset into one partition per comparator in a single pass.
+     * @details Replaces a cut expression and a dataset copy per comparator in the fit loop.
+     */
+    void partitionData();
+
+    /**
+     * @brief Removes the saturated points outside the fit window from the partitions.
+     * @details The transition of a comparator runs from the first point that differs from the
+     *          first point to the last point that differs from the last point; fitWindowMargin
+     *          points of each plateau are kept. Curves that are flat or not ordered in the pulse
+     *          amplitude are left untouched.
+     */
+    void applyFitWindow();
+
+    /**
+     * @brief Finds the partition of a comparator.
+     * @param selectedDisc The comparator.
+     * @return The partition, nullptr if the comparator is not in the dataset.
+     */
+    const ComparatorPartition* getPartition(int selectedDisc) const;
+
+    /**
+     * @brief Retrieves the dataset of one comparator for the RooFit backend, building it on first use.
+     * @param selectedDisc The comparator.
+     * @return The dataset, owned by the partition; nullptr if the comparator is not in the dataset.
+     */
+    RooDataSet* getPartitionDataSet(int selectedDisc);
+
+    /**
+     * @brief Determines the starting values of every comparator as for an independent fit.
+     * @param discs The comparators to seed.
+     * @param sigmaStart Set to the median of the sigma seeds.
+     * @param sigmaLow Set to the smallest lower sigma limit.
+     * @param sigmaHigh Set to the largest upper sigma limit.
+     * @return One seed per entry of discs.
+     */
+    std::vector<ComparatorSeed> seedComparators(const std::vector<int>& discs, double& sigmaStart, double& sigmaLow,
+                                                double& sigmaHigh);
+
+    /**
+     * @brief Fits all comparators at once with the RooFit backend.
+     * @details The chi-squares of the comparators are summed by a RooAddition and minimized
+     *          by one RooMinimizer; sigma is shared, thresholds are free or linear (see fitMode).
+     * @param discs The comparators to fit.
+     * @return One result per entry of discs, empty if a comparator has no data.
+     */
+    std::vector<smxFitResult> fitSimultaneousRooFit(const std::vector<int>& discs);
+
+    /**
+     * @brief Fits all comparators at once with smxErfcSimFitter.
+     * @param discs The comparators to fit.
+     * @return One result per entry of discs, empty if a comparator has no data.
+     */
+    std::vector<smxFitResult> fitSimultaneousNative(const std::vector<int>& discs);
+
+    /**
+     * @brief Fits one comparator with the RooFit backend.
+     * @param selectedDisc The comparator to fit.
+     * @return The fit result.
+     */
+    smxFitResult fitComparatorRooFit(int selectedDisc);
+
+    /**
+     * @brief Fits one comparator with the native Levenberg-Marquardt backend.
+     * @param selectedDisc The comparator to fit.
+     * @return The fit result.
+     */
+    smxFitResult fitComparatorNative(int selectedDisc);
+
 public:
     /**
      * @brief Constructor for smxScurveFit.
@@ -63,10 +253,114 @@ public:
 
     /**
      * @brief Performs a sequential fit of all s-curves using an error function model (erfc).
+     * @details Fits only the selected comparator if one was given to the constructor.
      * @return The chi-square value of the fit, or -1 on error.
      */
     double fitScurvesSeq();
 
+    /**
+     * @brief Selects the minimizer used by fitScurvesSeq().
+     * @param fitBackend The backend.
+     */
+    void setBackend(smxFitBackend fitBackend);
+
+    /**
+     * @brief Retrieves the minimizer used by fitScurvesSeq().
+     * @return The backend.
+     */
+    smxFitBackend getBackend() const;
+
+    /**
+     * @brief Limits the fits to the transition region of every S-curve.
+     * @details Points on the flat plateaus at 0 and at full efficiency contribute little but
+     *          cost a model evaluation in every iteration. Threshold and sigma are determined
+     *          by the transition; the offset is constrained by the kept plateau points only.
+     *          drawPlot() still shows all points.
+     * @param marginPoints Plateau points kept on each side of the transition, -1 for all points.
+     */
+    void setFitWindow(int marginPoints);
+
+    /**
+     * @brief Retrieves the number of points removed by the fit window.
+     * @return The number of points, summed over the comparators.
+     */
+    int getDroppedPoints() const;
+
+    /**
+     * @brief Leaves comparators out of fitScurvesSeq(), e.g. those labelled by smxCurveClassifier.
+     * @details The skipped comparators get no result and do not take part in a simultaneous fit.
+     * @param comparators The comparator numbers to skip.
+     */
+    void setSkippedComparators(const std::vector<int>& comparators);
+
+    /**
+     * @brief Starts the independent comparator fits from converged results instead of the seeds.
+     * @details See warmStartParameters() for the order of the sources. A fit that does not converge
+     *          from a warm start is repeated from the seeds; its attempts and iterations are added up.
+     *          Simultaneous fits are not warm-started.
+     * @param enable Whether to warm-start.
+     */
+    void setWarmStart(bool enable);
+
+    /**
+     * @brief Sets converged results to start from, e.g. of the previous channel or of a previous scan.
+     * @param starts The results, matched by comparator; those that did not converge are ignored.
+     */
+    void setStartValues(const std::vector<smxFitResult>& starts);
+
+    /**
+     * @brief Selects the model and the RooFit evaluation backend of the RooFit fits.
+     * @details Rebuilds the model; the native backend is not affected. With ROOT before 6.30
+     *          the evaluation backend cannot be chosen and only the model changes.
+     * @param backendType The evaluation backend.
+     */
+    void setEvalBackend(smxEvalBackend backendType);
+
+    /**
+     * @brief Retrieves the RooFit evaluation backend.
+     * @return The evaluation backend.
+     */
+    smxEvalBackend getEvalBackend() const;
+
+    /**
+     * @brief Selects independent or simultaneous fits of the comparators.
+     * @details A simultaneous fit needs all comparators (no comparator given to the constructor)
+     *          and at least two of them. If it fails, fitScurvesSeq() falls back to independent fits.
+     *          Its parameter errors are symmetric.
+     * @param mode The fit mode.
+     */
+    void setFitMode(smxFitMode mode);
+
+    /**
+     * @brief Retrieves the fit mode.
+     * @return The fit mode.
+     */
+    smxFitMode getFitMode() const;
+
+    /**
+     * @brief Enables or disables the moment-based seeding of the fit parameters.
+     * @param enable If false, every fit starts at threshold 60 and sigma 1 within the full ranges.
+     */
+    void setMomentSeeding(bool enable);
+
+    /**
+     * @brief Sets the cache that fitScurvesSeq() consults before fitting and fills after fitting.
+     * @param cache The cache, not owned; nullptr disables caching.
+     */
+    void setResultCache(smxResultCache* cache);
+
+    /**
+     * @brief Retrieves the results of the last fitScurvesSeq() call.
+     * @return One result per fitted comparator.
+     */
+    const std::vector<smxFitResult>& getResults() const;
+
+    /**
+     * @brief Sets the fit parameters from a previously obtained result, e.g. before drawPlot().
+     * @param result The fit result to apply.
+     */
+    void applyResult(const smxFitResult& result);
+
     /**
      * @brief Generates and returns a TCanvas with the S-curve fit plot.
      * @details Overlays the fit result on the dataset and optionally saves it as a PDF.
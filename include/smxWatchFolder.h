@@ -0,0 +1,217 @@
+#ifndef SMX_WATCH_FOLDER_H
+#define SMX_WATCH_FOLDER_H
+
+#include "smxPscan.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class smxWorkStealingPool;
+
+/**
+ * @struct smxWatchSummaryEntry
+ * @brief Results of one scan processed by smxWatchFolder.
+ */
+struct smxWatchSummaryEntry {
+    std::string fileName;           ///< The scan file, without directory.
+    std::string asicId;             ///< ASIC identifier of the scan.
+    std::time_t readTime = 0;       ///< Timestamp of the scan.
+    int nFits = 0;                  ///< Fitted comparators.
+    int nFailedFits = 0;            ///< Fits with a minimizer status above 1.
+    std::vector<std::pair<int, double>> meanThresholds; ///< Comparator and mean threshold over the good fits.
+    double meanSigma = 0;           ///< Mean S-curve width over all good fits.
+    double latency = 0;             ///< Seconds from the completion of the file to the results.
+};
+
+/**
+ * @class smxWatchFolder
+ * @brief Long-running watcher that parses and fits pulse scan files as the DAQ writes them.
+ *
+ * The directory is watched with inotify. A pscan_*.txt file counts as complete
+ * once it was closed after writing (or moved into the directory), has not
+ * changed for the settle time and ends with a full line; a file that is only
+ * modified and never closed is taken after ten settle times without changes.
+ * Complete files are read and all channels are fitted with the native fitter
+ * on a thread pool that lives as long as the watcher, in a process whose ROOT
+ * and RooFit libraries were loaded and exercised by warmUp() beforehand. The
+ * results are written next to the input and added to a rolling summary of
+ * the latest scans, which is printed and rewritten as JSON after every file.
+ */
+class smxWatchFolder {
+private:
+    /**
+     * @brief A file with inotify events that is not processed yet.
+     */
+    struct PendingFile {
+        std::chrono::steady_clock::time_point lastEvent; ///< Time of the last event or size change.
+        uintmax_t lastSize = 0;     ///< Size at the last check.
+        bool closed = false;        ///< Closed after writing or moved in.
+    };
+
+    std::string directory;                      ///< Watched directory.
+    std::unique_ptr<smxWorkStealingPool> pool;  ///< Fit threads.
+    std::chrono::milliseconds settleTime{500};  ///< Time without changes before a closed file is taken.
+    size_t summarySize = 20;                    ///< Scans kept in the rolling summary.
+    smxParseMode parseMode = smxParseMode::Fast; ///< Parser of the ASCII files.
+    bool momentSeeding = true;                  ///< Whether fits are seeded from the S-curve moments.
+    bool classify = true;                       ///< Whether curves are classified before fitting.
+    bool writeOutput = true;                    ///< Whether the ROOT file of every scan is written.
+    smxRootOutputOptions outputOptions;         ///< Compression and layout of the ROOT output.
+    std::string summaryFileName;                ///< JSON summary, empty for <directory>/pscan_watch_summary.json.
+
+    std::map<std::string, PendingFile> pending; ///< Files seen but not complete yet, by name.
+    std::map<std::string, std::filesystem::file_time_type> processed; ///< Processed files and their modification time.
+    std::deque<smxWatchSummaryEntry> summary;   ///< Latest scans, newest first.
+    int nProcessed = 0;                         ///< Scans processed since run() started.
+    int nFailed = 0;                            ///< Scans that could not be read.
+
+    static std::atomic<bool> stopRequested;     ///< Set by requestStop().
+
+    /**
+     * @brief Checks whether a file name is a pulse scan of the DAQ (pscan_*.txt).
+     * @param name The file name without directory.
+     * @return True for pulse scan files.
+     */
+    static bool isScanFileName(const std::string& name);
+
+    /**
+     * @brief Records an inotify event of a file.
+     * @param name The file name without directory.
+     * @param closed Whether the event closes the file (IN_CLOSE_WRITE, IN_MOVED_TO).
+     */
+    void notePending(const std::string& name, bool closed);
+
+    /**
+     * @brief Adds all scan files of the directory that were not processed in their current version.
+     * @details Used at start-up with processExisting and after an inotify queue overflow.
+     */
+    void rescanDirectory();
+
+    /**
+     * @brief Processes the pending files that are complete.
+     */
+    void processCompleteFiles();
+
+    /**
+     * @brief Checks whether a file ends with a newline.
+     * @param path The file.
+     * @return True if the last byte is a newline.
+     */
+    static bool endsWithNewline(const std::string& path);
+
+    /**
+     * @brief Adds a processed scan to the rolling summary, prints it and rewrites the JSON summary.
+     * @param entry The results of the scan.
+     */
+    void addToSummary(smxWatchSummaryEntry entry);
+
+public:
+    /**
+     * @brief Constructor.
+     * @param watchDirectory The directory to watch.
+     * @param threads Number of fit threads, 0 for the number of hardware threads.
+     */
+    explicit smxWatchFolder(const std::string& watchDirectory, int threads = 0);
+
+    /**
+     * @brief Destructor, stops the fit threads.
+     */
+    ~smxWatchFolder();
+
+    /**
+     * @brief Loads and exercises ROOT, RooFit and the fitter once, so the first scan runs at full speed.
+     * @details Enables ROOT's thread safety and batch mode, creates a RooDataSet, an in-memory TTree
+     *          and fits a synthetic S-curve.
+     */
+    static void warmUp();
+
+    /**
+     * @brief Asks a running run() to return; safe to call from a signal handler.
+     */
+    static void requestStop();
+
+    /**
+     * @brief Sets how long a closed file must stay unchanged before it is processed.
+     * @param milliseconds The settle time.
+     */
+    void setSettleTime(int milliseconds);
+
+    /**
+     * @brief Sets the number of scans kept in the rolling summary.
+     * @param scans The number of scans, at least 1.
+     */
+    void setSummarySize(size_t scans);
+
+    /**
+     * @brief Selects the parser of the ASCII files.
+     * @param mode The parser mode.
+     */
+    void setParseMode(smxParseMode mode);
+
+    /**
+     * @brief Enables or disables the moment-based seeding of the fits.
+     * @param enable See smxScurveFit::setMomentSeeding.
+     */
+    void setMomentSeeding(bool enable);
+
+    /**
+     * @brief Enables or disables the classification of the curves before fitting.
+     * @param enable See smxPipeline::setClassify.
+     */
+    void setClassify(bool enable);
+
+    /**
+     * @brief Enables or disables writing the ROOT file of every scan.
+     * @param enable If false, only the summary is kept.
+     */
+    void setWriteOutput(bool enable);
+
+    /**
+     * @brief Sets compression and layout of the ROOT output.
+     * @details A fixed fileName would be shared by all scans and is ignored.
+     * @param options The output options.
+     */
+    void setOutputOptions(const smxRootOutputOptions& options);
+
+    /**
+     * @brief Sets the JSON summary file.
+     * @param fileName The file, empty for <directory>/pscan_watch_summary.json.
+     */
+    void setSummaryFile(const std::string& fileName);
+
+    /**
+     * @brief Reads and fits one scan and adds it to the summary.
+     * @param path The scan file.
+     * @param completed Time at which the file was found complete, for the latency.
+     * @return False if the file could not be read.
+     */
+    bool processFile(const std::string& path, std::chrono::steady_clock::time_point completed);
+
+    /**
+     * @brief Watches the directory until requestStop() is called.
+     * @param processExisting Whether scan files already in the directory are processed first.
+     * @return 0 on a regular stop, 1 if the directory could not be watched.
+     */
+    int run(bool processExisting = false);
+
+    /**
+     * @brief Retrieves the rolling summary.
+     * @return The latest scans, newest first.
+     */
+    const std::deque<smxWatchSummaryEntry>& getSummary() const;
+
+    /**
+     * @brief Writes the rolling summary as JSON, replacing the file atomically.
+     * @return False if the file could not be written.
+     */
+    bool writeSummary() const;
+};
+
+#endif // SMX_WATCH_FOLDER_H
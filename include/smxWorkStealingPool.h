@@ -0,0 +1,105 @@
+#ifndef SMX_WORK_STEALING_POOL_H
+#define SMX_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class smxWorkStealingPool
+ * @brief Fixed set of worker threads with one task deque per worker.
+ *
+ * A task submitted from a worker thread goes to the back of that worker's
+ * deque, any other task is dealt round-robin. Each worker takes its newest
+ * task first and, when its deque is empty, steals the oldest task of another
+ * worker. A task that splits its work into subtasks thus keeps them close to
+ * the data it just loaded, while idle workers take over the remainder, which
+ * balances the load when tasks differ in size.
+ */
+class smxWorkStealingPool {
+private:
+    /**
+     * @brief Task deque of one worker.
+     */
+    struct Queue {
+        std::mutex mutex;                           ///< Guards tasks.
+        std::deque<std::function<void()>> tasks;    ///< Tasks, newest at the back.
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;     ///< One deque per worker.
+    std::vector<std::thread> workers;               ///< The worker threads.
+    std::mutex stateMutex;                          ///< Guards the waits below.
+    std::condition_variable taskAdded;              ///< Signalled when a task was submitted or the pool stops.
+    std::condition_variable allDone;                ///< Signalled when the last pending task finished.
+    std::atomic<long> pending{0};                   ///< Submitted tasks not yet finished.
+    std::atomic<long> queued{0};                    ///< Submitted tasks not yet taken by a worker.
+    std::atomic<long> steals{0};                    ///< Tasks taken from another worker's deque.
+    std::atomic<unsigned> nextQueue{0};             ///< Round-robin position for external submissions.
+    bool stopping = false;                          ///< Set by the destructor.
+
+    /**
+     * @brief Index of the calling worker thread.
+     * @return The index, or -1 outside the pool's workers.
+     */
+    int currentWorker() const;
+
+    /**
+     * @brief Takes a task, first from the worker's own deque, then from the others.
+     * @param worker The worker index.
+     * @param task Receives the task.
+     * @return False if all deques are empty.
+     */
+    bool takeTask(int worker, std::function<void()>& task);
+
+    /**
+     * @brief Main loop of a worker thread.
+     * @param worker The worker index.
+     */
+    void workerLoop(int worker);
+
+public:
+    /**
+     * @brief Constructor, starts the workers.
+     * @param nThreads Number of worker threads, 0 for the number of hardware threads.
+     */
+    explicit smxWorkStealingPool(int nThreads = 0);
+
+    /**
+     * @brief Destructor, finishes the queued tasks and joins the workers.
+     */
+    ~smxWorkStealingPool();
+
+    smxWorkStealingPool(const smxWorkStealingPool&) = delete;
+    smxWorkStealingPool& operator=(const smxWorkStealingPool&) = delete;
+
+    /**
+     * @brief Queues a task.
+     * @param task The task; exceptions must be handled inside it.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * @brief Waits until all submitted tasks, including those they submitted, have finished.
+     * @details Must not be called from a worker thread.
+     */
+    void wait();
+
+    /**
+     * @brief Retrieves the number of worker threads.
+     * @return The number of threads.
+     */
+    int getNThreads() const;
+
+    /**
+     * @brief Retrieves the number of tasks a worker took from another worker's deque.
+     * @return The steal count since construction.
+     */
+    long getSteals() const;
+};
+
+#endif // SMX_WORK_STEALING_POOL_H
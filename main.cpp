@@ -1,33 +1,368 @@
 #include "smxPscan.h"
 #include "smxScurveFit.h"
 #include "smxAsic.h"
+#include "smxFitEngine.h"
+#include "smxPipeline.h"
+#include "smxBatch.h"
+#include "smxWatchFolder.h"
+#include "smxResultCache.h"
+#include "smxHash.h"
+#include "smxInstrument.h"
+#include "smxLog.h"
+#include <csignal>
 #include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+void stopWatching(int) {
+    smxWatchFolder::requestStop();
+}
+
+} // namespace
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <filename>" << std::endl;
+    std::vector<std::string> filenames;
+    bool parseOnly = false;
+    int nJobs = 1;
+    int maxScalingJobs = 0;
+    bool crossCheck = false;
+    bool momentSeeding = true;
+    bool seedReport = false;
+    smxFitMode fitMode = smxFitMode::Independent;
+    bool fitModeReport = false;
+    smxEvalBackend evalBackend = smxEvalBackend::Cpu;
+    int fitWindow = -1;
+    bool fitWindowReport = false;
+    bool classify = true;
+    smxWarmStart warmStart = smxWarmStart::Off;
+    bool warmStartReport = false;
+    bool stream = false;
+    bool batch = false;
+    std::string mergedFile;
+    int batchThreads = 0;
+    std::string watchDirectory;
+    int settleMs = 500;
+    std::string summaryFile;
+    bool watchOutput = true;
+    bool watchExisting = false;
+    int memoryBudgetMB = 256;
+    bool useCache = false;
+    std::string cacheDirectory;
+    int cacheSizeMB = 2048;
+    smxFitBackend fitBackend = smxFitBackend::RooFit;
+    smxParseMode parseMode = smxParseMode::Fast;
+    smxRootOutputOptions outputOptions;
+    bool writeReport = false;
+    bool readReport = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--regex") {
+            parseMode = smxParseMode::Regex;
+        } else if (arg == "--parse-only") {
+            parseOnly = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            nJobs = std::stoi(argv[++i]);
+        } else if (arg == "--scaling" && i + 1 < argc) {
+            maxScalingJobs = std::stoi(argv[++i]);
+        } else if (arg == "--native") {
+            fitBackend = smxFitBackend::Native;
+        } else if (arg == "--crosscheck") {
+            crossCheck = true;
+        } else if (arg == "--no-seed") {
+            momentSeeding = false;
+        } else if (arg == "--seed-report") {
+            seedReport = true;
+        } else if (arg == "--shared-sigma") {
+            fitMode = smxFitMode::SharedSigma;
+        } else if (arg == "--linear-thresholds") {
+            fitMode = smxFitMode::LinearThresholds;
+        } else if (arg == "--fit-mode-report") {
+            fitModeReport = true;
+        } else if (arg == "--fit-window" && i + 1 < argc) {
+            fitWindow = std::stoi(argv[++i]);
+        } else if (arg == "--fit-window-report") {
+            fitWindowReport = true;
+        } else if (arg == "--warm-start" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "comparator") {
+                warmStart = smxWarmStart::Comparator;
+            } else if (name == "channel") {
+                warmStart = smxWarmStart::Channel;
+            } else if (name == "scan") {
+                warmStart = smxWarmStart::PreviousScan;
+            } else {
+                SMX_LOG_ERROR("Unknown warm-start policy: " << name);
+                return 1;
+            }
+        } else if (arg == "--warm-start-report") {
+            warmStartReport = true;
+        } else if (arg == "--no-classify") {
+            classify = false;
+        } else if (arg == "--eval-backend" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "legacy") {
+                evalBackend = smxEvalBackend::Legacy;
+            } else if (name == "codegen") {
+                evalBackend = smxEvalBackend::Codegen;
+            } else if (name == "cpu") {
+                evalBackend = smxEvalBackend::Cpu;
+            } else {
+                SMX_LOG_ERROR("Unknown evaluation backend: " << name);
+                return 1;
+            }
+        } else if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            batchThreads = std::stoi(argv[++i]);
+        } else if (arg == "--watch" && i + 1 < argc) {
+            watchDirectory = argv[++i];
+        } else if (arg == "--settle" && i + 1 < argc) {
+            settleMs = std::stoi(argv[++i]);
+        } else if (arg == "--summary" && i + 1 < argc) {
+            summaryFile = argv[++i];
+        } else if (arg == "--no-output") {
+            watchOutput = false;
+        } else if (arg == "--existing") {
+            watchExisting = true;
+        } else if (arg == "--merge" && i + 1 < argc) {
+            mergedFile = argv[++i];
+        } else if (arg == "--budget" && i + 1 < argc) {
+            memoryBudgetMB = std::stoi(argv[++i]);
+        } else if (arg == "--cache") {
+            useCache = true;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            useCache = true;
+            cacheDirectory = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            cacheSizeMB = std::stoi(argv[++i]);
+        } else if (arg == "--compression" && i + 1 < argc) {
+            // ALGORITHM[:LEVEL] with ALGORITHM one of zlib, lz4, zstd
+            std::string value = argv[++i];
+            std::string algorithm = value.substr(0, value.find(':'));
+            if (value.find(':') != std::string::npos) outputOptions.compressionLevel = std::stoi(value.substr(value.find(':') + 1));
+            outputOptions.compression = algorithm == "zlib" ? smxCompression::Zlib
+                                      : algorithm == "lz4"  ? smxCompression::LZ4
+                                      : algorithm == "zstd" ? smxCompression::Zstd
+                                                            : smxCompression::Default;
+        } else if (arg == "--basket-size" && i + 1 < argc) {
+            outputOptions.basketSize = std::stoi(argv[++i]);
+        } else if (arg == "--auto-flush" && i + 1 < argc) {
+            outputOptions.autoFlush = std::stoll(argv[++i]);
+        } else if (arg == "--split-adc") {
+            outputOptions.splitAdc = true;
+        } else if (arg == "--direct") {
+            outputOptions.directToFile = true;
+        } else if (arg == "--rntuple") {
+            outputOptions.format = smxOutputFormat::RNTuple;
+        } else if (arg == "--write-report") {
+            writeReport = true;
+        } else if (arg == "--read-report") {
+            readReport = true;
+        } else if (arg == "--verbose") {
+            smxLog::setLevel(smxLogLevel::Debug);
+        } else if (arg == "--quiet") {
+            smxLog::setLevel(smxLogLevel::Warning);
+        } else {
+            filenames.push_back(arg);
+        }
+    }
+
+    // The stream, batch and watch modes fit on threads with the native fitter, one comparator at a time
+    auto threadedModeOptions = [&](const char* mode) {
+        const char* option = fitMode != smxFitMode::Independent ? "--shared-sigma/--linear-thresholds"
+                           : evalBackend != smxEvalBackend::Cpu ? "--eval-backend"
+                           : fitWindow >= 0 ? "--fit-window"
+                           : warmStart != smxWarmStart::Off ? "--warm-start"
+                           : useCache ? "--cache"
+                           : maxScalingJobs > 0 || crossCheck || seedReport || fitModeReport || fitWindowReport ||
+                             warmStartReport ? "the report options"
+                           : nullptr;
+        if (option) SMX_LOG_ERROR(option << " cannot be used with " << mode << ".");
+        return option == nullptr;
+    };
+
+    if (!watchDirectory.empty()) {
+        // Long-running: fit every scan the DAQ completes in the directory until SIGINT/SIGTERM
+        if (!threadedModeOptions("--watch")) return 1;
+        smxWatchFolder::warmUp();
+        smxWatchFolder watcher(watchDirectory, batchThreads);
+        watcher.setSettleTime(settleMs);
+        watcher.setParseMode(parseMode);
+        watcher.setMomentSeeding(momentSeeding);
+        watcher.setClassify(classify);
+        watcher.setWriteOutput(watchOutput);
+        watcher.setOutputOptions(outputOptions);
+        watcher.setSummaryFile(summaryFile);
+        std::signal(SIGINT, stopWatching);
+        std::signal(SIGTERM, stopWatching);
+        return watcher.run(watchExisting);
+    }
+
+    if (filenames.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--regex] [--parse-only] [--jobs N] [--scaling N] [--native] [--crosscheck] [--no-seed] [--seed-report] [--shared-sigma|--linear-thresholds] [--fit-mode-report] [--eval-backend legacy|cpu|codegen] [--fit-window N] [--fit-window-report] [--no-classify] [--warm-start comparator|channel|scan] [--warm-start-report] [--cache] [--cache-dir DIR] [--cache-size MB] [--verbose|--quiet] <filename>" << std::endl;
+        std::cerr << "       output: [--compression zlib|lz4|zstd[:LEVEL]] [--basket-size BYTES] [--auto-flush N] [--split-adc] [--direct] [--rntuple] [--write-report] [--read-report]" << std::endl;
+        std::cerr << "       " << argv[0] << " --stream [--jobs N] [--budget MB] [--regex] [--no-seed] [--no-classify] <filename>..." << std::endl;
+        std::cerr << "       " << argv[0] << " --batch [--threads N] [--merge FILE] [--regex] [--no-seed] [--no-classify] <file|directory|pattern|@list>..." << std::endl;
+        std::cerr << "       " << argv[0] << " --watch DIR [--threads N] [--settle MS] [--summary FILE] [--no-output] [--existing] [--regex] [--no-seed] [--no-classify]" << std::endl;
         return 1;
     }
-    std::string filename = argv[1];
-    smxPscan* pscan = new smxPscan(); 
 
-    pscan->readAsciiFile(filename);
+    if (batch) {
+        // Read and fit all channels of all files on a work-stealing pool, one process for everything
+        if (!threadedModeOptions("--batch")) return 1;
+        std::vector<std::string> files = smxBatch::collectFiles(filenames);
+        if (files.empty()) {
+            SMX_LOG_ERROR("No scan files found.");
+            return 1;
+        }
+        smxBatch driver(batchThreads);
+        driver.setParseMode(parseMode);
+        driver.setMomentSeeding(momentSeeding);
+        driver.setClassify(classify);
+        driver.setOutputOptions(outputOptions);
+        driver.setMergedOutput(mergedFile);
+        int nFailed = driver.run(files);
+        driver.printSummary();
+        return nFailed == 0 ? 0 : 1;
+    }
+    if (stream) {
+        // Parse, fit (native backend) and write all files in overlapping stages
+        if (!threadedModeOptions("--stream")) return 1;
+        smxPipeline pipeline(nJobs, memoryBudgetMB);
+        pipeline.setParseMode(parseMode);
+        pipeline.setMomentSeeding(momentSeeding);
+        pipeline.setClassify(classify);
+        pipeline.setOutputOptions(outputOptions);
+        int nWritten = pipeline.run(filenames);
+        return nWritten == static_cast<int>(filenames.size()) ? 0 : 1;
+    }
+    const std::string& filename = filenames.front();
+    if (readReport) {
+        // Read time of the counts from the TTree and the RNTuple layout
+        smxPscan::measureReadThroughput(filename);
+        return 0;
+    }
+    if (writeReport) {
+        // Write time and size of the ROOT output per compression, basket size and branch layout
+        auto direct = [](smxCompression compression, int level, bool splitAdc = false, int basketSize = 32000) {
+            smxRootOutputOptions options;
+            options.compression = compression;
+            options.compressionLevel = level;
+            options.splitAdc = splitAdc;
+            options.basketSize = basketSize;
+            options.directToFile = true;
+            return options;
+        };
+        smxPscan::measureOutputOptions(filename, {
+            {"clone_default", smxRootOutputOptions()},
+            {"direct_default", direct(smxCompression::Default, 0)},
+            {"direct_zlib1", direct(smxCompression::Zlib, 1)},
+            {"direct_zlib6", direct(smxCompression::Zlib, 6)},
+            {"direct_lz4_4", direct(smxCompression::LZ4, 4)},
+            {"direct_zstd5", direct(smxCompression::Zstd, 5)},
+            {"direct_zstd5_split", direct(smxCompression::Zstd, 5, true)},
+            {"direct_zstd5_basket256k", direct(smxCompression::Zstd, 5, false, 256000)},
+        });
+        return 0;
+    }
+    smxResultCache* resultCache = useCache ? new smxResultCache(cacheDirectory, cacheSizeMB) : nullptr;
+    smxPscan* pscan = new smxPscan();
+    pscan->setParseMode(parseMode);
+    pscan->setResultCache(resultCache);
+    pscan->setOutputOptions(outputOptions);
+
+    pscan->readFile(filename);
+    if (parseOnly) {
+        if (resultCache) resultCache->printStatistics();
+        delete resultCache;
+        delete pscan;
+        return 0;
+    }
+    if (classify) {
+        // Dead, saturated, noisy and non-monotonic curves are labelled instead of fitted
+        pscan->classifyCurves();
+    }
+    int nChannels = smxNCh;
+    std::vector<RooDataSet*> datasets(nChannels);
+    for (int i=0; i<nChannels; ++i) {
+        datasets[i] = pscan->getRooDataSet(i);
+    }
+
+    if (maxScalingJobs > 0) {
+        smxFitEngine::measureScaling(datasets, maxScalingJobs, fitBackend);
+    }
+    if (crossCheck) {
+        smxFitEngine::compareBackends(datasets);
+    }
+    if (seedReport) {
+        smxFitEngine::compareSeeding(datasets, fitBackend);
+    }
+    if (fitModeReport) {
+        smxFitEngine::compareFitModes(datasets, fitBackend);
+    }
+    if (fitWindowReport) {
+        smxFitEngine::compareFitWindow(datasets, fitWindow >= 0 ? fitWindow : 5, fitBackend);
+    }
+
+    // Results of the last scan of the same ASIC, kept in the result cache
+    uint64_t previousScanKey = smxHash().add("previousScan").add(std::string(pscan->getAsicId().Data())).value();
+    std::vector<smxFitResult> previousScan;
+    if (warmStart == smxWarmStart::PreviousScan) {
+        if (!resultCache) {
+            SMX_LOG_WARNING("--warm-start scan needs the result cache (--cache), fitting from the seeds.");
+        } else if (!resultCache->loadFits(previousScanKey, previousScan)) {
+            SMX_LOG_INFO("No previous scan of ASIC " << pscan->getAsicId() << " in the result cache.");
+        }
+    }
+    if (warmStartReport) {
+        smxFitEngine::compareWarmStart(datasets, warmStart != smxWarmStart::Off ? warmStart : smxWarmStart::Comparator,
+                                       previousScan, fitBackend);
+    }
+
+    smxFitEngine fitEngine(nJobs);
+    fitEngine.setBackend(fitBackend);
+    fitEngine.setMomentSeeding(momentSeeding);
+    fitEngine.setFitMode(fitMode);
+    fitEngine.setEvalBackend(evalBackend);
+    fitEngine.setFitWindow(fitWindow);
+    fitEngine.setResultCache(resultCache);
+    if (classify) fitEngine.setCurveLabels(&pscan->getFitResults());
+    fitEngine.setWarmStart(warmStart);
+    fitEngine.setStartValues(previousScan);
+    const std::vector<smxFitResult>& results = fitEngine.fit(datasets);
+    if (resultCache) resultCache->storeFits(previousScanKey, results);
+    pscan->getFitResults().set(results);
     pscan->writeRootFile();
+
     smxScurveFit* scurveFit;
     TCanvas* canvA = new TCanvas("canvA", "S-Curve Fit", 1000, 400);
     canvA->Print("testDataSet.pdf[");
-    for (int i=0; i<16; ++i) {
-//  for (int i=0; i<smxNCh; ++i) {
-        scurveFit = new smxScurveFit(pscan->toRooDataSet(i));
-        scurveFit->fitScurvesSeq();
-        scurveFit->drawPlot()->Print("testDataSet.pdf");
+    for (int i=0; i<nChannels; ++i) {
+        scurveFit = new smxScurveFit(datasets[i], i);
+        // Draw the model with the parameters of the last comparator of the channel
+        for (const smxFitResult& result : results) {
+            if (result.channel == i && result.status >= 0) scurveFit->applyResult(result);
+        }
+        TCanvas* plot = scurveFit->drawPlot();
+        {
+            SMX_TIMER("printPdf");
+            plot->Print("testDataSet.pdf");
+        }
         delete scurveFit;
     }
     canvA->Print("testDataSet.pdf]");
-//  smxAsic asic;       
+    // Rewrite the summary of writeRootFile() including the plotting stages
+    SMX_WRITE_SUMMARY(pscan->getSummaryFileName());
+//  smxAsic asic;
 //  asic.addPscan(pscan);
-                        
-                        
-    return 0;           
-}                       
 
+    if (resultCache) resultCache->printStatistics();
+    delete resultCache;
+    delete pscan;
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "smxAsciiScanner.h"
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+// Same character class as \s in std::regex (ECMAScript)
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Skips whitespace, returns false if none was found
+inline bool skipSpaces(const char*& p, const char* end) {
+    const char* start = p;
+    while (p < end && isSpace(*p)) ++p;
+    return p != start;
+}
+
+// Parses an unsigned decimal number, returns false on missing digits or overflow
+inline bool parseNumber(const char*& p, const char* end, int& value) {
+    if (p == end || !isDigit(*p)) return false;
+    auto [next, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc()) return false;
+    p = next;
+    return true;
+}
+
+inline bool expectLiteral(const char*& p, const char* end, const char* literal, std::size_t length) {
+    if (static_cast<std::size_t>(end - p) < length || std::memcmp(p, literal, length) != 0) return false;
+    p += length;
+    return true;
+}
+
+} // namespace
+
+smxAsciiScanner::smxAsciiScanner(const char* buffer, std::size_t size)
+    : cursor(buffer), end(buffer + size) {}
+
+bool smxAsciiScanner::nextLine(std::string_view& line) {
+    if (cursor >= end) return false;
+
+    const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+    const char* lineEnd = newline ? newline : end;
+    line = std::string_view(cursor, lineEnd - cursor);
+    cursor = newline ? newline + 1 : end;
+    return true;
+}
+
+bool smxAsciiScanner::parseDataLine(std::string_view line, int& pulse, int& channel, int* values, int& nValues) {
+    const char* p = line.data();
+    const char* end = p + line.size();
+
+    // "vp" \s+ <pulse> \s+ "ch" \s+ <channel> ":" \s+
+    if (!expectLiteral(p, end, "vp", 2) || !skipSpaces(p, end)) return false;
+    if (!parseNumber(p, end, pulse) || !skipSpaces(p, end)) return false;
+    if (!expectLiteral(p, end, "ch", 2) || !skipSpaces(p, end)) return false;
+    if (!parseNumber(p, end, channel)) return false;
+    if (!expectLiteral(p, end, ":", 1) || !skipSpaces(p, end)) return false;
+
+    // (\d+\s*)+ up to the end of the line
+    nValues = 0;
+    if (p == end) return false;
+    while (p < end) {
+        int value;
+        if (!parseNumber(p, end, value)) return false;
+        if (nValues < maxValues) values[nValues] = value;
+        ++nValues;
+        skipSpaces(p, end);
+    }
+    return true;
+}
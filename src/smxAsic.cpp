@@ -1,19 +1,19 @@
 #include "smxAsic.h"
-#include <iostream>
+#include "smxLog.h"
 
 smxAsic::smxAsic(const TString& id, const smxAsicSettings& settings)
     : asicId(id), asicSettings(settings) {}
 
 void smxAsic::addPscan(smxPscan* pscan) {
     if (!pscan) {
-        std::cerr << "Error: nullptr passed to addPscan." << std::endl;
+        SMX_LOG_ERROR("nullptr passed to addPscan.");
         return;
     }
 
     if (asicId.IsNull() || asicId == "XA-000-00-000-000-000-000-00") {
         asicId = pscan->getAsicId();
     } else if (asicId != pscan->getAsicId()) {
-        std::cerr << "Error: Mismatched ASIC IDs. Cannot add pscan." << std::endl;
+        SMX_LOG_ERROR("Mismatched ASIC IDs. Cannot add pscan.");
         return;
     }
 
@@ -0,0 +1,357 @@
+#include "smxBatch.h"
+#include "smxConstants.h"
+#include "smxPipeline.h"
+#include "smxPscanFile.h"
+#include "smxWorkStealingPool.h"
+#include "smxLog.h"
+#include <TFile.h>
+#include <TROOT.h>
+#include <TTree.h>
+#include <glob.h>
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Scan files picked up from a directory
+bool isScanFileName(const std::filesystem::path& path) {
+    std::string name = path.filename().string();
+    return path.extension() == ".pscan" || (path.extension() == ".txt" && name.rfind("pscan_", 0) == 0);
+}
+
+void addFile(const std::string& file, std::vector<std::string>& files, std::set<std::string>& seen) {
+    if (seen.insert(file).second) files.push_back(file);
+}
+
+void expandInput(const std::string& input, std::vector<std::string>& files, std::set<std::string>& seen) {
+    if (input.empty()) return;
+    std::error_code ec;
+    if (input[0] == '@') {
+        std::ifstream list(input.substr(1));
+        if (!list) {
+            SMX_LOG_ERROR("Failed to open file list: " << input.substr(1));
+            return;
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#') expandInput(line, files, seen);
+        }
+    } else if (std::filesystem::is_directory(input, ec)) {
+        std::vector<std::string> entries;
+        for (const auto& entry : std::filesystem::directory_iterator(input, ec)) {
+            if (entry.is_regular_file(ec) && isScanFileName(entry.path())) entries.push_back(entry.path().string());
+        }
+        std::sort(entries.begin(), entries.end());
+        for (const std::string& entry : entries) addFile(entry, files, seen);
+    } else if (input.find_first_of("*?[") != std::string::npos) {
+        glob_t matches;
+        if (glob(input.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; ++i) addFile(matches.gl_pathv[i], files, seen);
+        } else {
+            SMX_LOG_WARNING("No files match " << input);
+        }
+        globfree(&matches);
+    } else {
+        addFile(input, files, seen); // a missing file is reported as the error of that file
+    }
+}
+
+} // namespace
+
+smxBatch::smxBatch(int threads) {
+    setThreads(threads);
+}
+
+std::vector<std::string> smxBatch::collectFiles(const std::vector<std::string>& inputs) {
+    std::vector<std::string> files;
+    std::set<std::string> seen;
+    for (const std::string& input : inputs) {
+        expandInput(input, files, seen);
+    }
+    return files;
+}
+
+void smxBatch::setThreads(int threads) {
+    nThreads = threads > 0 ? threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+void smxBatch::setChunkChannels(int channels) {
+    chunkChannels = std::max(1, channels);
+}
+
+void smxBatch::setParseMode(smxParseMode mode) {
+    parseMode = mode;
+}
+
+void smxBatch::setMomentSeeding(bool enable) {
+    momentSeeding = enable;
+}
+
+void smxBatch::setClassify(bool enable) {
+    classify = enable;
+}
+
+void smxBatch::setOutputOptions(const smxRootOutputOptions& options) {
+    outputOptions = options;
+    outputOptions.fileName.clear();
+}
+
+void smxBatch::setMergedOutput(const std::string& fileName) {
+    mergedFileName = fileName;
+}
+
+const std::vector<smxBatchFileResult>& smxBatch::getFileResults() const {
+    return fileResults;
+}
+
+void smxBatch::recordResult(size_t index, smxBatchFileResult result) {
+    std::lock_guard<std::mutex> lock(resultsMutex);
+    result.fileName = fileResults[index].fileName;
+    fileResults[index] = std::move(result);
+}
+
+void smxBatch::processFile(smxWorkStealingPool& pool, size_t index) {
+    auto start = std::chrono::steady_clock::now();
+    const std::string filename = fileResults[index].fileName;
+    smxPscan* pscan = nullptr;
+    try {
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(filename, ec)) {
+            throw std::runtime_error("file not found");
+        }
+        pscan = new smxPscan();
+        pscan->setParseMode(parseMode);
+        pscan->setOutputOptions(outputOptions);
+        pscan->readFile(filename);
+        if (pscan->getNVp() == 0) {
+            throw std::runtime_error("no data read");
+        }
+    } catch (const std::exception& e) {
+        SMX_LOG_ERROR("Skipping " << filename << ": " << e.what());
+        delete pscan;
+        smxBatchFileResult result;
+        result.error = e.what();
+        result.seconds = secondsSince(start);
+        recordResult(index, result);
+        return;
+    }
+
+    // The chunks go to this worker's deque, idle workers steal from it
+    FileJob* job = new FileJob;
+    job->index = index;
+    job->pscan = pscan;
+    job->start = start;
+    job->results.resize(smxNCh * pscan->getReadDiscList().size());
+    int nChunks = (smxNCh + chunkChannels - 1) / chunkChannels;
+    job->pendingChunks.store(nChunks);
+    for (int first = 0; first < smxNCh; first += chunkChannels) {
+        int last = std::min(smxNCh, first + chunkChannels);
+        pool.submit([this, job, first, last] { fitChunk(job, first, last); });
+    }
+}
+
+void smxBatch::fitChunk(FileJob* job, int firstChannel, int lastChannel) {
+    try {
+        size_t nDisc = job->pscan->getReadDiscList().size();
+        for (int ch = firstChannel; ch < lastChannel; ++ch) {
+            smxPipeline::fitChannel(*job->pscan, ch, momentSeeding, classify, job->results.data() + ch * nDisc);
+        }
+    } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(job->errorMutex);
+        if (job->error.empty()) job->error = std::string("fit failed: ") + e.what();
+    }
+    // The worker finishing the last chunk writes the scan
+    if (job->pendingChunks.fetch_sub(1) == 1) {
+        finishFile(job);
+    }
+}
+
+void smxBatch::finishFile(FileJob* job) {
+    std::unique_ptr<FileJob> owned(job);
+    std::unique_ptr<smxPscan> pscan(job->pscan);
+    smxBatchFileResult result;
+    result.error = job->error;
+    result.asicId = pscan->getAsicId().Data();
+    result.readTime = pscan->getReadTime();
+
+    std::vector<smxFitResult> filled;
+    for (const smxFitResult& fit : job->results) {
+        if (!smxFitResultTable::isFilled(fit)) continue;
+        filled.push_back(fit);
+        if (fit.retries == 0) continue; // labelled by the classifier, not fitted
+        result.nFits++;
+        if (fit.status > 1) result.nFailedFits++;
+    }
+
+    if (result.error.empty()) {
+        try {
+            if (mergedFileName.empty()) {
+                pscan->getFitResults().set(filled);
+                std::string outputName = pscan->getOutputFileName();
+                std::error_code ec;
+                if (!outputOptions.directToFile) {
+                    std::filesystem::remove(outputName, ec); // a stale file would hide a failed write
+                }
+                pscan->writeRootFile();
+                if (!std::filesystem::exists(outputName, ec)) {
+                    throw std::runtime_error("failed to write " + outputName);
+                }
+                result.outputFileName = outputName;
+            } else {
+                std::lock_guard<std::mutex> lock(resultsMutex);
+                mergedFits[job->index] = std::move(filled);
+            }
+        } catch (const std::exception& e) {
+            result.error = e.what();
+        }
+    }
+    if (!result.error.empty()) {
+        SMX_LOG_ERROR("Failed to process " << pscan->getAsciiFileName() << ": " << result.error);
+    }
+    result.seconds = secondsSince(job->start);
+    SMX_LOG_INFO("Fitted " << result.nFits << " comparators of " << pscan->getAsciiFileName() << " in "
+                 << result.seconds << " s" << (result.nFailedFits > 0 ? " (" + std::to_string(result.nFailedFits) + " failed)" : ""));
+    recordResult(job->index, result);
+}
+
+int smxBatch::run(const std::vector<std::string>& files) {
+    ROOT::EnableThreadSafety();
+    auto start = std::chrono::steady_clock::now();
+    fileResults.assign(files.size(), smxBatchFileResult());
+    mergedFits.assign(files.size(), {});
+    for (size_t i = 0; i < files.size(); ++i) {
+        fileResults[i].fileName = files[i];
+    }
+
+    // Largest files first, so that the small ones fill the gaps at the end
+    std::vector<size_t> order(files.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<uintmax_t> sizes(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::error_code ec;
+        sizes[i] = std::filesystem::file_size(files[i], ec);
+        if (ec) sizes[i] = 0;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    {
+        smxWorkStealingPool pool(nThreads);
+        for (size_t index : order) {
+            pool.submit([this, &pool, index] { processFile(pool, index); });
+        }
+        pool.wait();
+        steals = pool.getSteals();
+    }
+
+    int nFailed = 0;
+    for (const smxBatchFileResult& result : fileResults) {
+        if (!result.error.empty()) nFailed++;
+    }
+    if (!mergedFileName.empty() && !writeMergedFile()) {
+        nFailed = static_cast<int>(files.size());
+    }
+    wallTime = secondsSince(start);
+    return nFailed;
+}
+
+bool smxBatch::writeMergedFile() const {
+    std::unique_ptr<TFile> file(TFile::Open(mergedFileName.c_str(), "RECREATE"));
+    if (!file || file->IsZombie()) {
+        SMX_LOG_ERROR("Failed to create merged output file: " << mergedFileName);
+        return false;
+    }
+
+    // One entry per input file, the fit results refer to it by fileIndex
+    int fileIndex = 0;
+    std::string fileName, asicId, error;
+    Long64_t readTime = 0;
+    int nFits = 0, nFailedFits = 0;
+    double seconds = 0;
+    TTree* filesTree = new TTree("batchFilesTree", "Input files of the batch run");
+    filesTree->SetDirectory(file.get());
+    filesTree->Branch("fileIndex", &fileIndex, "fileIndex/I");
+    filesTree->Branch("fileName", &fileName);
+    filesTree->Branch("asicId", &asicId);
+    filesTree->Branch("readTime", &readTime, "readTime/L");
+    filesTree->Branch("error", &error);
+    filesTree->Branch("nFits", &nFits, "nFits/I");
+    filesTree->Branch("nFailedFits", &nFailedFits, "nFailedFits/I");
+    filesTree->Branch("seconds", &seconds, "seconds/D");
+    for (size_t i = 0; i < fileResults.size(); ++i) {
+        const smxBatchFileResult& result = fileResults[i];
+        fileIndex = static_cast<int>(i);
+        fileName = result.fileName;
+        asicId = result.asicId;
+        readTime = static_cast<Long64_t>(result.readTime);
+        error = result.error;
+        nFits = result.nFits;
+        nFailedFits = result.nFailedFits;
+        seconds = result.seconds;
+        filesTree->Fill();
+    }
+
+    smxFitResult row;
+    TTree* fitTree = new TTree("fitResultsTree", "S-curve fit results of all files of the batch run");
+    fitTree->SetDirectory(file.get());
+    fitTree->Branch("fileIndex", &fileIndex, "fileIndex/I");
+    fitTree->Branch("channel", &row.channel, "channel/I");
+    fitTree->Branch("comparator", &row.comparator, "comparator/I");
+    fitTree->Branch("threshold", &row.threshold, "threshold/D");
+    fitTree->Branch("thresholdErrLo", &row.thresholdErrLo, "thresholdErrLo/D");
+    fitTree->Branch("thresholdErrHi", &row.thresholdErrHi, "thresholdErrHi/D");
+    fitTree->Branch("sigma", &row.sigma, "sigma/D");
+    fitTree->Branch("sigmaErrLo", &row.sigmaErrLo, "sigmaErrLo/D");
+    fitTree->Branch("sigmaErrHi", &row.sigmaErrHi, "sigmaErrHi/D");
+    fitTree->Branch("offset", &row.offset, "offset/D");
+    fitTree->Branch("offsetErrLo", &row.offsetErrLo, "offsetErrLo/D");
+    fitTree->Branch("offsetErrHi", &row.offsetErrHi, "offsetErrHi/D");
+    fitTree->Branch("chi2", &row.chi2, "chi2/D");
+    fitTree->Branch("status", &row.status, "status/I");
+    fitTree->Branch("retries", &row.retries, "retries/I");
+    fitTree->Branch("label", &row.label, "label/I");
+    fitTree->Branch("wallTime", &row.wallTime, "wallTime/D");
+    for (size_t i = 0; i < mergedFits.size(); ++i) {
+        fileIndex = static_cast<int>(i);
+        for (const smxFitResult& fit : mergedFits[i]) {
+            row = fit;
+            fitTree->Fill();
+        }
+    }
+
+    file->Write();
+    file->Close(); // deletes the trees
+    SMX_LOG_INFO("Merged results of " << fileResults.size() << " file(s) written to " << mergedFileName);
+    return true;
+}
+
+void smxBatch::printSummary() const {
+    int nFailed = 0;
+    int nFits = 0;
+    for (const smxBatchFileResult& result : fileResults) {
+        if (result.error.empty()) {
+            SMX_LOG_INFO("  ok     " << result.fileName << ": " << result.nFits << " fits, " << result.nFailedFits
+                         << " failed, " << result.seconds << " s" << (result.outputFileName.empty() ? "" : " -> " + result.outputFileName));
+        } else {
+            nFailed++;
+            SMX_LOG_WARNING("  FAILED " << result.fileName << ": " << result.error);
+        }
+        nFits += result.nFits;
+    }
+    SMX_LOG_INFO("Batch: " << fileResults.size() - nFailed << " of " << fileResults.size() << " file(s) processed, "
+                 << nFits << " fits in " << wallTime << " s on " << nThreads << " thread(s) ("
+                 << (wallTime > 0 ? fileResults.size() / wallTime : 0.) << " files/s, " << steals << " tasks stolen)"
+                 << (mergedFileName.empty() ? "" : ", merged into " + mergedFileName));
+}
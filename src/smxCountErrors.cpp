@@ -0,0 +1,100 @@
+#include "smxCountErrors.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+smxCountErrors::smxCountErrors(int pulses, int maxCount) : nPulses(pulses) {
+    int size = std::max(pulses, maxCount) + 1;
+    tableLo.resize(size);
+    tableHi.resize(size);
+    for (int count = 0; count < size; ++count) {
+        willsonErrors(count, nPulses, tableLo[count], tableHi[count]);
+    }
+}
+
+int smxCountErrors::getMaxCount() const {
+    return static_cast<int>(tableLo.size()) - 1;
+}
+
+void smxCountErrors::compute(int count, double& errLo, double& errHi) const {
+    if (count >= 0 && static_cast<size_t>(count) < tableLo.size()) {
+        errLo = tableLo[count];
+        errHi = tableHi[count];
+    } else {
+        willsonErrors(count, nPulses, errLo, errHi);
+    }
+}
+
+void smxCountErrors::compute(std::span<const uint16_t> counts, double* errLo, double* errHi) const {
+    const size_t n = counts.size();
+    const uint16_t* in = counts.data();
+    size_t i = 0;
+#ifdef __AVX2__
+    // Four counts per step; a step with a count beyond the table is done by the scalar loop
+    const __m128i maxIndex = _mm_set1_epi32(getMaxCount());
+    // Masked gathers with a zero source; the unmasked form trips -Wmaybe-uninitialized on its undefined source
+    const __m256d allLanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    for (; i + 4 <= n; i += 4) {
+        __m128i index = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i)));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi32(index, maxIndex)) != 0) {
+            for (size_t k = i; k < i + 4; ++k) compute(in[k], errLo[k], errHi[k]);
+            continue;
+        }
+        _mm256_storeu_pd(errLo + i, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), tableLo.data(), index, allLanes, 8));
+        _mm256_storeu_pd(errHi + i, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), tableHi.data(), index, allLanes, 8));
+    }
+#endif
+    const double* lo = tableLo.data();
+    const double* hi = tableHi.data();
+    const size_t size = tableLo.size();
+    for (; i < n; ++i) {
+        size_t count = in[i];
+        if (count < size) {
+            errLo[i] = lo[count];
+            errHi[i] = hi[count];
+        } else {
+            willsonErrors(count, nPulses, errLo[i], errHi[i]);
+        }
+    }
+}
+
+void smxCountErrors::poissonianErrors(double count, double& errLo, double& errHi) {
+    errLo = 0;
+    errHi = 1.841;
+    if(count != 0) {
+        errLo = -std::sqrt(count -.25);   // Lower error approximation
+        errHi = std::sqrt(count + .75);   // Upper error approximation
+    }
+}
+
+void smxCountErrors::willsonErrors(double count, int n, double& errLo, double& errHi) {
+    double p_hat = count / n; // Proportion of successes
+    if (p_hat < 0 || p_hat > 1) {
+        poissonianErrors(count, errLo, errHi); // Handle invalid probabilities
+        return;
+    }
+
+    double z = 1.0; // z-value for confidence interval
+    double z2 = z * z; // Precompute z-squared for efficiency
+
+    // Compute the Wilson score interval with continuity correction
+    double sqrtTermMinus = p_hat != 0 
+        ? z * sqrt(z2 - 2 - (1.0 / n) + 4 * p_hat * (n * (1 - p_hat) + 1)) 
+        : 0.0;
+    double sqrtTermPlus = p_hat != 1 
+        ? z * sqrt(z2 + 2 - (1.0 / n) + 4 * p_hat * (n * (1 - p_hat) - 1)) 
+        : 0.0;
+
+    double w_cc_minus = p_hat != 0 
+        ? std::max(0.0, (2 * n * p_hat + z2 - 1 - sqrtTermMinus) / (2 * (n + z2))) 
+        : 0.0;
+    double w_cc_plus = p_hat < 1 
+        ? std::min(1.0, (2 * n * p_hat + z2 + 1 + sqrtTermPlus) / (2 * (n + z2))) 
+        : 1.0;
+
+    errLo = n * w_cc_minus - n * p_hat -.5;
+    errHi = n * w_cc_plus - n * p_hat +.5;
+}
@@ -0,0 +1,48 @@
+#include "smxCurveClassifier.h"
+#include <algorithm>
+#include <cmath>
+
+smxCurveClassifier::smxCurveClassifier(int pulses)
+    : nPulses(pulses),
+      maxDrop(std::max(3.0, 3 * std::sqrt(0.25 * std::max(pulses, 0)))) {
+}
+
+void smxCurveClassifier::setNoiseFactor(double factor) {
+    noiseFactor = std::max(1.0, factor);
+}
+
+void smxCurveClassifier::setMaxDrop(double counts) {
+    maxDrop = counts;
+}
+
+smxCurveLabel smxCurveClassifier::classify(std::span<const uint16_t> counts) const {
+    if (nPulses <= 0 || counts.empty()) return smxCurveLabel::Fittable;
+
+    const double noiseLimit = nPulses * noiseFactor;
+    bool allZero = true, allSaturated = true, noisy = false, dropped = false;
+    int runningMax = 0;
+    for (uint16_t count : counts) {
+        allZero = allZero && count == 0;
+        allSaturated = allSaturated && count >= nPulses;
+        noisy = noisy || count > noiseLimit;
+        dropped = dropped || runningMax - count > maxDrop;
+        runningMax = std::max(runningMax, static_cast<int>(count));
+    }
+
+    if (allZero) return smxCurveLabel::Dead;
+    if (allSaturated) return smxCurveLabel::Saturated;
+    if (noisy) return smxCurveLabel::Noisy;
+    if (dropped) return smxCurveLabel::NonMonotonic;
+    return smxCurveLabel::Fittable;
+}
+
+const char* smxCurveClassifier::labelName(smxCurveLabel label) {
+    switch (label) {
+        case smxCurveLabel::Fittable: return "fittable";
+        case smxCurveLabel::Dead: return "dead";
+        case smxCurveLabel::Saturated: return "saturated";
+        case smxCurveLabel::Noisy: return "noisy";
+        case smxCurveLabel::NonMonotonic: return "non-monotonic";
+    }
+    return "unknown";
+}
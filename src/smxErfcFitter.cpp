@@ -0,0 +1,451 @@
+#include "smxErfcFitter.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+constexpr double kSqrt2 = 1.41421356237309504880;
+constexpr double kInvSqrtPi = 0.56418958354775628695;
+
+/**
+ * @brief exp(x) for x <= 0, inlined so that loops calling it can be vectorized.
+ * @details Reduces x = k ln2 + r with |r| <= ln2/2 and sums the Taylor series of exp(r)
+ *          to degree 12 (relative error about 2e-16). Arguments below -708 are clamped,
+ *          giving about 3e-308 instead of an underflow to zero.
+ */
+inline double expNegative(double x) {
+    constexpr double kLog2e = 1.44269504088896340736;
+    constexpr double kLn2Hi = 6.93147180369123816490e-01;
+    constexpr double kLn2Lo = 1.90821492927058770002e-10;
+    constexpr double kRound = 6755399441055744.0; // 1.5 * 2^52, rounds to an integer in the low bits
+    x = x < -708.0 ? -708.0 : x;
+    double shifted = x * kLog2e + kRound;
+    double k = shifted - kRound;
+    double r = (x - k * kLn2Hi) - k * kLn2Lo;
+    double p = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 +
+               r * (1.0 / 720 + r * (1.0 / 5040 + r * (1.0 / 40320 + r * (1.0 / 362880 +
+               r * (1.0 / 3628800 + r * (1.0 / 39916800 + r * (1.0 / 479001600))))))))))));
+    // 2^k from the integer in the low bits of the shifted value
+    uint64_t exponent = (std::bit_cast<uint64_t>(shifted) + 1023) << 52;
+    return p * std::bit_cast<double>(exponent);
+}
+
+} // namespace
+
+bool smxErfcFitter::solveLinear(double* M, double* b, int n) {
+    for (int col = 0; col < n; ++col) {
+        int pivot = col;
+        for (int row = col + 1; row < n; ++row) {
+            if (std::fabs(M[row * n + col]) > std::fabs(M[pivot * n + col])) pivot = row;
+        }
+        if (M[pivot * n + col] == 0.0) return false;
+        if (pivot != col) {
+            for (int k = 0; k < n; ++k) std::swap(M[col * n + k], M[pivot * n + k]);
+            std::swap(b[col], b[pivot]);
+        }
+        for (int row = col + 1; row < n; ++row) {
+            double factor = M[row * n + col] / M[col * n + col];
+            for (int k = col; k < n; ++k) M[row * n + k] -= factor * M[col * n + k];
+            b[row] -= factor * b[col];
+        }
+    }
+    for (int row = n - 1; row >= 0; --row) {
+        double sum = b[row];
+        for (int k = row + 1; k < n; ++k) sum -= M[row * n + k] * b[k];
+        b[row] = sum / M[row * n + row];
+    }
+    return true;
+}
+
+void smxErfcFitter::erfcBatch(const double* u, double* erfcOut, double* gaussOut, std::size_t n) {
+    // erfc(z) = t * exp(-z^2 + P(t)), t = 1 / (1 + z/2), for z >= 0 (Numerical Recipes, erfcc)
+    // Without calls or branches in the body, so that the loop is vectorized (-fopenmp-simd)
+#pragma omp simd
+    for (std::size_t i = 0; i < n; ++i) {
+        double z = std::fabs(u[i]);
+        double t = 1.0 / (1.0 + 0.5 * z);
+        double poly = -1.26551223 + t * (1.00002368 + t * (0.37409196 + t * (0.09678418 +
+                      t * (-0.18628806 + t * (0.27886807 + t * (-1.13520398 + t * (1.48851587 +
+                      t * (-0.82215223 + t * 0.17087277))))))));
+        double g = expNegative(-z * z);
+        double r = t * g * expNegative(poly);
+        double s = u[i] < 0 ? -1.0 : 1.0;
+        erfcOut[i] = (1.0 - s) + s * r; // 2 - r for negative u
+        gaussOut[i] = g;
+    }
+}
+
+bool smxErfcFitter::estimateMoments(const double* xValues, const double* yValues, std::size_t n,
+                                    double& offset, double& threshold, double& sigma) {
+    if (n < 3) return false;
+
+    // Total rise and the 16% and 84% points of the cumulative rise, which are
+    // insensitive to single outlying counts far from the edge
+    double rise = yValues[n - 1] - yValues[0];
+    if (!(rise > 0)) return false;
+    double x16 = xValues[0], x84 = xValues[n - 1];
+    bool found16 = false;
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+        double cumulative = yValues[i + 1] - yValues[0];
+        double xMid = 0.5 * (xValues[i] + xValues[i + 1]);
+        if (!found16 && cumulative >= 0.16 * rise) {
+            x16 = xMid;
+            found16 = true;
+        }
+        if (cumulative >= 0.84 * rise) {
+            x84 = xMid;
+            break;
+        }
+    }
+    double step = (xValues[n - 1] - xValues[0]) / (n - 1);
+    double margin = 3 * (x84 - x16) + 2 * step;
+
+    // Moments of the signed derivative within the window around the edge,
+    // negative noise fluctuations cancel out
+    double sum0 = 0, sum1 = 0, sum2 = 0;
+    std::size_t first = n;
+    for (std::size_t i = 0; i + 1 < n; ++i) {
+        double xMid = 0.5 * (xValues[i] + xValues[i + 1]);
+        if (xMid < x16 - margin || xMid > x84 + margin) continue;
+        if (first == n) first = i;
+        double d = yValues[i + 1] - yValues[i];
+        sum0 += d;
+        sum1 += d * xMid;
+        sum2 += d * xMid * xMid;
+    }
+    if (!(sum0 > 0)) return false;
+
+    double mean = sum1 / sum0;
+    double variance = sum2 / sum0 - mean * mean - step * step / 12.0;
+    if (!std::isfinite(mean) || mean < xValues[0] || mean > xValues[n - 1]) return false;
+
+    offset = yValues[first];
+    threshold = mean;
+    sigma = variance > 0 ? std::sqrt(variance) : 0;
+    return true;
+}
+
+void smxErfcFitter::setData(const double* xValues, const double* yValues, const double* yErrLo, const double* yErrHi, std::size_t n) {
+    x.assign(xValues, xValues + n);
+    y.assign(yValues, yValues + n);
+    errLo.resize(n);
+    errHi.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        errLo[i] = std::fabs(yErrLo[i]);
+        errHi[i] = std::fabs(yErrHi[i]);
+    }
+    arg.resize(n);
+    erfcVal.resize(n);
+    gauss.resize(n);
+    weight.resize(n);
+    residual.resize(n);
+    jacobian.resize(kNPar * n);
+}
+
+void smxErfcFitter::setStart(double offset, double threshold, double sigma) {
+    start[kOffset] = offset;
+    start[kThreshold] = threshold;
+    start[kSigma] = sigma;
+}
+
+void smxErfcFitter::setLimits(int parIndex, double low, double high) {
+    if (parIndex < 0 || parIndex >= kNPar) return;
+    lower[parIndex] = low;
+    upper[parIndex] = high;
+}
+
+bool smxErfcFitter::seedFromMoments() {
+    double offsetSeed, thresholdSeed, sigmaSeed;
+    if (!estimateMoments(x.data(), y.data(), x.size(), offsetSeed, thresholdSeed, sigmaSeed)) {
+        return false;
+    }
+
+    // Keep generous margins around the estimate, within the current limits
+    double sigmaLo = std::max(lower[kSigma], sigmaSeed / 4);
+    double sigmaHi = std::min(upper[kSigma], std::max(4 * sigmaSeed, 2.0));
+    double thresholdMargin = std::max(10.0, 5 * sigmaHi);
+    lower[kSigma] = sigmaLo;
+    upper[kSigma] = sigmaHi;
+    lower[kThreshold] = std::max(lower[kThreshold], thresholdSeed - thresholdMargin);
+    upper[kThreshold] = std::min(upper[kThreshold], thresholdSeed + thresholdMargin);
+    for (int p = 0; p < kNPar; ++p) {
+        double seed = p == kOffset ? offsetSeed : p == kThreshold ? thresholdSeed : sigmaSeed;
+        start[p] = std::clamp(seed, lower[p], upper[p]);
+    }
+    return true;
+}
+
+double smxErfcFitter::getStart(int parIndex) const {
+    return parIndex >= 0 && parIndex < kNPar ? start[parIndex] : 0;
+}
+
+double smxErfcFitter::getLower(int parIndex) const {
+    return parIndex >= 0 && parIndex < kNPar ? lower[parIndex] : 0;
+}
+
+double smxErfcFitter::getUpper(int parIndex) const {
+    return parIndex >= 0 && parIndex < kNPar ? upper[parIndex] : 0;
+}
+
+void smxErfcFitter::setAsymErrors(bool enable) {
+    computeAsymErrors = enable;
+}
+
+int smxErfcFitter::getIterations() const {
+    return iterations;
+}
+
+double smxErfcFitter::chi2(double offset, double threshold, double sigma) {
+    double par[kNPar] = {offset, threshold, sigma};
+    return evaluate(par, false);
+}
+
+double smxErfcFitter::evaluate(const double* par, bool withJacobian) {
+    const std::size_t n = x.size();
+    const double invScale = 1.0 / (kSqrt2 * par[kSigma]);
+
+    for (std::size_t i = 0; i < n; ++i) {
+        arg[i] = (par[kThreshold] - x[i]) * invScale;
+    }
+    erfcBatch(arg.data(), erfcVal.data(), gauss.data(), n);
+
+    double sum = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        double diff = par[kOffset] + 0.5 * erfcVal[i] - y[i];
+        // Upper error bar if the model lies above the point, as in RooXYChi2Var
+        double err = diff > 0 ? errHi[i] : errLo[i];
+        weight[i] = err > 0 ? 1.0 / err : 0.0;
+        residual[i] = diff * weight[i];
+        sum += residual[i] * residual[i];
+    }
+
+    if (withJacobian) {
+        double* dOffset = jacobian.data();
+        double* dThreshold = dOffset + n;
+        double* dSigma = dThreshold + n;
+        const double dThrScale = -kInvSqrtPi * invScale;
+        const double dSigScale = kInvSqrtPi / par[kSigma];
+        for (std::size_t i = 0; i < n; ++i) {
+            dOffset[i] = weight[i];
+            dThreshold[i] = weight[i] * dThrScale * gauss[i];
+            dSigma[i] = weight[i] * dSigScale * gauss[i] * arg[i];
+        }
+    }
+    return sum;
+}
+
+int smxErfcFitter::minimize(double* par, int fixedPar, double& chi2Out, double tolerance) {
+    const std::size_t n = x.size();
+    double lambda = 1e-3;
+    double chi2Current = evaluate(par, true);
+    if (!std::isfinite(chi2Current)) return 3;
+
+    for (int iter = 0; iter < maxIterations; ++iter) {
+        ++iterations;
+
+        // Normal equations of the free parameters
+        int freeIndex[kNPar];
+        int nFree = 0;
+        for (int p = 0; p < kNPar; ++p) {
+            if (p != fixedPar) freeIndex[nFree++] = p;
+        }
+        double A[kNPar * kNPar] = {0};
+        double g[kNPar] = {0};
+        for (int a = 0; a < nFree; ++a) {
+            const double* Ja = jacobian.data() + freeIndex[a] * n;
+            for (std::size_t i = 0; i < n; ++i) g[a] -= Ja[i] * residual[i];
+            for (int b = 0; b <= a; ++b) {
+                const double* Jb = jacobian.data() + freeIndex[b] * n;
+                double sum = 0;
+                for (std::size_t i = 0; i < n; ++i) sum += Ja[i] * Jb[i];
+                A[a * nFree + b] = A[b * nFree + a] = sum;
+            }
+        }
+
+        // Increase the damping until a step lowers the chi-square
+        bool improved = false;
+        while (!improved && lambda < 1e12) {
+            double M[kNPar * kNPar];
+            double step[kNPar];
+            for (int a = 0; a < nFree; ++a) {
+                for (int b = 0; b < nFree; ++b) M[a * nFree + b] = A[a * nFree + b];
+                M[a * nFree + a] += lambda * std::max(A[a * nFree + a], 1e-12);
+                step[a] = g[a];
+            }
+            if (!solveLinear(M, step, nFree)) {
+                lambda *= 10;
+                continue;
+            }
+
+            double trial[kNPar];
+            std::copy(par, par + kNPar, trial);
+            for (int a = 0; a < nFree; ++a) {
+                int p = freeIndex[a];
+                trial[p] = std::clamp(par[p] + step[a], lower[p], upper[p]);
+            }
+
+            double chi2Trial = evaluate(trial, true);
+            if (std::isfinite(chi2Trial) && chi2Trial < chi2Current) {
+                double decrease = chi2Current - chi2Trial;
+                std::copy(trial, trial + kNPar, par);
+                chi2Current = chi2Trial;
+                lambda = std::max(lambda * 0.3, 1e-9);
+                improved = true;
+                if (decrease < tolerance * (1.0 + chi2Current)) {
+                    chi2Out = chi2Current;
+                    return 0;
+                }
+            } else {
+                lambda *= 10;
+            }
+        }
+
+        if (!improved) {
+            // No step lowers the chi-square any more: minimum reached
+            evaluate(par, true);
+            chi2Out = chi2Current;
+            return 0;
+        }
+    }
+
+    chi2Out = chi2Current;
+    return 1;
+}
+
+bool smxErfcFitter::covarianceMatrix(const double* par, double* covariance) {
+    const std::size_t n = x.size();
+    evaluate(par, true);
+
+    // Covariance = (J^T J)^-1 for chi-square minimization (error definition 1)
+    double A[kNPar * kNPar];
+    for (int a = 0; a < kNPar; ++a) {
+        for (int b = 0; b < kNPar; ++b) {
+            const double* Ja = jacobian.data() + a * n;
+            const double* Jb = jacobian.data() + b * n;
+            double sum = 0;
+            for (std::size_t i = 0; i < n; ++i) sum += Ja[i] * Jb[i];
+            A[a * kNPar + b] = sum;
+        }
+    }
+    for (int col = 0; col < kNPar; ++col) {
+        double M[kNPar * kNPar];
+        double e[kNPar] = {0};
+        std::copy(A, A + kNPar * kNPar, M);
+        e[col] = 1.0;
+        if (!solveLinear(M, e, kNPar)) return false;
+        for (int row = 0; row < kNPar; ++row) covariance[row * kNPar + col] = e[row];
+    }
+    for (int p = 0; p < kNPar; ++p) {
+        if (!(covariance[p * kNPar + p] > 0)) return false;
+    }
+    return true;
+}
+
+double smxErfcFitter::profileCrossing(const double* best, double chi2Min, int parIndex, int direction, double stepGuess) {
+    const double limit = direction > 0 ? upper[parIndex] - best[parIndex] : best[parIndex] - lower[parIndex];
+    if (limit <= 0) return 0;
+
+    // Chi-square of the profile at distance d, minus the chi2 + 1 target
+    auto excess = [&](double d) {
+        double par[kNPar];
+        std::copy(best, best + kNPar, par);
+        par[parIndex] = best[parIndex] + direction * d;
+        double chi2Profile;
+        minimize(par, parIndex, chi2Profile, 1e-5);
+        return chi2Profile - chi2Min - 1.0;
+    };
+
+    // Bracket the crossing, starting from the parabolic error
+    double dLow = 0, hLow = -1.0;
+    double dHigh = std::min(std::max(stepGuess, 1e-6), limit);
+    double hHigh = excess(dHigh);
+    while (hHigh < 0) {
+        if (dHigh >= limit) return limit;
+        dLow = dHigh;
+        hLow = hHigh;
+        dHigh = std::min(2 * dHigh, limit);
+        hHigh = excess(dHigh);
+    }
+
+    // Regula falsi refinement
+    for (int iter = 0; iter < 8; ++iter) {
+        double d = dLow - hLow * (dHigh - dLow) / (hHigh - hLow);
+        double h = excess(d);
+        if (std::fabs(h) < 1e-2) return d;
+        if (h < 0) {
+            dLow = d;
+            hLow = h;
+        } else {
+            dHigh = d;
+            hHigh = h;
+        }
+    }
+    return dLow - hLow * (dHigh - dLow) / (hHigh - hLow);
+}
+
+int smxErfcFitter::fit(smxFitResult& result) {
+    iterations = 0;
+    result.retries = 0;
+    result.status = 3;
+    if (x.empty()) return result.status;
+
+    double best[kNPar];
+    double chi2Min = 0;
+    double covariance[kNPar * kNPar];
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        for (int p = 0; p < kNPar; ++p) best[p] = std::clamp(start[p], lower[p], upper[p]);
+
+        if (attempt == 1) {
+            // Retry from the best threshold of a coarse scan over the allowed range
+            double bestChi2 = evaluate(best, false);
+            double bestThreshold = best[kThreshold];
+            for (double thr = lower[kThreshold]; thr <= upper[kThreshold]; thr += 2.0) {
+                best[kThreshold] = thr;
+                double c = evaluate(best, false);
+                if (c < bestChi2) {
+                    bestChi2 = c;
+                    bestThreshold = thr;
+                }
+            }
+            best[kThreshold] = bestThreshold;
+        }
+
+        result.retries++;
+        result.status = minimize(best, -1, chi2Min, 1e-9);
+        // A singular curvature matrix means the minimizer never reached the transition
+        if (result.status == 0 && !covarianceMatrix(best, covariance)) result.status = 4;
+        if (result.status == 0) break;
+    }
+
+    result.offset = best[kOffset];
+    result.threshold = best[kThreshold];
+    result.sigma = best[kSigma];
+    result.chi2 = chi2Min;
+
+    double* values[kNPar] = {&result.offset, &result.threshold, &result.sigma};
+    double* errorsLo[kNPar] = {&result.offsetErrLo, &result.thresholdErrLo, &result.sigmaErrLo};
+    double* errorsHi[kNPar] = {&result.offsetErrHi, &result.thresholdErrHi, &result.sigmaErrHi};
+    for (int p = 0; p < kNPar; ++p) {
+        *errorsLo[p] = *errorsHi[p] = 0;
+    }
+    if (result.status != 0) return result.status;
+
+    // The profile scans below are not counted as fit iterations
+    int fitIterations = iterations;
+    for (int p = 0; p < kNPar; ++p) {
+        double parabolic = std::sqrt(covariance[p * kNPar + p]);
+        if (computeAsymErrors) {
+            *errorsLo[p] = -profileCrossing(best, chi2Min, p, -1, parabolic);
+            *errorsHi[p] = profileCrossing(best, chi2Min, p, +1, parabolic);
+        } else {
+            *errorsLo[p] = -parabolic;
+            *errorsHi[p] = parabolic;
+        }
+        *values[p] = best[p];
+    }
+    iterations = fitIterations;
+    return result.status;
+}
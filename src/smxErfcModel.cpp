@@ -0,0 +1,76 @@
+#include "smxErfcModel.h"
+#include "smxErfcFitter.h"
+#include <span>
+
+namespace {
+
+constexpr double kInvSqrt2 = 0.70710678118654752440;
+
+} // namespace
+
+smxErfcModel::smxErfcModel(const char* name, const char* title, RooAbsReal& xVar, RooAbsReal& offsetVar,
+                           RooAbsReal& thresholdVar, RooAbsReal& sigmaVar)
+    : RooAbsReal(name, title),
+      x("x", "Pulse amplitude", this, xVar),
+      offset("offset", "Offset", this, offsetVar),
+      threshold("threshold", "Threshold", this, thresholdVar),
+      sigma("sigma", "Sigma", this, sigmaVar) {
+}
+
+smxErfcModel::smxErfcModel(const smxErfcModel& other, const char* name)
+    : RooAbsReal(other, name),
+      x("x", this, other.x),
+      offset("offset", this, other.offset),
+      threshold("threshold", this, other.threshold),
+      sigma("sigma", this, other.sigma) {
+}
+
+TObject* smxErfcModel::clone(const char* newname) const {
+    return new smxErfcModel(*this, newname);
+}
+
+void smxErfcModel::evaluateBatch(const double* xValues, std::size_t nX, const double* offsets,
+                                 const double* thresholds, const double* sigmas, std::size_t nOffsets,
+                                 std::size_t nThresholds, std::size_t nSigmas, double* output,
+                                 double* gaussScratch, std::size_t n) {
+    // Parameters are constant over the batch in a fit, the per-point form is kept for generality
+    if (nX == n && nThresholds == 1 && nSigmas == 1) {
+        const double thr = thresholds[0];
+        const double invScale = kInvSqrt2 / sigmas[0];
+        for (std::size_t i = 0; i < n; ++i) output[i] = (thr - xValues[i]) * invScale;
+    } else {
+        for (std::size_t i = 0; i < n; ++i) {
+            double thr = thresholds[nThresholds == 1 ? 0 : i];
+            double sig = sigmas[nSigmas == 1 ? 0 : i];
+            output[i] = (thr - xValues[nX == 1 ? 0 : i]) * kInvSqrt2 / sig;
+        }
+    }
+    // In place: every element is read before it is overwritten
+    smxErfcFitter::erfcBatch(output, output, gaussScratch, n);
+    for (std::size_t i = 0; i < n; ++i) {
+        output[i] = offsets[nOffsets == 1 ? 0 : i] + 0.5 * output[i];
+    }
+}
+
+double smxErfcModel::evaluate() const {
+    double xValue = x, offsetValue = offset, thresholdValue = threshold, sigmaValue = sigma;
+    double value, gauss;
+    evaluateBatch(&xValue, 1, &offsetValue, &thresholdValue, &sigmaValue, 1, 1, 1, &value, &gauss, 1);
+    return value;
+}
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 30, 0)
+void smxErfcModel::doEval(RooFit::EvalContext& ctx) const {
+    std::span<const double> xSpan = ctx.at(&x.arg());
+    std::span<const double> offsetSpan = ctx.at(&offset.arg());
+    std::span<const double> thresholdSpan = ctx.at(&threshold.arg());
+    std::span<const double> sigmaSpan = ctx.at(&sigma.arg());
+    std::span<double> output = ctx.output();
+
+    const std::size_t n = output.size();
+    if (scratch.size() < n) scratch.resize(n);
+    // x has length 1 when all points share it, e.g. when a parameter is batched instead
+    evaluateBatch(xSpan.data(), xSpan.size(), offsetSpan.data(), thresholdSpan.data(), sigmaSpan.data(),
+                  offsetSpan.size(), thresholdSpan.size(), sigmaSpan.size(), output.data(), scratch.data(), n);
+}
+#endif
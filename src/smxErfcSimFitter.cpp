@@ -0,0 +1,305 @@
+#include "smxErfcSimFitter.h"
+#include "smxErfcFitter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double kSqrt2 = 1.41421356237309504880;
+constexpr double kInvSqrtPi = 0.56418958354775628695;
+
+// Limits of the linear threshold model, wide enough to never constrain a physical scan
+constexpr double kInterceptLimit = 1000.;
+constexpr double kSlopeLimit = 256.;
+
+} // namespace
+
+void smxErfcSimFitter::clear() {
+    curves.clear();
+    x.clear();
+    y.clear();
+    errLo.clear();
+    errHi.clear();
+}
+
+void smxErfcSimFitter::setThresholdModel(ThresholdModel model) {
+    thresholdModel = model;
+}
+
+void smxErfcSimFitter::addCurve(double position, const double* xValues, const double* yValues, const double* yErrLo,
+                                const double* yErrHi, std::size_t n, double offset, double threshold,
+                                double thresholdLow, double thresholdHigh) {
+    Curve curve;
+    curve.position = position;
+    curve.first = x.size();
+    curve.n = n;
+    curve.offsetStart = offset;
+    curve.thresholdStart = threshold;
+    curve.thresholdLow = thresholdLow;
+    curve.thresholdHigh = thresholdHigh;
+    curves.push_back(curve);
+
+    x.insert(x.end(), xValues, xValues + n);
+    y.insert(y.end(), yValues, yValues + n);
+    for (std::size_t i = 0; i < n; ++i) {
+        errLo.push_back(std::fabs(yErrLo[i]));
+        errHi.push_back(std::fabs(yErrHi[i]));
+    }
+}
+
+void smxErfcSimFitter::setSigma(double start, double low, double high) {
+    sigmaStart = start;
+    sigmaLow = low;
+    sigmaHigh = high;
+}
+
+void smxErfcSimFitter::setOffsetLimits(double low, double high) {
+    offsetLow = low;
+    offsetHigh = high;
+}
+
+int smxErfcSimFitter::getIterations() const {
+    return iterations;
+}
+
+std::size_t smxErfcSimFitter::getNCurves() const {
+    return curves.size();
+}
+
+int smxErfcSimFitter::offsetIndex() const {
+    return thresholdModel == kLinearThresholds ? 3 : 1 + static_cast<int>(curves.size());
+}
+
+int smxErfcSimFitter::nPar() const {
+    return offsetIndex() + static_cast<int>(curves.size());
+}
+
+double smxErfcSimFitter::curveThreshold(const double* par, std::size_t k) const {
+    return thresholdModel == kLinearThresholds ? par[1] + par[2] * curves[k].position : par[1 + k];
+}
+
+double smxErfcSimFitter::evaluate(const double* par, double* A, double* g) {
+    const int P = nPar();
+    const double sigma = par[0];
+    const double invScale = 1.0 / (kSqrt2 * sigma);
+    const double dThrScale = -kInvSqrtPi * invScale;
+    const double dSigScale = kInvSqrtPi / sigma;
+    if (A) {
+        std::fill(A, A + P * P, 0.0);
+        std::fill(g, g + P, 0.0);
+    }
+
+    double sum = 0;
+    curveChi2.assign(curves.size(), 0.0);
+    for (std::size_t k = 0; k < curves.size(); ++k) {
+        const Curve& curve = curves[k];
+        const double threshold = curveThreshold(par, k);
+        const double offset = par[offsetIndex() + k];
+        double* u = arg.data() + curve.first;
+        for (std::size_t i = 0; i < curve.n; ++i) {
+            u[i] = (threshold - x[curve.first + i]) * invScale;
+        }
+        smxErfcFitter::erfcBatch(u, erfcVal.data() + curve.first, gauss.data() + curve.first, curve.n);
+
+        // Sums of the local derivatives (sigma, threshold, offset) over the points of the curve
+        double S[3][3] = {{0}};
+        double G[3] = {0};
+        double chi2 = 0;
+        for (std::size_t j = curve.first; j < curve.first + curve.n; ++j) {
+            double diff = offset + 0.5 * erfcVal[j] - y[j];
+            // Upper error bar if the model lies above the point, as in RooXYChi2Var
+            double err = diff > 0 ? errHi[j] : errLo[j];
+            double w = err > 0 ? 1.0 / err : 0.0;
+            double r = diff * w;
+            chi2 += r * r;
+            if (!A) continue;
+            double d[3] = {w * dSigScale * gauss[j] * arg[j], w * dThrScale * gauss[j], w};
+            for (int a = 0; a < 3; ++a) {
+                G[a] -= d[a] * r;
+                for (int b = 0; b <= a; ++b) S[a][b] += d[a] * d[b];
+            }
+        }
+        curveChi2[k] = chi2;
+        sum += chi2;
+        if (!A) continue;
+
+        // Scatter into the normal equations: the threshold derivative maps to the
+        // curve's threshold or to intercept and slope of the linear model
+        int index[4], local[4];
+        double factor[4];
+        int m = 0;
+        index[m] = 0; factor[m] = 1.0; local[m++] = 0;
+        if (thresholdModel == kLinearThresholds) {
+            index[m] = 1; factor[m] = 1.0; local[m++] = 1;
+            index[m] = 2; factor[m] = curve.position; local[m++] = 1;
+        } else {
+            index[m] = 1 + static_cast<int>(k); factor[m] = 1.0; local[m++] = 1;
+        }
+        index[m] = offsetIndex() + static_cast<int>(k); factor[m] = 1.0; local[m++] = 2;
+        for (int a = 0; a < m; ++a) {
+            g[index[a]] += factor[a] * G[local[a]];
+            for (int b = 0; b < m; ++b) {
+                int la = std::max(local[a], local[b]), lb = std::min(local[a], local[b]);
+                A[index[a] * P + index[b]] += factor[a] * factor[b] * S[la][lb];
+            }
+        }
+    }
+    return sum;
+}
+
+int smxErfcSimFitter::minimize(std::vector<double>& par, double& chi2Out) {
+    const int P = nPar();
+    std::vector<double> A(P * P), g(P), M(P * P), step(P), trial(P);
+    double lambda = 1e-3;
+    double chi2Current = evaluate(par.data(), A.data(), g.data());
+    if (!std::isfinite(chi2Current)) return 3;
+
+    for (int iter = 0; iter < maxIterations; ++iter) {
+        ++iterations;
+
+        // Increase the damping until a step lowers the chi-square
+        bool improved = false;
+        while (!improved && lambda < 1e12) {
+            for (int a = 0; a < P; ++a) {
+                for (int b = 0; b < P; ++b) M[a * P + b] = A[a * P + b];
+                M[a * P + a] += lambda * std::max(A[a * P + a], 1e-12);
+                step[a] = g[a];
+            }
+            if (!smxErfcFitter::solveLinear(M.data(), step.data(), P)) {
+                lambda *= 10;
+                continue;
+            }
+
+            for (int p = 0; p < P; ++p) {
+                trial[p] = std::clamp(par[p] + step[p], lower[p], upper[p]);
+            }
+
+            double chi2Trial = evaluate(trial.data(), nullptr, nullptr);
+            if (std::isfinite(chi2Trial) && chi2Trial < chi2Current) {
+                double decrease = chi2Current - chi2Trial;
+                par = trial;
+                chi2Current = evaluate(par.data(), A.data(), g.data());
+                lambda = std::max(lambda * 0.3, 1e-9);
+                improved = true;
+                if (decrease < 1e-9 * (1.0 + chi2Current)) {
+                    chi2Out = chi2Current;
+                    return 0;
+                }
+            } else {
+                lambda *= 10;
+            }
+        }
+
+        if (!improved) {
+            // No step lowers the chi-square any more: minimum reached
+            chi2Out = evaluate(par.data(), nullptr, nullptr);
+            return 0;
+        }
+    }
+
+    chi2Out = chi2Current;
+    return 1;
+}
+
+int smxErfcSimFitter::fit(std::vector<smxFitResult>& results) {
+    iterations = 0;
+    results.resize(curves.size());
+    for (smxFitResult& result : results) {
+        result.status = 3;
+        result.retries = 0;
+    }
+    if (curves.empty() || x.empty()) return 3;
+
+    arg.resize(x.size());
+    erfcVal.resize(x.size());
+    gauss.resize(x.size());
+
+    // Limits and starting values
+    const int P = nPar();
+    const int off = offsetIndex();
+    lower.assign(P, 0.0);
+    upper.assign(P, 0.0);
+    std::vector<double> par(P);
+    lower[0] = sigmaLow;
+    upper[0] = sigmaHigh;
+    par[0] = sigmaStart;
+    if (thresholdModel == kLinearThresholds) {
+        // Least-squares line through the starting thresholds
+        double n = 0, sp = 0, st = 0, spp = 0, spt = 0;
+        for (const Curve& curve : curves) {
+            n += 1;
+            sp += curve.position;
+            st += curve.thresholdStart;
+            spp += curve.position * curve.position;
+            spt += curve.position * curve.thresholdStart;
+        }
+        double det = n * spp - sp * sp;
+        double slope = det > 0 ? (n * spt - sp * st) / det : 0.0;
+        lower[1] = -kInterceptLimit;
+        upper[1] = kInterceptLimit;
+        lower[2] = -kSlopeLimit;
+        upper[2] = kSlopeLimit;
+        par[1] = (st - slope * sp) / n;
+        par[2] = slope;
+    } else {
+        for (std::size_t k = 0; k < curves.size(); ++k) {
+            lower[1 + k] = curves[k].thresholdLow;
+            upper[1 + k] = curves[k].thresholdHigh;
+            par[1 + k] = curves[k].thresholdStart;
+        }
+    }
+    for (std::size_t k = 0; k < curves.size(); ++k) {
+        lower[off + k] = offsetLow;
+        upper[off + k] = offsetHigh;
+        par[off + k] = curves[k].offsetStart;
+    }
+    for (int p = 0; p < P; ++p) par[p] = std::clamp(par[p], lower[p], upper[p]);
+
+    double chi2Min = 0;
+    int status = minimize(par, chi2Min);
+
+    // Covariance = (J^T J)^-1 for chi-square minimization (error definition 1)
+    std::vector<double> covariance(P * P, 0.0);
+    if (status == 0) {
+        std::vector<double> A(P * P), g(P), M(P * P), e(P);
+        evaluate(par.data(), A.data(), g.data());
+        for (int col = 0; col < P && status == 0; ++col) {
+            M = A;
+            std::fill(e.begin(), e.end(), 0.0);
+            e[col] = 1.0;
+            if (!smxErfcFitter::solveLinear(M.data(), e.data(), P) || !(e[col] > 0)) {
+                status = 4;
+                break;
+            }
+            for (int row = 0; row < P; ++row) covariance[row * P + col] = e[row];
+        }
+    }
+    evaluate(par.data(), nullptr, nullptr);
+
+    auto error = [&](int a, int b, double fa, double fb) {
+        double variance = fa * fa * covariance[a * P + a] + fb * fb * covariance[b * P + b] +
+                          2 * fa * fb * covariance[a * P + b];
+        return variance > 0 ? std::sqrt(variance) : 0.0;
+    };
+    for (std::size_t k = 0; k < curves.size(); ++k) {
+        smxFitResult& result = results[k];
+        result.status = status;
+        result.retries = 1;
+        result.chi2 = curveChi2[k];
+        result.sigma = par[0];
+        result.threshold = curveThreshold(par.data(), k);
+        result.offset = par[off + k];
+
+        double sigmaErr = error(0, 0, 1.0, 0.0);
+        double offsetErr = error(off + k, off + k, 1.0, 0.0);
+        double thresholdErr = thresholdModel == kLinearThresholds ? error(1, 2, 1.0, curves[k].position)
+                                                                  : error(1 + k, 1 + k, 1.0, 0.0);
+        result.sigmaErrLo = -sigmaErr;
+        result.sigmaErrHi = sigmaErr;
+        result.thresholdErrLo = -thresholdErr;
+        result.thresholdErrHi = thresholdErr;
+        result.offsetErrLo = -offsetErr;
+        result.offsetErrHi = offsetErr;
+    }
+    return status;
+}
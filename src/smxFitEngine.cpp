@@ -0,0 +1,528 @@
+#include "smxFitEngine.h"
+#include "smxScurveFit.h"
+#include "smxResultCache.h"
+#include "smxFitResultTable.h"
+#include "smxConstants.h"
+#include "smxLog.h"
+#include "smxInstrument.h"
+#include <RooCategory.h>
+#include <RooArgSet.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <new>
+#include <thread>
+
+namespace {
+
+// Header of the anonymous shared-memory block, followed by one smxFitResult per task
+struct alignas(smxFitResult) SharedHeader {
+    std::atomic<int> nextTask;   // next task (chain of units) to be taken by a worker
+    std::atomic<int> nDone;      // number of finished tasks
+};
+
+// Compares two results, ignoring the wall time
+bool sameFit(const smxFitResult& a, const smxFitResult& b) {
+    return a.channel == b.channel && a.comparator == b.comparator &&
+           a.offset == b.offset && a.offsetErrLo == b.offsetErrLo && a.offsetErrHi == b.offsetErrHi &&
+           a.threshold == b.threshold && a.thresholdErrLo == b.thresholdErrLo && a.thresholdErrHi == b.thresholdErrHi &&
+           a.sigma == b.sigma && a.sigmaErrLo == b.sigmaErrLo && a.sigmaErrHi == b.sigmaErrHi &&
+           a.chi2 == b.chi2 && a.status == b.status && a.retries == b.retries && a.label == b.label &&
+           a.iterations == b.iterations;
+}
+
+int defaultWorkers() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? static_cast<int>(n) : 1;
+}
+
+} // namespace
+
+smxFitEngine::smxFitEngine(int workers) {
+    setWorkers(workers);
+}
+
+void smxFitEngine::setWorkers(int workers) {
+    nWorkers = workers > 0 ? workers : defaultWorkers();
+}
+
+int smxFitEngine::getWorkers() const {
+    return nWorkers;
+}
+
+void smxFitEngine::setBackend(smxFitBackend fitBackend) {
+    backend = fitBackend;
+}
+
+void smxFitEngine::setMomentSeeding(bool enable) {
+    momentSeeding = enable;
+}
+
+void smxFitEngine::setResultCache(smxResultCache* cache) {
+    resultCache = cache;
+}
+
+void smxFitEngine::setFitMode(smxFitMode mode) {
+    fitMode = mode;
+}
+
+void smxFitEngine::setEvalBackend(smxEvalBackend backendType) {
+    evalBackend = backendType;
+}
+
+void smxFitEngine::setFitWindow(int marginPoints) {
+    fitWindowMargin = marginPoints < 0 ? -1 : marginPoints;
+}
+
+void smxFitEngine::setCurveLabels(const smxFitResultTable* labels) {
+    curveLabels = labels;
+}
+
+void smxFitEngine::setWarmStart(smxWarmStart policy) {
+    warmStart = policy;
+}
+
+void smxFitEngine::setStartValues(const std::vector<smxFitResult>& previous) {
+    startValues = previous;
+}
+
+int smxFitEngine::curveLabel(int channel, int comparator) const {
+    if (!curveLabels) return 0;
+    const smxFitResult* row = curveLabels->find(channel, comparator);
+    return row ? row->label : 0;
+}
+
+void smxFitEngine::fitUnit(const std::vector<RooDataSet*>& datasets, const std::vector<std::pair<int, int>>& tasks,
+                           size_t first, size_t count, smxFitResult* out,
+                           const std::vector<smxFitResult>& starts) const {
+    int channel = tasks[first].first;
+    bool singleComparator = fitMode == smxFitMode::Independent && warmStart == smxWarmStart::Off;
+    int comparator = singleComparator ? tasks[first].second : -1;
+    std::vector<int> skipped;
+    for (size_t i = first; i < first + count; ++i) {
+        if (curveLabel(channel, tasks[i].second) != 0) skipped.push_back(tasks[i].second);
+    }
+    smxScurveFit scurveFit(datasets[channel], channel, comparator);
+    scurveFit.setBackend(backend);
+    scurveFit.setMomentSeeding(momentSeeding);
+    scurveFit.setFitMode(fitMode);
+    scurveFit.setEvalBackend(evalBackend);
+    scurveFit.setFitWindow(fitWindowMargin);
+    scurveFit.setSkippedComparators(skipped);
+    scurveFit.setWarmStart(warmStart != smxWarmStart::Off);
+    scurveFit.setStartValues(starts);
+    scurveFit.fitScurvesSeq();
+
+    // Skipped comparators have no result, so match the results to the tasks by comparator
+    const std::vector<smxFitResult>& fitted = scurveFit.getResults();
+    for (size_t i = 0; i < count; ++i) {
+        int disc = tasks[first + i].second;
+        auto it = std::find_if(fitted.begin(), fitted.end(),
+                               [disc](const smxFitResult& result) { return result.comparator == disc; });
+        if (it != fitted.end()) {
+            out[i] = *it;
+        } else {
+            out[i] = smxFitResult();
+            out[i].channel = channel;
+            out[i].comparator = disc;
+            out[i].label = curveLabel(channel, disc);
+        }
+    }
+}
+
+void smxFitEngine::fitChain(const std::vector<RooDataSet*>& datasets, const std::vector<std::pair<int, int>>& tasks,
+                            const std::vector<std::pair<size_t, size_t>>& units, std::pair<size_t, size_t> chain,
+                            smxFitResult* out) const {
+    std::vector<smxFitResult> starts;
+    for (size_t u = chain.first; u < chain.second; ++u) {
+        const auto& [first, count] = units[u];
+        int channel = tasks[first].first;
+        starts.clear();
+        if (warmStart == smxWarmStart::Channel && u > chain.first) {
+            // The channel fitted before in this chain
+            starts.assign(out + units[u - 1].first, out + units[u - 1].first + units[u - 1].second);
+        } else if (warmStart == smxWarmStart::PreviousScan) {
+            std::copy_if(startValues.begin(), startValues.end(), std::back_inserter(starts),
+                         [channel](const smxFitResult& result) { return result.channel == channel; });
+        }
+        if ((warmStart == smxWarmStart::Channel || warmStart == smxWarmStart::PreviousScan) && starts.empty()) {
+            // No neighbouring channel or previous scan, all comparators start from the previous comparators
+            SMX_COUNT("warmStartFallbacks", count);
+            SMX_LOG_DEBUG("No start values for channel " << channel << ", warm-starting from its own comparators.");
+        }
+        fitUnit(datasets, tasks, first, count, out + first, starts);
+    }
+}
+
+const std::vector<smxFitResult>& smxFitEngine::getResults() const {
+    return results;
+}
+
+double smxFitEngine::getWallTime() const {
+    return wallTime;
+}
+
+const std::vector<smxFitResult>& smxFitEngine::fit(const std::vector<RooDataSet*>& datasets) {
+    auto start = std::chrono::steady_clock::now();
+
+    // One task per (channel, comparator), in the order used by smxScurveFit::fitScurvesSeq
+    std::vector<std::pair<int, int>> tasks;
+    for (size_t ch = 0; ch < datasets.size(); ++ch) {
+        if (!datasets[ch]) continue;
+        auto* adcComp = dynamic_cast<RooCategory*>(datasets[ch]->get()->find("adcComp"));
+        if (!adcComp) {
+            SMX_LOG_ERROR("Dataset of channel " << ch << " has no adcComp category.");
+            continue;
+        }
+        for (const auto& [name, value] : adcComp->states()) {
+            tasks.emplace_back(static_cast<int>(ch), value);
+        }
+    }
+
+    // Unchanged data fitted with the same configuration is taken from the cache
+    uint64_t cacheKey = 0;
+    if (resultCache) {
+        smxHash hash;
+        hash.add("smxFitEngine").add(smxLibVersion).add(static_cast<int>(backend)).add(momentSeeding)
+            .add(static_cast<int>(fitMode)).add(static_cast<int>(evalBackend))
+            .add(fitWindowMargin);
+        for (const auto& [ch, comp] : tasks) hash.add(curveLabel(ch, comp));
+        hash.add(static_cast<int>(warmStart));
+        if (warmStart == smxWarmStart::Channel) hash.add(nWorkers);
+        if (warmStart == smxWarmStart::PreviousScan) {
+            for (const smxFitResult& start : startValues) {
+                hash.add(start.channel).add(start.comparator).add(start.status).add(start.offset)
+                    .add(start.threshold).add(start.sigma);
+            }
+        }
+        for (RooDataSet* dataset : datasets) {
+            smxResultCache::addDataSet(hash, dataset);
+        }
+        cacheKey = hash.value();
+        if (resultCache->loadFits(cacheKey, results) && results.size() == tasks.size()) {
+            wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            SMX_LOG_INFO("Took " << results.size() << " S-curve fits from the result cache in " << wallTime << " s.");
+            return results;
+        }
+    }
+
+    // Curves that are not fittable keep their label and are not fitted
+    results.assign(tasks.size(), smxFitResult());
+    int nSkipped = 0;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        results[i].channel = tasks[i].first;
+        results[i].comparator = tasks[i].second;
+        results[i].label = curveLabel(tasks[i].first, tasks[i].second);
+        if (results[i].label != 0) nSkipped++;
+    }
+
+    // Pairs fitted together: one per comparator, or all comparators of a channel
+    const bool channelUnits = fitMode != smxFitMode::Independent || warmStart != smxWarmStart::Off;
+    std::vector<std::pair<size_t, size_t>> units;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        if (!channelUnits && results[i].label != 0) continue;
+        bool sameChannel = !units.empty() && tasks[units.back().first].first == tasks[i].first;
+        if (channelUnits && sameChannel) {
+            units.back().second++;
+        } else {
+            units.emplace_back(i, 1);
+        }
+    }
+    std::erase_if(units, [this](const std::pair<size_t, size_t>& unit) {
+        return std::all_of(results.begin() + unit.first, results.begin() + unit.first + unit.second,
+                           [](const smxFitResult& result) { return result.label != 0; });
+    });
+
+    // Units fitted in order: a chain of channels per worker for the channel warm start, each unit alone otherwise
+    std::vector<std::pair<size_t, size_t>> chains;
+    if (warmStart == smxWarmStart::Channel) {
+        size_t nChains = std::clamp<size_t>(nWorkers, 1, std::max<size_t>(units.size(), 1));
+        for (size_t c = 0; c < nChains; ++c) {
+            size_t begin = c * units.size() / nChains, end = (c + 1) * units.size() / nChains;
+            if (end > begin) chains.emplace_back(begin, end);
+        }
+    } else {
+        for (size_t u = 0; u < units.size(); ++u) chains.emplace_back(u, u + 1);
+    }
+
+    if (nWorkers <= 1 || chains.size() <= 1 || !fitForked(datasets, tasks, units, chains)) {
+        fitInProcess(datasets, tasks, units, chains);
+    }
+    if (resultCache) {
+        resultCache->storeFits(cacheKey, results);
+    }
+
+    wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int attempts = 0, failed = 0;
+    for (const smxFitResult& result : results) {
+        attempts += result.retries;
+        if (result.label == 0 && (result.status < 0 || result.status > 1)) failed++;
+    }
+    SMX_LOG_INFO("Fitted " << tasks.size() - nSkipped << " S-curves with " << nWorkers << " worker(s) in "
+                 << wallTime << " s: " << attempts << " fit attempts, " << failed << " failed, "
+                 << nSkipped << " not fittable.");
+    return results;
+}
+
+void smxFitEngine::fitInProcess(const std::vector<RooDataSet*>& datasets, const std::vector<std::pair<int, int>>& tasks,
+                                const std::vector<std::pair<size_t, size_t>>& units,
+                                const std::vector<std::pair<size_t, size_t>>& chains) {
+    for (const auto& chain : chains) {
+        fitChain(datasets, tasks, units, chain, results.data());
+    }
+}
+
+bool smxFitEngine::fitForked(const std::vector<RooDataSet*>& datasets, const std::vector<std::pair<int, int>>& tasks,
+                             const std::vector<std::pair<size_t, size_t>>& units,
+                             const std::vector<std::pair<size_t, size_t>>& chains) {
+    size_t blockSize = sizeof(SharedHeader) + tasks.size() * sizeof(smxFitResult);
+    void* memory = mmap(nullptr, blockSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        SMX_LOG_ERROR("Failed to allocate shared memory for the fit workers.");
+        return false;
+    }
+    auto* shared = new (memory) SharedHeader;
+    shared->nextTask.store(0);
+    shared->nDone.store(0);
+    auto* sharedResults = reinterpret_cast<smxFitResult*>(static_cast<char*>(memory) + sizeof(SharedHeader));
+    std::copy(results.begin(), results.end(), sharedResults); // tasks outside the units keep their label
+
+    // Do not let the children flush the parent's pending output a second time
+    smxLog::flush();
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+
+    int nChains = static_cast<int>(chains.size());
+    int nChildren = std::min(nWorkers, nChains);
+    std::vector<pid_t> children;
+    for (int w = 0; w < nChildren; ++w) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Worker: take tasks until none are left
+            for (int i = shared->nextTask.fetch_add(1); i < nChains; i = shared->nextTask.fetch_add(1)) {
+                fitChain(datasets, tasks, units, chains[i], sharedResults);
+                shared->nDone.fetch_add(1);
+            }
+            std::cout.flush();
+            std::fflush(nullptr);
+            _exit(0);
+        } else if (pid < 0) {
+            SMX_LOG_ERROR("fork() failed, continuing with " << children.size() << " worker(s).");
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    bool ok = !children.empty();
+    for (pid_t pid : children) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            SMX_LOG_ERROR("Fit worker " << pid << " terminated abnormally.");
+            ok = false;
+        }
+    }
+    ok = ok && shared->nDone.load() == nChains;
+
+    if (ok) {
+        std::copy(sharedResults, sharedResults + tasks.size(), results.begin());
+    }
+    shared->~SharedHeader();
+    munmap(memory, blockSize);
+    return ok;
+}
+
+std::vector<double> smxFitEngine::measureScaling(const std::vector<RooDataSet*>& datasets, int maxWorkers,
+                                                 smxFitBackend fitBackend) {
+    std::vector<double> wallTimes;
+    std::vector<smxFitResult> reference;
+
+    for (int workers = 1; workers <= maxWorkers; ++workers) {
+        smxFitEngine engine(workers);
+        engine.setBackend(fitBackend);
+        engine.fit(datasets);
+        wallTimes.push_back(engine.getWallTime());
+
+        bool identical = true;
+        if (workers == 1) {
+            reference = engine.getResults();
+        } else {
+            identical = reference.size() == engine.getResults().size() &&
+                        std::equal(reference.begin(), reference.end(), engine.getResults().begin(), sameFit);
+        }
+        SMX_LOG_INFO("Workers: " << std::setw(3) << workers
+                     << "  wall time: " << std::setw(10) << engine.getWallTime() << " s"
+                     << "  speedup: " << std::setw(6) << wallTimes.front() / engine.getWallTime()
+                     << "  results " << (identical ? "identical" : "DIFFER"));
+    }
+    return wallTimes;
+}
+
+double smxFitEngine::compareBackends(const std::vector<RooDataSet*>& datasets) {
+    smxFitEngine rooFitEngine(1);
+    rooFitEngine.setBackend(smxFitBackend::RooFit);
+    rooFitEngine.fit(datasets);
+
+    smxFitEngine nativeEngine(1);
+    nativeEngine.setBackend(smxFitBackend::Native);
+    nativeEngine.fit(datasets);
+
+    const std::vector<smxFitResult>& a = rooFitEngine.getResults();
+    const std::vector<smxFitResult>& b = nativeEngine.getResults();
+    double maxPull = 0;
+
+    SMX_LOG_INFO(" ch comp | threshold RooFit   native  | sigma RooFit   native | offset RooFit   native | pull");
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        if (a[i].status < 0 || a[i].status > 1 || b[i].status < 0 || b[i].status > 1) continue;
+        double error = std::max(a[i].thresholdErrHi, 1e-9);
+        double pull = std::fabs(a[i].threshold - b[i].threshold) / error;
+        maxPull = std::max(maxPull, pull);
+        SMX_LOG_INFO(std::setw(3) << a[i].channel << std::setw(5) << a[i].comparator << " | "
+                     << std::setw(10) << a[i].threshold << std::setw(10) << b[i].threshold << " | "
+                     << std::setw(8) << a[i].sigma << std::setw(8) << b[i].sigma << " | "
+                     << std::setw(8) << a[i].offset << std::setw(8) << b[i].offset << " | "
+                     << pull);
+    }
+    SMX_LOG_INFO("RooFit: " << rooFitEngine.getWallTime() << " s, native: " << nativeEngine.getWallTime()
+                 << " s, largest threshold difference: " << maxPull << " standard errors.");
+    return maxPull;
+}
+
+void smxFitEngine::compareSeeding(const std::vector<RooDataSet*>& datasets, smxFitBackend fitBackend) {
+    for (bool seeding : {false, true}) {
+        smxFitEngine engine(1);
+        engine.setBackend(fitBackend);
+        engine.setMomentSeeding(seeding);
+        engine.fit(datasets);
+
+        int attempts = 0, retried = 0;
+        for (const smxFitResult& result : engine.getResults()) {
+            attempts += result.retries;
+            if (result.retries > 1) retried++;
+        }
+        SMX_LOG_INFO((seeding ? "Moment seeding:  " : "Default seeds:   ")
+                     << engine.getResults().size() << " fits, " << attempts << " attempts, "
+                     << retried << " fits retried, " << engine.getWallTime() << " s");
+    }
+}
+
+void smxFitEngine::compareFitModes(const std::vector<RooDataSet*>& datasets, smxFitBackend fitBackend) {
+    const std::pair<smxFitMode, const char*> modes[] = {
+        {smxFitMode::Independent, "Independent:       "},
+        {smxFitMode::SharedSigma, "Shared sigma:      "},
+        {smxFitMode::LinearThresholds, "Linear thresholds: "}};
+    for (const auto& [mode, label] : modes) {
+        smxFitEngine engine(1);
+        engine.setBackend(fitBackend);
+        engine.setFitMode(mode);
+        engine.fit(datasets);
+
+        int failed = 0, good = 0;
+        double thresholdErr = 0;
+        for (const smxFitResult& result : engine.getResults()) {
+            if (result.status < 0 || result.status > 1) {
+                failed++;
+                continue;
+            }
+            good++;
+            thresholdErr += 0.5 * (result.thresholdErrHi - result.thresholdErrLo);
+        }
+        SMX_LOG_INFO(label << engine.getResults().size() << " fits, " << failed << " failed, mean threshold error "
+                     << (good > 0 ? thresholdErr / good : 0) << ", " << engine.getWallTime() << " s");
+    }
+}
+
+void smxFitEngine::compareFitWindow(const std::vector<RooDataSet*>& datasets, int marginPoints, smxFitBackend fitBackend) {
+    int totalPoints = 0, totalDropped = 0;
+    double totalFull = 0, totalWindow = 0, maxThresholdPull = 0, maxSigmaPull = 0;
+
+    SMX_LOG_INFO(" ch | points dropped | full ms  window ms  saved | max pull threshold  sigma");
+    for (size_t ch = 0; ch < datasets.size(); ++ch) {
+        if (!datasets[ch]) continue;
+        smxScurveFit full(datasets[ch], static_cast<int>(ch));
+        full.setBackend(fitBackend);
+        auto start = std::chrono::steady_clock::now();
+        full.fitScurvesSeq();
+        double fullTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        smxScurveFit window(datasets[ch], static_cast<int>(ch));
+        window.setBackend(fitBackend);
+        window.setFitWindow(marginPoints);
+        start = std::chrono::steady_clock::now();
+        window.fitScurvesSeq();
+        double windowTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Differences in units of the errors of the fit with all points
+        double thresholdPull = 0, sigmaPull = 0;
+        const std::vector<smxFitResult>& a = full.getResults();
+        const std::vector<smxFitResult>& b = window.getResults();
+        for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+            if (a[i].status < 0 || a[i].status > 1 || b[i].status < 0 || b[i].status > 1) continue;
+            thresholdPull = std::max(thresholdPull, std::fabs(a[i].threshold - b[i].threshold) / std::max(a[i].thresholdErrHi, 1e-9));
+            sigmaPull = std::max(sigmaPull, std::fabs(a[i].sigma - b[i].sigma) / std::max(a[i].sigmaErrHi, 1e-9));
+        }
+        int points = datasets[ch]->numEntries();
+        SMX_LOG_INFO(std::setw(3) << ch << " | " << std::setw(6) << points << std::setw(8) << window.getDroppedPoints()
+                     << " | " << std::setw(7) << 1e3 * fullTime << std::setw(10) << 1e3 * windowTime
+                     << std::setw(6) << static_cast<int>(fullTime > 0 ? 100 * (1 - windowTime / fullTime) : 0) << "%"
+                     << " | " << std::setw(18) << thresholdPull << std::setw(7) << sigmaPull);
+
+        totalPoints += points;
+        totalDropped += window.getDroppedPoints();
+        totalFull += fullTime;
+        totalWindow += windowTime;
+        maxThresholdPull = std::max(maxThresholdPull, thresholdPull);
+        maxSigmaPull = std::max(maxSigmaPull, sigmaPull);
+    }
+    SMX_LOG_INFO("Fit window of " << marginPoints << " plateau points: " << totalDropped << " of " << totalPoints
+                 << " points dropped, " << totalFull << " s -> " << totalWindow << " s, largest differences "
+                 << maxThresholdPull << " (threshold) and " << maxSigmaPull << " (sigma) standard errors.");
+}
+
+void smxFitEngine::compareWarmStart(const std::vector<RooDataSet*>& datasets, smxWarmStart policy,
+                                    const std::vector<smxFitResult>& previous, smxFitBackend fitBackend) {
+    smxFitEngine cold(1);
+    cold.setBackend(fitBackend);
+    cold.fit(datasets);
+
+    smxFitEngine warm(1);
+    warm.setBackend(fitBackend);
+    warm.setWarmStart(policy);
+    warm.setStartValues(previous);
+    warm.fit(datasets);
+
+    auto summarize = [](const smxFitEngine& engine, const char* label) {
+        int attempts = 0, iterations = 0, failed = 0;
+        for (const smxFitResult& result : engine.getResults()) {
+            attempts += result.retries;
+            iterations += result.iterations;
+            if (result.label == 0 && (result.status < 0 || result.status > 1)) failed++;
+        }
+        SMX_LOG_INFO(label << engine.getResults().size() << " fits, " << attempts << " attempts, " << iterations
+                     << " iterations, " << failed << " failed, " << engine.getWallTime() << " s");
+        return iterations;
+    };
+    int coldIterations = summarize(cold, "Seeds:      ");
+    int warmIterations = summarize(warm, "Warm start: ");
+
+    // Differences of the converged fits in units of the threshold error from the seeds
+    const std::vector<smxFitResult>& a = cold.getResults();
+    const std::vector<smxFitResult>& b = warm.getResults();
+    double maxPull = 0;
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        if (a[i].status < 0 || a[i].status > 1 || b[i].status < 0 || b[i].status > 1) continue;
+        maxPull = std::max(maxPull, std::fabs(a[i].threshold - b[i].threshold) / std::max(a[i].thresholdErrHi, 1e-9));
+    }
+    SMX_LOG_INFO("Warm start saved " << coldIterations - warmIterations << " minimizer iterations ("
+                 << (coldIterations > 0 ? 100. * (coldIterations - warmIterations) / coldIterations : 0.) << "%) and "
+                 << cold.getWallTime() - warm.getWallTime() << " s, largest threshold difference: "
+                 << maxPull << " standard errors.");
+}
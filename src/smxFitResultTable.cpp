@@ -0,0 +1,103 @@
+#include "smxFitResultTable.h"
+#include <algorithm>
+
+smxFitResultTable::smxFitResultTable(const std::vector<int>& compList, int channels) {
+    reset(compList, channels);
+}
+
+void smxFitResultTable::reset(const std::vector<int>& compList, int channels) {
+    comparators = compList;
+    nChannels = channels;
+    rows.assign(static_cast<size_t>(nChannels) * comparators.size(), smxFitResult());
+    for (int ch = 0; ch < nChannels; ++ch) {
+        for (size_t j = 0; j < comparators.size(); ++j) {
+            smxFitResult& row = rows[ch * comparators.size() + j];
+            row.channel = ch;
+            row.comparator = comparators[j];
+        }
+    }
+}
+
+long smxFitResultTable::rowIndex(int channel, int comparator) const {
+    if (channel < 0 || channel >= nChannels) return -1;
+    auto it = std::find(comparators.begin(), comparators.end(), comparator);
+    if (it == comparators.end()) return -1;
+    return static_cast<long>(channel * comparators.size() + (it - comparators.begin()));
+}
+
+bool smxFitResultTable::set(const smxFitResult& result) {
+    long index = rowIndex(result.channel, result.comparator);
+    if (index < 0) return false;
+    rows[index] = result;
+    return true;
+}
+
+int smxFitResultTable::set(const std::vector<smxFitResult>& results) {
+    int nMissing = 0;
+    for (const smxFitResult& result : results) {
+        if (!set(result)) nMissing++;
+    }
+    return nMissing;
+}
+
+bool smxFitResultTable::setLabel(int channel, int comparator, int label) {
+    long index = rowIndex(channel, comparator);
+    if (index < 0) return false;
+    rows[index].label = label;
+    return true;
+}
+
+bool smxFitResultTable::isFilled(const smxFitResult& row) {
+    return row.retries > 0 || row.label != 0;
+}
+
+const smxFitResult* smxFitResultTable::find(int channel, int comparator) const {
+    long index = rowIndex(channel, comparator);
+    return index < 0 ? nullptr : &rows[index];
+}
+
+const std::vector<smxFitResult>& smxFitResultTable::getRows() const {
+    return rows;
+}
+
+const std::vector<int>& smxFitResultTable::getComparators() const {
+    return comparators;
+}
+
+int smxFitResultTable::getNFilled() const {
+    return static_cast<int>(std::count_if(rows.begin(), rows.end(),
+                                          [](const smxFitResult& row) { return isFilled(row); }));
+}
+
+TTree* smxFitResultTable::toTree(const char* treeName) const {
+    TTree* tree = new TTree(treeName, "S-curve fit results per channel and comparator");
+
+    // Branch buffer, each filled row is copied into it before Fill()
+    smxFitResult row;
+    tree->Branch("channel", &row.channel, "channel/I");
+    tree->Branch("comparator", &row.comparator, "comparator/I");
+    tree->Branch("threshold", &row.threshold, "threshold/D");
+    tree->Branch("thresholdErrLo", &row.thresholdErrLo, "thresholdErrLo/D");
+    tree->Branch("thresholdErrHi", &row.thresholdErrHi, "thresholdErrHi/D");
+    tree->Branch("sigma", &row.sigma, "sigma/D");
+    tree->Branch("sigmaErrLo", &row.sigmaErrLo, "sigmaErrLo/D");
+    tree->Branch("sigmaErrHi", &row.sigmaErrHi, "sigmaErrHi/D");
+    tree->Branch("offset", &row.offset, "offset/D");
+    tree->Branch("offsetErrLo", &row.offsetErrLo, "offsetErrLo/D");
+    tree->Branch("offsetErrHi", &row.offsetErrHi, "offsetErrHi/D");
+    tree->Branch("chi2", &row.chi2, "chi2/D");
+    tree->Branch("status", &row.status, "status/I");
+    tree->Branch("retries", &row.retries, "retries/I");
+    tree->Branch("label", &row.label, "label/I");
+    tree->Branch("wallTime", &row.wallTime, "wallTime/D");
+
+    for (const smxFitResult& filled : rows) {
+        if (!isFilled(filled)) continue;
+        row = filled;
+        tree->Fill();
+    }
+
+    // Do not leave the tree pointing at the local buffer
+    tree->ResetBranchAddresses();
+    return tree;
+}
@@ -0,0 +1,88 @@
+#include "smxInstrument.h"
+#include "smxConstants.h"
+#include "smxLog.h"
+#include <cstdio>
+#include <fstream>
+
+std::mutex smxInstrumentation::mutex;
+std::map<std::string, std::unique_ptr<smxCounter>> smxInstrumentation::counters;
+std::map<std::string, std::unique_ptr<smxIndexedCounter>> smxInstrumentation::indexedCounters;
+std::map<std::string, std::unique_ptr<smxCounter>> smxInstrumentation::timers;
+
+namespace {
+
+template <typename T>
+T& lookup(std::map<std::string, std::unique_ptr<T>>& map, const std::string& name) {
+    std::unique_ptr<T>& entry = map[name];
+    if (!entry) entry = std::make_unique<T>();
+    return *entry;
+}
+
+} // namespace
+
+smxCounter& smxInstrumentation::counter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lookup(counters, name);
+}
+
+smxIndexedCounter& smxInstrumentation::indexedCounter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lookup(indexedCounters, name);
+}
+
+smxCounter& smxInstrumentation::timer(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lookup(timers, name);
+}
+
+void smxInstrumentation::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [name, entry] : counters) entry->reset();
+    for (auto& [name, entry] : indexedCounters) entry->reset();
+    for (auto& [name, entry] : timers) entry->reset();
+}
+
+bool smxInstrumentation::writeSummary(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ofstream out(filename, std::ios::trunc);
+    out << "{\n  \"version\": \"" << smxLibVersion << "\",\n  \"counters\": {";
+    const char* separator = "\n";
+    for (const auto& [name, entry] : counters) {
+        out << separator << "    \"" << name << "\": " << entry->getValue();
+        separator = ",\n";
+    }
+
+    // Indexed counters up to the last non-empty index, the overflow slot separately
+    out << "\n  },\n  \"indexed\": {";
+    separator = "\n";
+    for (const auto& [name, entry] : indexedCounters) {
+        int size = smxIndexedCounter::maxIndex;
+        while (size > 0 && entry->getValue(size - 1) == 0) --size;
+        out << separator << "    \"" << name << "\": {\"values\": [";
+        for (int i = 0; i < size; ++i) {
+            out << (i > 0 ? ", " : "") << entry->getValue(i);
+        }
+        out << "], \"overflow\": " << entry->getValue(smxIndexedCounter::maxIndex) << "}";
+        separator = ",\n";
+    }
+
+    out << "\n  },\n  \"timers\": {";
+    separator = "\n";
+    for (const auto& [name, entry] : timers) {
+        char line[256];
+        int64_t calls = entry->getValue();
+        std::snprintf(line, sizeof(line), "{\"calls\": %lld, \"total_ms\": %.3f, \"mean_ms\": %.6f, \"max_ms\": %.6f}",
+                      static_cast<long long>(calls), entry->getNanoseconds() * 1e-6,
+                      calls > 0 ? entry->getNanoseconds() * 1e-6 / calls : 0., entry->getMaxNanoseconds() * 1e-6);
+        out << separator << "    \"" << name << "\": " << line;
+        separator = ",\n";
+    }
+    out << "\n  }\n}\n";
+
+    if (!out) {
+        SMX_LOG_ERROR("Failed to write instrumentation summary: " << filename);
+        return false;
+    }
+    SMX_LOG_INFO("Instrumentation summary written to: " << filename);
+    return true;
+}
@@ -0,0 +1,100 @@
+#include "smxLog.h"
+#include <unistd.h>
+#include <iostream>
+
+std::atomic<int> smxLog::level{static_cast<int>(smxLogLevel::Info)};
+std::atomic<bool> smxLog::async{true};
+
+smxLog& smxLog::instance() {
+    static smxLog sink;
+    return sink;
+}
+
+smxLog::~smxLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    pendingAdded.notify_all();
+    if (writer.joinable() && ownerPid == ::getpid()) {
+        writer.join();
+    } else if (writer.joinable()) {
+        writer.detach(); // copy of the parent's thread handle in a forked process
+    }
+    output(pending);
+}
+
+void smxLog::setLevel(smxLogLevel minLevel) {
+    level.store(static_cast<int>(minLevel), std::memory_order_relaxed);
+}
+
+smxLogLevel smxLog::getLevel() {
+    return static_cast<smxLogLevel>(level.load(std::memory_order_relaxed));
+}
+
+void smxLog::setAsync(bool enable) {
+    if (!enable) flush();
+    async.store(enable);
+}
+
+void smxLog::output(const std::vector<std::pair<smxLogLevel, std::string>>& messages) {
+    for (const auto& [messageLevel, message] : messages) {
+        switch (messageLevel) {
+            case smxLogLevel::Error:
+                std::cout.flush();
+                std::cerr << "Error: " << message << '\n';
+                break;
+            case smxLogLevel::Warning:
+                std::cout.flush();
+                std::cerr << "Warning: " << message << '\n';
+                break;
+            default:
+                std::cout << message << '\n';
+                break;
+        }
+    }
+    std::cout.flush();
+    std::cerr.flush();
+}
+
+void smxLog::write(smxLogLevel messageLevel, std::string message) {
+    smxLog& sink = instance();
+    std::unique_lock<std::mutex> lock(sink.mutex);
+    pid_t pid = ::getpid();
+    if (!async.load() || sink.stopping || (sink.writer.joinable() && sink.ownerPid != pid)) {
+        // Synchronous output, also in forked processes without writer thread
+        output({{messageLevel, std::move(message)}});
+        return;
+    }
+    if (!sink.writer.joinable()) {
+        sink.ownerPid = pid;
+        sink.writer = std::thread(&smxLog::writeLoop, &sink);
+    }
+    sink.pendingWritten.wait(lock, [&sink] { return sink.pending.size() < maxPending; });
+    sink.pending.emplace_back(messageLevel, std::move(message));
+    if (sink.pending.size() == 1) sink.pendingAdded.notify_one();
+}
+
+void smxLog::flush() {
+    smxLog& sink = instance();
+    std::unique_lock<std::mutex> lock(sink.mutex);
+    if (!sink.writer.joinable() || sink.ownerPid != ::getpid()) return;
+    sink.pendingWritten.wait(lock, [&sink] { return sink.pending.empty() && !sink.writing; });
+}
+
+void smxLog::writeLoop() {
+    std::vector<std::pair<smxLogLevel, std::string>> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        pendingAdded.wait(lock, [this] { return !pending.empty() || stopping; });
+        if (pending.empty() && stopping) break;
+        batch.swap(pending);
+        writing = true;
+        lock.unlock();
+        output(batch);
+        batch.clear();
+        lock.lock();
+        writing = false;
+        pendingWritten.notify_all();
+    }
+}
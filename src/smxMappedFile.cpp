@@ -0,0 +1,80 @@
+#include "smxMappedFile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utility>
+
+smxMappedFile::smxMappedFile(const std::string& filename) {
+    open(filename);
+}
+
+smxMappedFile::~smxMappedFile() {
+    close();
+}
+
+smxMappedFile::smxMappedFile(smxMappedFile&& other) noexcept
+    : mapData(std::exchange(other.mapData, nullptr)),
+      mapSize(std::exchange(other.mapSize, 0)),
+      opened(std::exchange(other.opened, false)) {}
+
+smxMappedFile& smxMappedFile::operator=(smxMappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        mapData = std::exchange(other.mapData, nullptr);
+        mapSize = std::exchange(other.mapSize, 0);
+        opened = std::exchange(other.opened, false);
+    }
+    return *this;
+}
+
+bool smxMappedFile::open(const std::string& filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // mmap rejects zero-length mappings, an empty file is simply empty
+    if (st.st_size > 0) {
+        void* addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        mapData = static_cast<const char*>(addr);
+        mapSize = static_cast<std::size_t>(st.st_size);
+    }
+
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    opened = true;
+    return true;
+}
+
+void smxMappedFile::close() {
+    if (mapData) {
+        ::munmap(const_cast<char*>(mapData), mapSize);
+    }
+    mapData = nullptr;
+    mapSize = 0;
+    opened = false;
+}
+
+bool smxMappedFile::isOpen() const {
+    return opened;
+}
+
+const char* smxMappedFile::data() const {
+    return mapData;
+}
+
+std::size_t smxMappedFile::size() const {
+    return mapSize;
+}
@@ -0,0 +1,219 @@
+#include "smxPipeline.h"
+#include "smxConstants.h"
+#include "smxCurveClassifier.h"
+#include "smxErfcFitter.h"
+#include "smxLog.h"
+#include <TROOT.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+smxPipeline::smxPipeline(int fitWorkers, size_t memoryBudgetMB) {
+    setFitWorkers(fitWorkers);
+    setMemoryBudget(memoryBudgetMB);
+}
+
+void smxPipeline::setFitWorkers(int fitWorkers) {
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    nFitWorkers = fitWorkers > 0 ? fitWorkers : std::max(1u, hardwareThreads);
+}
+
+void smxPipeline::setMemoryBudget(size_t memoryBudgetMB) {
+    memoryBudget = memoryBudgetMB * 1024 * 1024;
+}
+
+void smxPipeline::setParseMode(smxParseMode mode) {
+    parseMode = mode;
+}
+
+void smxPipeline::setMomentSeeding(bool enable) {
+    momentSeeding = enable;
+}
+
+void smxPipeline::setClassify(bool enable) {
+    classify = enable;
+}
+
+void smxPipeline::setOutputOptions(const smxRootOutputOptions& options) {
+    outputOptions = options;
+    outputOptions.fileName.clear();
+}
+
+double smxPipeline::getWallTime() const {
+    return wallTime;
+}
+
+size_t smxPipeline::estimateMemory(const std::string& filename) {
+    // The in-memory pscanTree holds about 136 bytes per ~55 byte ASCII data line;
+    // a binary scan maps its ~12 bytes per line and builds the tree when written.
+    // The count cube and the results are small in comparison.
+    std::error_code ec;
+    size_t fileSize = std::filesystem::file_size(filename, ec);
+    if (ec) fileSize = 0;
+    size_t cubeSize = static_cast<size_t>(smxNCh) * smxNAdc * (smxNApmCalU + 2) * sizeof(uint16_t);
+    if (smxPscanFile::isPscanFile(filename)) {
+        return fileSize + fileSize / 12 * 136 + cubeSize;
+    }
+    return 3 * fileSize + cubeSize;
+}
+
+void smxPipeline::acquireMemory(size_t bytes) {
+    std::unique_lock<std::mutex> lock(budgetMutex);
+    budgetFreed.wait(lock, [&] { return memoryInFlight == 0 || memoryInFlight + bytes <= memoryBudget; });
+    memoryInFlight += bytes;
+    peakMemory = std::max(peakMemory, memoryInFlight);
+}
+
+void smxPipeline::releaseMemory(size_t bytes) {
+    std::lock_guard<std::mutex> lock(budgetMutex);
+    memoryInFlight -= std::min(bytes, memoryInFlight);
+    budgetFreed.notify_all();
+}
+
+void smxPipeline::readStage(const std::vector<std::string>& files, smxBoundedQueue<ChannelTask>& fitQueue) {
+    for (const std::string& filename : files) {
+        size_t memoryCost = estimateMemory(filename);
+        acquireMemory(memoryCost);
+
+        auto start = std::chrono::steady_clock::now();
+        smxPscan* pscan = new smxPscan();
+        pscan->setParseMode(parseMode);
+        pscan->setOutputOptions(outputOptions);
+        pscan->readFile(filename);
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            parseTime += secondsSince(start);
+        }
+        if (pscan->getNVp() == 0) {
+            SMX_LOG_ERROR("No data read from " << filename << ", skipping it.");
+            delete pscan;
+            releaseMemory(memoryCost);
+            continue;
+        }
+
+        // All channels are final now, hand them to the fit workers
+        ScanJob* job = new ScanJob;
+        job->pscan = pscan;
+        job->memoryCost = memoryCost;
+        job->results.resize(smxNCh * pscan->getReadDiscList().size());
+        job->pendingChannels.store(smxNCh);
+        for (int ch = 0; ch < smxNCh; ++ch) {
+            fitQueue.push(ChannelTask{job, ch});
+        }
+    }
+}
+
+void smxPipeline::fitChannel(const smxPscan& pscan, int channel, bool momentSeeding, bool classify,
+                             smxFitResult* results) {
+    const std::vector<int>& discList = pscan.getReadDiscList();
+    std::vector<double> x, y, yErrLo, yErrHi;
+    smxCurveClassifier classifier(pscan.getNPulses());
+
+    for (size_t j = 0; j < discList.size(); ++j) {
+        smxCurveLabel label = classify ? classifier.classify(pscan.getComparatorCounts(channel, static_cast<int>(j)))
+                                       : smxCurveLabel::Fittable;
+        if (label != smxCurveLabel::Fittable) {
+            results[j].channel = channel;
+            results[j].comparator = discList[j];
+            results[j].label = static_cast<int>(label);
+            continue;
+        }
+        if (pscan.getComparatorPoints(channel, static_cast<int>(j), x, y, yErrLo, yErrHi) == 0) continue;
+        auto start = std::chrono::steady_clock::now();
+
+        smxFitResult& result = results[j];
+        result.channel = channel;
+        result.comparator = discList[j];
+
+        smxErfcFitter fitter; // fresh start values and limits for every comparator
+        fitter.setData(x.data(), y.data(), yErrLo.data(), yErrHi.data(), x.size());
+        if (momentSeeding) fitter.seedFromMoments();
+        fitter.fit(result);
+        result.wallTime = secondsSince(start);
+    }
+}
+
+void smxPipeline::fitStage(smxBoundedQueue<ChannelTask>& fitQueue, smxBoundedQueue<ScanJob*>& writeQueue) {
+    ChannelTask task;
+    while (fitQueue.pop(task)) {
+        auto start = std::chrono::steady_clock::now();
+        size_t nDisc = task.job->pscan->getReadDiscList().size();
+        fitChannel(*task.job->pscan, task.channel, momentSeeding, classify,
+                   task.job->results.data() + task.channel * nDisc);
+        double seconds = secondsSince(start);
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            fitTime += seconds;
+            task.job->fitTime += seconds;
+        }
+        // The worker finishing the last channel passes the scan on
+        if (task.job->pendingChannels.fetch_sub(1) == 1) {
+            writeQueue.push(task.job);
+        }
+    }
+}
+
+void smxPipeline::writeStage(smxBoundedQueue<ScanJob*>& writeQueue) {
+    ScanJob* job = nullptr;
+    while (writeQueue.pop(job)) {
+        auto start = std::chrono::steady_clock::now();
+        int nFits = job->pscan->getFitResults().set(job->results);
+        job->pscan->writeRootFile();
+        SMX_LOG_INFO("Stored " << nFits << " S-curve fits of " << job->pscan->getAsciiFileName()
+                     << " (" << job->fitTime << " s of fitting).");
+        delete job->pscan;
+        releaseMemory(job->memoryCost);
+        delete job;
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            writeTime += secondsSince(start);
+            nWritten++;
+        }
+    }
+}
+
+int smxPipeline::run(const std::vector<std::string>& files) {
+    ROOT::EnableThreadSafety();
+    auto start = std::chrono::steady_clock::now();
+    parseTime = fitTime = writeTime = 0;
+    nWritten = 0;
+    peakMemory = 0;
+
+    // One scan worth of channels ahead of the fitters, two fitted scans ahead of the writer
+    smxBoundedQueue<ChannelTask> fitQueue(smxNCh);
+    smxBoundedQueue<ScanJob*> writeQueue(2);
+
+    std::thread reader(&smxPipeline::readStage, this, std::cref(files), std::ref(fitQueue));
+    std::vector<std::thread> fitters;
+    for (int w = 0; w < nFitWorkers; ++w) {
+        fitters.emplace_back(&smxPipeline::fitStage, this, std::ref(fitQueue), std::ref(writeQueue));
+    }
+    std::thread writer(&smxPipeline::writeStage, this, std::ref(writeQueue));
+
+    // Shut the stages down in order, each one after its producers are done
+    reader.join();
+    fitQueue.close();
+    for (std::thread& fitter : fitters) {
+        fitter.join();
+    }
+    writeQueue.close();
+    writer.join();
+
+    wallTime = secondsSince(start);
+    double serialTime = parseTime + fitTime + writeTime;
+    SMX_LOG_INFO("Pipeline: " << nWritten << " of " << files.size() << " scan(s) written in " << wallTime << " s"
+                 << " with " << nFitWorkers << " fit worker(s); busy time parse " << parseTime << " s, fit "
+                 << fitTime << " s, write " << writeTime << " s (" << (wallTime > 0 ? serialTime / wallTime : 0.)
+                 << "x overlap); peak memory estimate " << peakMemory / 1048576. << " of "
+                 << memoryBudget / 1048576. << " MB.");
+    return nWritten;
+}
@@ -1,5 +1,8 @@
 #include "smxPscan.h"
 #include <TFile.h>
+#include <TBranch.h>
+#include <TDirectory.h>
+#include <Compression.h>
 #include <TCanvas.h>
 #include <TAxis.h>
 #include <TNamed.h>
@@ -10,17 +13,57 @@
 #include <RooArgSet.h>
 #include <RooPlot.h>
 #include <RooCategory.h>
-#include <iostream>
 #include <sstream>
 #include <regex>
 #include <filesystem> // For handling file paths
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <limits>
+#include <numeric>
+#include "smxMappedFile.h"
+#include "smxAsciiScanner.h"
+#include "smxResultCache.h"
+#include "smxCurveClassifier.h"
+#include "smxCountErrors.h"
+#include "smxInstrument.h"
+#include "smxLog.h"
+
+namespace {
+
+// Name of the branch of one ADC discriminator in the split layout
+std::string adcBranchName(int disc) {
+    char name[16];
+    std::snprintf(name, sizeof(name), "ADC_%02d", disc);
+    return name;
+}
+
+// Pulse amplitude range VP_<min>_<max>_<step> of a scan file name
+bool parseVpRange(const std::string& name, int& vpMin, int& vpMax, int& vpStep) {
+    std::regex vp_regex(R"(_VP_(\d+)_(\d+)_(\d+)_)");
+    std::smatch match;
+    if (!std::regex_search(name, match, vp_regex)) return false;
+    vpMin = std::stoi(match[1]);
+    vpMax = std::stoi(match[2]);
+    vpStep = std::max(1, std::stoi(match[3]));
+    return true;
+}
+
+} // namespace
 
 // Constructor to initialize the TTree
 smxPscan::smxPscan() : pscanTree(new TTree("pscanTree", "Tree for pulse scan data")) {}
 
 // Destructor to manage memory and close the file if necessary
 smxPscan::~smxPscan() {
+    clearDataSetCache();
     delete pscanTree;
+    if (outputFile) {
+        outputFile->Close();
+        delete outputFile;
+    }
 }
 
 void smxPscan::parseHeaderLine(const std::string& line) {
@@ -37,12 +80,19 @@ void smxPscan::parseHeaderLine(const std::string& line) {
         }
     }
 
+    std::regex pol_regex(R"(\bPOL:\s*(\d+))");
+    if (std::regex_search(line, match, pol_regex)) {
+        asicSettings.setPol(std::stoi(match[1]));
+    }
+
     // Debugging output to confirm positions
-    std::cout << "Parsed DISC_LIST positions: ";
-    for (const auto& pos : readDiscList) {
-        std::cout << pos << " ";
+    if (SMX_LOG_ENABLED(Debug)) {
+        std::ostringstream positions;
+        for (const auto& pos : readDiscList) {
+            positions << pos << " ";
+        }
+        SMX_LOG_DEBUG("Parsed DISC_LIST positions: " << positions.str());
     }
-    std::cout << std::endl;
 }
 
 // Helper function to parse the asciiFileName
@@ -82,12 +132,16 @@ void smxPscan::parseAsciiFileName() {
         }
     }
 
+    // Pulse amplitude range VP_<min>_<max>_<step>, used to preallocate the count cube
+    parseVpRange(asciiFileName, vpMin, vpMax, vpStep);
+
     // Debugging output to print parsed fields
-    std::cout << "readTime: " << readTime << " (" << formatReadTime() << ")" << std::endl;
-    std::cout << "asicId: " << asicId << std::endl;
-    std::cout << "nPulses: " << nPulses << std::endl;
-    std::cout << "Vref_p: " << asicSettings.getVref_p() << ", Vref_n: " << asicSettings.getVref_n()
-              << ", Vref_t: " << asicSettings.getVref_t() << ", Thr2_glb: " << asicSettings.getThr2_glb() << std::endl;
+    SMX_LOG_DEBUG("readTime: " << readTime << " (" << formatReadTime() << ")");
+    SMX_LOG_DEBUG("asicId: " << asicId);
+    SMX_LOG_DEBUG("nPulses: " << nPulses);
+    SMX_LOG_DEBUG("Vref_p: " << asicSettings.getVref_p() << ", Vref_n: " << asicSettings.getVref_n()
+                  << ", Vref_t: " << asicSettings.getVref_t() << ", Thr2_glb: " << asicSettings.getThr2_glb());
+    SMX_LOG_DEBUG("VP range: " << vpMin << " to " << vpMax << " step " << vpStep);
 }
 
 // Helper function to convert readTime to a human-readable string
@@ -104,14 +158,14 @@ std::string smxPscan::formatReadTime() const {
 
 // Method to log errors for consistency
 void smxPscan::logError(const std::string& message) const {
-    std::cerr << "Error: " << message << std::endl;
+    SMX_LOG_ERROR(message);
 }
 
 // Helper function to generate default output file name based on ASCII file name
 std::string smxPscan::generateDefaultOutputFileName() const {
     std::filesystem::path filePath(asciiFileName);
     std::string baseName = filePath.stem().string();
-    return asciiFileAddress + "/" + baseName + "_output.root";
+    return asciiFileAddress + "/" + baseName + outputSuffix + ".root";
 }
 
 // Method to read an ASCII file and fill the TTree
@@ -120,88 +174,657 @@ TTree* smxPscan::readAsciiFile(const std::string& filename) {
     std::filesystem::path filePath(filename);
     asciiFileName = filePath.filename().string();
     asciiFileAddress = filePath.parent_path().string();
-    std::cout << "Processing file: " << asciiFileName << " at path: " << asciiFileAddress << std::endl;
+    outputSuffix = "_output";
+    channelSubset = false;
+    SMX_LOG_INFO("Processing file: " << asciiFileName << " at path: " << asciiFileAddress);
+
+    // An unchanged file is served from its cached binary conversion
+    uint64_t cacheKey = resultCache ? smxResultCache::scanKey(filename) : 0;
+    if (cacheKey != 0) {
+        std::string cachedFile = resultCache->lookupScan(cacheKey);
+        if (!cachedFile.empty()) {
+            readBinaryFile(cachedFile);
+            if (getNVp() > 0) {
+                asciiFileName = filePath.filename().string();
+                asciiFileAddress = filePath.parent_path().string();
+                SMX_LOG_INFO("Loaded " << asciiFileName << " from the result cache.");
+                return pscanTree;
+            }
+        }
+    }
 
     parseAsciiFileName();
+    clearDataSetCache();
+    binaryFile.reset();
+    if (outputOptions.directToFile && outputOptions.format == smxOutputFormat::TTree) {
+        attachTreeToOutput();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Long64_t lineCount = (parseMode == smxParseMode::Regex) ? readAsciiFileRegex(filename)
+                                                            : readAsciiFileFast(filename);
+    if (lineCount < 0) {
+        return pscanTree;
+    }
+    fitResults.reset(readDiscList);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Report parser throughput
+    std::error_code ec;
+    double megaBytes = std::filesystem::file_size(filePath, ec) / 1e6;
+    SMX_LOG_INFO("Parsed " << lineCount << " lines (" << megaBytes << " MB) in " << seconds * 1e3 << " ms ("
+                 << (seconds > 0 ? megaBytes / seconds : 0.) << " MB/s, "
+                 << (parseMode == smxParseMode::Regex ? "regex" : "fast") << " parser)");
+    SMX_LOG_INFO("Count cube: " << smxNCh << " channels x " << readDiscList.size() << " discriminators x "
+                 << nVp << " pulses (" << countCube.size() * sizeof(uint16_t) / 1024. << " kB)");
+
+    if (cacheKey != 0 && lineCount > 0) {
+        resultCache->storeScan(cacheKey, *this);
+    }
+    return pscanTree;
+}
+
+TTree* smxPscan::readBinaryFile(const std::string& filename) {
+    SMX_TIMER("readBinaryFile");
+    std::filesystem::path filePath(filename);
+    SMX_LOG_INFO("Processing file: " << filePath.filename().string() << " at path: " << filePath.parent_path().string());
+
+    auto start = std::chrono::steady_clock::now();
+    auto file = std::make_shared<smxPscanFile>();
+    if (!file->open(filename)) {
+        logError("Failed to open file: " + filename);
+        return pscanTree;
+    }
+    const smxPscanFileHeader& header = file->getHeader();
+    if (header.nChannels != smxNCh) {
+        logError(Form("Binary scan holds %d channels, expected %d.", header.nChannels, smxNCh));
+        return pscanTree;
+    }
+
+    // Take over the scan description, the counts stay in the mapping
+    clearDataSetCache();
+    countCube.clear();
+    countCube.shrink_to_fit();
+    binaryFile = file;
+    asciiFileName = std::string(header.sourceName, strnlen(header.sourceName, sizeof(header.sourceName)));
+    if (asciiFileName.empty()) asciiFileName = filePath.filename().string();
+    asciiFileAddress = filePath.parent_path().string();
+    outputSuffix = "_output";
+    channelSubset = false;
+    readTime = static_cast<std::time_t>(header.readTime);
+    asicId = TString(header.asicId, strnlen(header.asicId, sizeof(header.asicId)));
+    nPulses = header.nPulses;
+    asicSettings = smxAsicSettings(header.pol, header.vrefP, header.vrefN, header.thr2Glb, header.vrefT, header.vrefTRange);
+    readDiscList.assign(header.discList, header.discList + header.nDisc);
+    vpMin = header.vpMin;
+    vpMax = header.vpMax;
+    vpStep = header.vpStep;
+    nVp = header.nVp;
+    vpStride = header.nVp;
+    pscanTree->Reset();
+    fitResults.reset(readDiscList);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SMX_LOG_INFO("Mapped " << header.cubeCount << " counts (" << header.cubeCount * sizeof(uint16_t) / 1024.
+                 << " kB) of " << asicId << " in " << seconds * 1e3 << " ms");
+    SMX_LOG_INFO("Count cube: " << smxNCh << " channels x " << readDiscList.size() << " discriminators x "
+                 << nVp << " pulses");
+    return pscanTree;
+}
+
+TTree* smxPscan::readRootFile(const std::string& filename, const std::vector<int>& channels) {
+    SMX_TIMER("readRootFile");
+    std::filesystem::path filePath(filename);
+    SMX_LOG_INFO("Processing file: " << filePath.filename().string() << " at path: " << filePath.parent_path().string());
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<TFile> file(TFile::Open(filename.c_str(), "READ"));
+    if (!file || file->IsZombie()) {
+        logError("Failed to open file: " + filename);
+        return pscanTree;
+    }
+    TTree* settingsTree = file->Get<TTree>("pscanSettingsTree");
+    TTree* dataTree = file->Get<TTree>("pscanTree");
+    if (!settingsTree || !dataTree || settingsTree->GetEntries() == 0) {
+        logError("No pulse scan trees in " + filename);
+        return pscanTree;
+    }
+
+    // Scan description, ROOT allocates the objects of the TString and vector branches
+    Long64_t readTimeLong = 0;
+    TString* asicIdRead = nullptr;
+    std::vector<int>* discListRead = nullptr;
+    settingsTree->SetBranchAddress("readTime", &readTimeLong);
+    settingsTree->SetBranchAddress("nPulses", &nPulses);
+    settingsTree->SetBranchAddress("asicId", &asicIdRead);
+    settingsTree->SetBranchAddress("readDiscList", &discListRead);
+    // Not written by older versions, the range is recovered from the source name or the pulses then
+    bool hasVpRange = settingsTree->GetBranch("vpMin") && settingsTree->GetBranch("vpMax") &&
+                      settingsTree->GetBranch("vpStep");
+    if (hasVpRange) {
+        settingsTree->SetBranchAddress("vpMin", &vpMin);
+        settingsTree->SetBranchAddress("vpMax", &vpMax);
+        settingsTree->SetBranchAddress("vpStep", &vpStep);
+    }
+    settingsTree->GetEntry(0);
+    settingsTree->ResetBranchAddresses();
+    readTime = static_cast<std::time_t>(readTimeLong);
+    asicId = asicIdRead ? *asicIdRead : TString();
+    readDiscList = discListRead ? *discListRead : std::vector<int>();
+    vpStep = std::max(1, vpStep);
+    delete asicIdRead;
+    delete discListRead;
+
+    if (TTree* asicTree = file->Get<TTree>("asicSettingsTree"); asicTree && asicTree->GetEntries() > 0) {
+        int pol = 0, vrefP = 0, vrefN = 0, thr2Glb = 0, vrefT = 0, vrefTRange = 0;
+        asicTree->SetBranchAddress("Pol", &pol);
+        asicTree->SetBranchAddress("Vref_p", &vrefP);
+        asicTree->SetBranchAddress("Vref_n", &vrefN);
+        asicTree->SetBranchAddress("Thr2_glb", &thr2Glb);
+        asicTree->SetBranchAddress("Vref_t", &vrefT);
+        asicTree->SetBranchAddress("Vref_t_range", &vrefTRange);
+        asicTree->GetEntry(0);
+        asicTree->ResetBranchAddresses();
+        asicSettings = smxAsicSettings(pol, vrefP, vrefN, thr2Glb, vrefT, vrefTRange);
+    }
+
+    // Name of the source scan; the default output is <source>_refit.root, never the input itself
+    std::string stem = filePath.stem().string();
+    const std::string suffix = "_output";
+    if (stem.size() > suffix.size() && stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        stem.resize(stem.size() - suffix.size());
+    }
+    asciiFileName = stem + ".txt";
+    asciiFileAddress = filePath.parent_path().string();
+    outputSuffix = "_refit";
+    clearDataSetCache();
+    binaryFile.reset();
+    pscanTree->Reset();
+
+    std::vector<bool> wanted(smxNCh, channels.empty());
+    for (int ch : channels) {
+        if (ch >= 0 && ch < smxNCh) {
+            wanted[ch] = true;
+        } else {
+            SMX_LOG_WARNING("Channel " << ch << " does not exist, skipped.");
+        }
+    }
+    channelSubset = std::count(wanted.begin(), wanted.end(), true) < smxNCh;
+
+    // Only the enabled branches are read, and the counts only for the entries of the wanted channels
+    int pulse = 0, channel = 0;
+    int adc[smxNAdc] = {0};
+    TBranch* pulseBranch = nullptr;
+    TBranch* channelBranch = nullptr;
+    std::vector<TBranch*> adcBranches;
+    dataTree->SetBranchStatus("*", false);
+    dataTree->SetBranchStatus("pulse", true);
+    dataTree->SetBranchStatus("channel", true);
+    dataTree->SetBranchAddress("pulse", &pulse, &pulseBranch);
+    dataTree->SetBranchAddress("channel", &channel, &channelBranch);
+    if (dataTree->GetBranch("ADC")) {
+        TBranch* branch = nullptr;
+        dataTree->SetBranchStatus("ADC", true);
+        dataTree->SetBranchAddress("ADC", adc, &branch);
+        adcBranches.push_back(branch);
+    } else {
+        for (int disc : readDiscList) {
+            std::string name = adcBranchName(disc);
+            if (disc >= smxNAdc || !dataTree->GetBranch(name.c_str())) continue;
+            TBranch* branch = nullptr;
+            dataTree->SetBranchStatus(name.c_str(), true);
+            dataTree->SetBranchAddress(name.c_str(), &adc[disc], &branch);
+            adcBranches.push_back(branch);
+        }
+    }
+    if (!pulseBranch || !channelBranch || adcBranches.empty()) {
+        logError("Incomplete data branches in " + filename);
+        dataTree->ResetBranchAddresses();
+        return pscanTree;
+    }
+
+    Long64_t nEntries = dataTree->GetEntries();
+    if (!hasVpRange && !parseVpRange(asciiFileName, vpMin, vpMax, vpStep)) {
+        // Smallest and largest pulse amplitude, the step is the common divisor of the distances
+        vpMin = 0;
+        vpMax = smxNApmCalU + 1;
+        vpStep = 1;
+        int first = std::numeric_limits<int>::max(), last = std::numeric_limits<int>::min();
+        for (Long64_t entry = 0; entry < nEntries; ++entry) {
+            pulseBranch->GetEntry(entry);
+            first = std::min(first, pulse);
+            last = std::max(last, pulse);
+        }
+        if (first <= last) {
+            int step = 0;
+            for (Long64_t entry = 0; entry < nEntries; ++entry) {
+                pulseBranch->GetEntry(entry);
+                step = std::gcd(step, pulse - first);
+            }
+            vpMin = first;
+            vpMax = last;
+            vpStep = std::max(1, step);
+        }
+    }
+    SMX_LOG_DEBUG("VP range: " << vpMin << " to " << vpMax << " step " << vpStep
+                  << (hasVpRange ? "" : " (not stored in the file)"));
+
+    // Counts of discriminators beyond the ADC array are not part of the tree and stay zero
+    allocateCountCube();
+    size_t nDisc = readDiscList.size();
+    std::vector<int> values(nDisc);
+    Long64_t nRead = 0;
+    for (Long64_t entry = 0; entry < nEntries; ++entry) {
+        channelBranch->GetEntry(entry);
+        if (channel < 0 || channel >= smxNCh || !wanted[channel]) continue;
+        pulseBranch->GetEntry(entry);
+        for (TBranch* branch : adcBranches) {
+            branch->GetEntry(entry);
+        }
+        for (size_t j = 0; j < nDisc; ++j) {
+            values[j] = readDiscList[j] < smxNAdc ? adc[readDiscList[j]] : 0;
+        }
+        fillCountCube(pulse, channel, values.data(), static_cast<int>(nDisc));
+        ++nRead;
+    }
+    finalizeCountCube();
+    dataTree->ResetBranchAddresses();
+
+    fitResults.reset(readDiscList);
+    if (TTree* fitTree = file->Get<TTree>("fitResultsTree")) {
+        smxFitResult row;
+        fitTree->SetBranchAddress("channel", &row.channel);
+        fitTree->SetBranchAddress("comparator", &row.comparator);
+        fitTree->SetBranchAddress("threshold", &row.threshold);
+        fitTree->SetBranchAddress("thresholdErrLo", &row.thresholdErrLo);
+        fitTree->SetBranchAddress("thresholdErrHi", &row.thresholdErrHi);
+        fitTree->SetBranchAddress("sigma", &row.sigma);
+        fitTree->SetBranchAddress("sigmaErrLo", &row.sigmaErrLo);
+        fitTree->SetBranchAddress("sigmaErrHi", &row.sigmaErrHi);
+        fitTree->SetBranchAddress("offset", &row.offset);
+        fitTree->SetBranchAddress("offsetErrLo", &row.offsetErrLo);
+        fitTree->SetBranchAddress("offsetErrHi", &row.offsetErrHi);
+        fitTree->SetBranchAddress("chi2", &row.chi2);
+        fitTree->SetBranchAddress("status", &row.status);
+        fitTree->SetBranchAddress("retries", &row.retries);
+        if (fitTree->GetBranch("label")) fitTree->SetBranchAddress("label", &row.label); // not in older files
+        fitTree->SetBranchAddress("wallTime", &row.wallTime);
+        for (Long64_t entry = 0; entry < fitTree->GetEntries(); ++entry) {
+            fitTree->GetEntry(entry);
+            if (row.channel >= 0 && row.channel < smxNCh && wanted[row.channel]) fitResults.set(row);
+        }
+        fitTree->ResetBranchAddresses();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SMX_LOG_INFO("Read " << nRead << " of " << nEntries << " entries ("
+                 << (channels.empty() ? smxNCh : static_cast<int>(std::count(wanted.begin(), wanted.end(), true)))
+                 << " channels) and " << fitResults.getNFilled() << " fit results of " << asicId << " in "
+                 << seconds * 1e3 << " ms");
+    SMX_LOG_INFO("Count cube: " << smxNCh << " channels x " << readDiscList.size() << " discriminators x "
+                 << nVp << " pulses");
+    return pscanTree;
+}
+
+TTree* smxPscan::readFile(const std::string& filename) {
+    if (smxPscanFile::isPscanFile(filename)) return readBinaryFile(filename);
+    if (std::filesystem::path(filename).extension() == ".root") {
+        return isRNTupleFile(filename) ? readRNTupleFile(filename) : readRootFile(filename);
+    }
+    return readAsciiFile(filename);
+}
+
+smxPscanFileHeader smxPscan::makeFileHeader() const {
+    smxPscanFileHeader header = smxPscanFile::makeHeader();
+    header.nPulses = nPulses;
+    header.readTime = static_cast<int64_t>(readTime);
+    std::strncpy(header.asicId, asicId.Data(), sizeof(header.asicId) - 1);
+    std::strncpy(header.sourceName, asciiFileName.c_str(), sizeof(header.sourceName) - 1);
+    header.pol = asicSettings.getPol();
+    header.vrefP = asicSettings.getVref_p();
+    header.vrefN = asicSettings.getVref_n();
+    header.thr2Glb = asicSettings.getThr2_glb();
+    header.vrefT = asicSettings.getVref_t();
+    header.vrefTRange = asicSettings.getVref_t_range();
+    header.vpMin = vpMin;
+    header.vpMax = vpMax;
+    header.vpStep = vpStep;
+    header.nVp = nVp;
+    header.nChannels = smxNCh;
+    header.nDisc = static_cast<int32_t>(std::min(readDiscList.size(), static_cast<size_t>(smxPscanFileMaxDisc)));
+    std::copy_n(readDiscList.begin(), header.nDisc, header.discList);
+    return header;
+}
 
+bool smxPscan::writeBinaryFile(const std::string& outputFileName) const {
+    if (cubeCounts().empty()) {
+        logError("No counts to write, read a scan first.");
+        return false;
+    }
+    if (readDiscList.size() > static_cast<size_t>(smxPscanFileMaxDisc)) {
+        logError(Form("DISC_LIST has more than %d entries.", smxPscanFileMaxDisc));
+        return false;
+    }
+    std::string outputFile = outputFileName;
+    if (outputFile.empty()) {
+        outputFile = asciiFileAddress + "/" + std::filesystem::path(asciiFileName).stem().string() + ".pscan";
+    }
+    if (!smxPscanFile::write(outputFile, makeFileHeader(), cubeCounts())) {
+        logError("Failed to write binary file: " + outputFile);
+        return false;
+    }
+    SMX_LOG_INFO("File written successfully to: " << outputFile);
+    return true;
+}
+
+bool smxPscan::writeAsciiFile(const std::string& outputFileName) const {
+    if (cubeCounts().empty()) {
+        logError("No counts to write, read a scan first.");
+        return false;
+    }
+    if (!smxPscanFile::writeAscii(outputFileName, makeFileHeader(), cubeCounts())) {
+        logError("Failed to write ASCII file: " + outputFileName);
+        return false;
+    }
+    SMX_LOG_INFO("File written successfully to: " << outputFileName);
+    return true;
+}
+
+TTree* smxPscan::fillTreeFromCube() {
+    std::span<const uint16_t> counts = cubeCounts();
+    if (counts.empty()) {
+        logError("No counts to fill pscanTree from.");
+        return pscanTree;
+    }
+
+    int pulse, channel;
+    int adc[smxNAdc] = {0};
+    int tcomp = 0;
+    if (pscanTree->GetBranch("pulse")) {
+        setDataBranchAddresses(pulse, channel, adc, tcomp);
+    } else {
+        setupDataBranches(pulse, channel, adc, tcomp);
+    }
+    pscanTree->Reset();
+
+    // Same entry order as the ASCII file: pulse amplitude, then channel
+    size_t nDisc = readDiscList.size();
+    std::vector<int> values(nDisc);
+    for (int v = 0; v < nVp; ++v) {
+        for (int ch = 0; ch < smxNCh; ++ch) {
+            for (size_t j = 0; j < nDisc; ++j) {
+                values[j] = counts[(ch * nDisc + j) * vpStride + v];
+            }
+            pulse = getPulseAmplitude(v);
+            channel = ch;
+            fillDataEntry(values.data(), static_cast<int>(nDisc), adc, tcomp);
+            pscanTree->Fill();
+        }
+    }
+    pscanTree->ResetBranchAddresses();
+    return pscanTree;
+}
+
+void smxPscan::allocateCountCube() {
+    // Allocate the full VP_<min>_<max>_<step> range including <max>, finalizeCountCube() trims it
+    vpStride = std::max(1, (vpMax - vpMin) / vpStep + 1);
+    nVp = 0;
+    countCube.assign(static_cast<size_t>(smxNCh) * readDiscList.size() * vpStride, 0);
+}
+
+void smxPscan::fillCountCube(int pulse, int channel, const int* values, int nValues) {
+    int vpIndex = (pulse - vpMin) / vpStep;
+    if (channel < 0 || channel >= smxNCh || pulse < vpMin || (pulse - vpMin) % vpStep != 0 || vpIndex >= vpStride) {
+        logError(Form("Data point vp %d ch %d outside of the VP range of the file name.", pulse, channel));
+        return;
+    }
+    nVp = std::max(nVp, vpIndex + 1);
+
+    size_t nDisc = std::min(readDiscList.size(), static_cast<size_t>(nValues));
+    uint16_t* curve = countCube.data() + static_cast<size_t>(channel) * readDiscList.size() * vpStride + vpIndex;
+    for (size_t i = 0; i < nDisc; ++i) {
+        curve[i * vpStride] = static_cast<uint16_t>(std::clamp(values[i], 0, 0xFFFF));
+    }
+}
+
+void smxPscan::finalizeCountCube() {
+    // Compact in place if the last pulse amplitudes of the allocated range were not scanned
+    if (nVp == vpStride) return;
+    size_t nCurves = static_cast<size_t>(smxNCh) * readDiscList.size();
+    for (size_t curve = 0; curve < nCurves; ++curve) {
+        std::copy_n(countCube.begin() + curve * vpStride, nVp, countCube.begin() + curve * nVp);
+    }
+    countCube.resize(nCurves * nVp);
+    countCube.shrink_to_fit();
+    vpStride = nVp;
+}
+
+void smxPscan::setupDataBranches(int& pulse, int& channel, int* adc, int& tcomp) {
+    SMX_LOG_DEBUG("Setting up TTree branches...");
+    int basketSize = outputOptions.basketSize;
+    pscanTree->Branch("pulse", &pulse, "pulse/I", basketSize);
+    pscanTree->Branch("channel", &channel, "channel/I", basketSize);
+    if (outputOptions.splitAdc) {
+        // One branch per read ADC discriminator, the others are always zero
+        for (int disc : readDiscList) {
+            if (disc >= smxNAdc) continue;
+            std::string name = adcBranchName(disc);
+            pscanTree->Branch(name.c_str(), &adc[disc], (name + "/I").c_str(), basketSize);
+        }
+    } else {
+        pscanTree->Branch("ADC", adc, Form("ADC[%d]/I", smxNAdc), basketSize);
+    }
+    pscanTree->Branch("tcomp", &tcomp, "tcomp/I", basketSize);
+}
+
+void smxPscan::setDataBranchAddresses(int& pulse, int& channel, int* adc, int& tcomp) const {
+    pscanTree->SetBranchAddress("pulse", &pulse);
+    pscanTree->SetBranchAddress("channel", &channel);
+    pscanTree->SetBranchAddress("tcomp", &tcomp);
+    if (pscanTree->GetBranch("ADC")) {
+        pscanTree->SetBranchAddress("ADC", adc);
+        return;
+    }
+    for (int disc : readDiscList) {
+        if (disc < smxNAdc && pscanTree->GetBranch(adcBranchName(disc).c_str())) {
+            pscanTree->SetBranchAddress(adcBranchName(disc).c_str(), &adc[disc]);
+        }
+    }
+}
+
+bool smxPscan::hasDataBranches() const {
+    if (!pscanTree->GetBranch("pulse") || !pscanTree->GetBranch("channel") || !pscanTree->GetBranch("tcomp")) {
+        return false;
+    }
+    if (pscanTree->GetBranch("ADC")) return true;
+    for (int disc : readDiscList) {
+        if (disc < smxNAdc && !pscanTree->GetBranch(adcBranchName(disc).c_str())) return false;
+    }
+    return true;
+}
+
+void smxPscan::fillDataEntry(const int* values, int nValues, int* adc, int& tcomp) const {
+    // Reset adc array to zero for each entry
+    std::fill(adc, adc + smxNAdc, 0);
+
+    size_t nRead = readDiscList.size();
+    for (int index = 0; index < nValues; ++index) {
+        size_t i = static_cast<size_t>(index);
+        if (i < nRead && readDiscList[i] < smxNAdc) {
+            adc[readDiscList[i]] = values[index];
+        } else if (i == nRead) {
+            tcomp = values[index]; // Last value as timing comparator
+        }
+    }
+}
+
+// Reference parser based on std::regex
+Long64_t smxPscan::readAsciiFileRegex(const std::string& filename) {
+    SMX_TIMER("parse");
     // Open the text file
     std::ifstream asciiFile;
     asciiFile.open(filename);
     if (!asciiFile.is_open()) {
         logError("Failed to open file: " + filename);
-        return pscanTree;
+        return -1;
     }
-    std::cout << "File opened successfully: " << filename << std::endl;
+    SMX_LOG_DEBUG("File opened successfully: " << filename);
 
     // Parse header line to extract DISC_LIST positions
     std::string line;
     std::getline(asciiFile, line);
-    std::cout << "Header line: " << line << std::endl;
+    SMX_LOG_INFO("Header line: " << line);
     parseHeaderLine(line);
 
     // Variables for TTree branches
     int pulse, channel;
     int adc[smxNAdc] = {0};  // Array of fixed size smxNAdc, initialized to 0
-    int tcomp;               // Timing comparator
-
-    // Set branch addresses
-    std::cout << "Setting up TTree branches..." << std::endl;
-    pscanTree->Branch("pulse", &pulse, "pulse/I");
-    pscanTree->Branch("channel", &channel, "channel/I");
-    pscanTree->Branch("ADC", adc, Form("ADC[%d]/I", smxNAdc));
-    pscanTree->Branch("tcomp", &tcomp, "tcomp/I");
+    int tcomp = 0;           // Timing comparator
+    setupDataBranches(pulse, channel, adc, tcomp);
+    allocateCountCube();
 
     // Regex pattern to parse each data line
     std::regex data_pattern(R"(vp\s+(\d+)\s+ch\s+(\d+):\s+((\d+\s*)+))");
 
     // Read and parse each line of data
     Long64_t lineCount = 0;
+    std::vector<int> values;
     while (std::getline(asciiFile, line)) {
-        lineCount++;
         std::smatch data_match;
         if (std::regex_match(line, data_match, data_pattern)) {
             // Extract pulse and channel
             pulse = std::stoi(data_match[1]);
             channel = std::stoi(data_match[2]);
 
-            // Reset adc array to zero for each entry
-            std::fill(std::begin(adc), std::end(adc), 0);
-
             // Extract ADC values into a string and parse them into the array
             std::string adc_values_str = data_match[3];
             std::istringstream iss(adc_values_str);
             int value;
-            size_t index = 0;
+            values.clear();
             while (iss >> value) {
-                if (index < readDiscList.size() && readDiscList[index] < smxNAdc) {
-                    adc[readDiscList[index]] = value;
-                } else if (index == readDiscList.size()) {
-                    tcomp = value; // Last value as timing comparator
-                }
-                ++index;
+                values.push_back(value);
             }
+            fillDataEntry(values.data(), static_cast<int>(values.size()), adc, tcomp);
+            fillCountCube(pulse, channel, values.data(), static_cast<int>(values.size()));
 
             // Fill the TTree
-            pscanTree->Fill();
+            {
+                SMX_TIMER("treeFill");
+                pscanTree->Fill();
+            }
+            lineCount++;
+            SMX_COUNT("linesParsed", 1);
+            SMX_COUNT_AT("entriesPerChannel", channel, 1);
         } else {
             logError("Failed to match the line: " + line);
+            SMX_COUNT("failedMatches", 1);
         }
     }
 
-    // Close the file and return the TTree
+    // Close the file
     asciiFile.close();
-    return pscanTree;
+    finalizeCountCube();
+    return lineCount;
+}
+
+// Memory-mapped parser, no heap allocation per line
+Long64_t smxPscan::readAsciiFileFast(const std::string& filename) {
+    SMX_TIMER("parse");
+    smxMappedFile asciiFile(filename);
+    if (!asciiFile.isOpen()) {
+        logError("Failed to open file: " + filename);
+        return -1;
+    }
+    SMX_LOG_DEBUG("File mapped successfully: " << filename);
+
+    smxAsciiScanner scanner(asciiFile.data(), asciiFile.size());
+
+    // Parse header line to extract DISC_LIST positions
+    std::string_view line;
+    scanner.nextLine(line);
+    SMX_LOG_INFO("Header line: " << line);
+    parseHeaderLine(std::string(line));
+
+    // Variables for TTree branches
+    int pulse, channel;
+    int adc[smxNAdc] = {0};  // Array of fixed size smxNAdc, initialized to 0
+    int tcomp = 0;           // Timing comparator
+    setupDataBranches(pulse, channel, adc, tcomp);
+    allocateCountCube();
+
+    // Read and parse each line of data
+    Long64_t lineCount = 0;
+    int values[smxAsciiScanner::maxValues];
+    int nValues = 0;
+    while (scanner.nextLine(line)) {
+        if (smxAsciiScanner::parseDataLine(line, pulse, channel, values, nValues)) {
+            fillDataEntry(values, std::min(nValues, smxAsciiScanner::maxValues), adc, tcomp);
+            fillCountCube(pulse, channel, values, std::min(nValues, smxAsciiScanner::maxValues));
+            {
+                SMX_TIMER("treeFill");
+                pscanTree->Fill();
+            }
+            lineCount++;
+            SMX_COUNT("linesParsed", 1);
+            SMX_COUNT_AT("entriesPerChannel", channel, 1);
+        } else {
+            logError("Failed to match the line: " + std::string(line));
+            SMX_COUNT("failedMatches", 1);
+        }
+    }
+
+    finalizeCountCube();
+    return lineCount;
 }
 
 // Method to write the TTree and metadata to a ROOT file
 void smxPscan::writeRootFile(const std::string& outputFileName) {
-    std::string outputFile = outputFileName.empty() ? generateDefaultOutputFileName() : outputFileName;
-    TFile file(outputFile.c_str(), "RECREATE");
+    if (channelSubset) {
+        // The unread channels are zero in the count cube and would replace the stored counts
+        logError("The scan was read with a channel selection, not writing it.");
+        return;
+    }
+    if (outputOptions.format == smxOutputFormat::RNTuple) {
+        writeRNTupleFile(outputFileName);
+        return;
+    }
+    // A tree created in its output file while parsing only needs its remaining baskets written
+    bool direct = outputFile && pscanTree->GetDirectory() == outputFile;
+    std::string outputName = direct ? std::string(outputFile->GetName())
+                           : !outputFileName.empty() ? outputFileName
+                           : !outputOptions.fileName.empty() ? outputOptions.fileName
+                           : generateDefaultOutputFileName();
+    if (direct && !outputFileName.empty() && outputFileName != outputName) {
+        SMX_LOG_WARNING("The data tree was written to " << outputName << " while parsing, not to " << outputFileName << ".");
+    }
+    TFile* file = direct ? outputFile : openOutputFile(outputName);
+    if (!file) {
+        logError("Failed to create output file: " + outputName);
+        return;
+    }
 
-    if (file.IsOpen()) {
-        pscanTree->Clone()->Write();
-        settingsToTree()->Write();
-        asicSettings.toTree()->Write("asicSettingsTree");
+    auto start = std::chrono::steady_clock::now();
+    {
+        SMX_TIMER("writeRootFile");
+        TDirectory::TContext context(file);
+        if (direct) {
+            pscanTree->Write();
+        } else {
+            if (pscanTree->GetEntries() == 0) {
+                fillTreeFromCube(); // scan loaded from a binary file
+            }
+            std::unique_ptr<TTree> copy(static_cast<TTree*>(pscanTree->Clone()));
+            copy->Write();
+        }
+        // Metadata trees are deleted right after writing instead of staying in the file until it is closed
+        std::unique_ptr<TTree> settingsTree(settingsToTree());
+        settingsTree->Write();
+        std::unique_ptr<TTree> asicSettingsTree(asicSettings.toTree());
+        asicSettingsTree->Write("asicSettingsTree");
+        if (fitResults.getNFilled() > 0) {
+            std::unique_ptr<TTree> fitResultsTree(fitResults.toTree());
+            fitResultsTree->Write();
+        }
 
 /*
         file.WriteObject(&asicId, "asicId");
@@ -209,13 +832,171 @@ void smxPscan::writeRootFile(const std::string& outputFileName) {
         TParameter<int> nPulsesParam("nPulses", nPulses);
         nPulsesParam.Write();
 */
-        file.Close();
-        std::cout << "File written successfully to: " << outputFile << std::endl;
-    } else {
-        logError("Failed to create output file: " + outputFile);
+        if (direct) {
+            // The entries are in the file now; keep an empty in-memory tree like after readBinaryFile()
+            delete pscanTree;
+            pscanTree = new TTree("pscanTree", "Tree for pulse scan data");
+            pscanTree->SetDirectory(nullptr);
+            outputFile = nullptr;
+        }
+        file->Close();
+        delete file;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::error_code ec;
+    double megaBytes = std::filesystem::file_size(outputName, ec) / 1e6;
+    SMX_LOG_INFO("File written successfully to: " << outputName << " (" << megaBytes << " MB in " << seconds * 1e3
+                 << " ms" << (direct ? " after writing the data baskets while parsing" : "") << ")");
+    SMX_WRITE_SUMMARY(getSummaryFileName(outputName));
+}
+
+void smxPscan::setOutputOptions(const smxRootOutputOptions& options) {
+    outputOptions = options;
+}
+
+const smxRootOutputOptions& smxPscan::getOutputOptions() const {
+    return outputOptions;
+}
+
+TFile* smxPscan::openOutputFile(const std::string& fileName) const {
+    TDirectory::TContext context; // do not leave gDirectory pointing at the new file
+    TFile* file = TFile::Open(fileName.c_str(), "RECREATE");
+    if (!file || file->IsZombie()) {
+        delete file;
+        return nullptr;
+    }
+    int settings = compressionSettings();
+    if (settings >= 0) {
+        file->SetCompressionSettings(settings);
+    }
+    return file;
+}
+
+int smxPscan::compressionSettings() const {
+    int level = std::clamp(outputOptions.compressionLevel, 0, 9);
+    switch (outputOptions.compression) {
+        case smxCompression::Zlib:
+            return ROOT::CompressionSettings(ROOT::RCompressionSetting::EAlgorithm::kZLIB, level);
+        case smxCompression::LZ4:
+            return ROOT::CompressionSettings(ROOT::RCompressionSetting::EAlgorithm::kLZ4, level);
+        case smxCompression::Zstd:
+            return ROOT::CompressionSettings(ROOT::RCompressionSetting::EAlgorithm::kZSTD, level);
+        case smxCompression::Default:
+            break;
     }
+    return -1;
 }
 
+bool smxPscan::attachTreeToOutput() {
+    discardOutputFile();
+    std::string outputName = outputOptions.fileName.empty() ? generateDefaultOutputFileName() : outputOptions.fileName;
+    TFile* file = openOutputFile(outputName);
+    if (!file) {
+        logError("Failed to create output file: " + outputName);
+        return false;
+    }
+    outputFile = file;
+    delete pscanTree;
+    pscanTree = new TTree("pscanTree", "Tree for pulse scan data");
+    pscanTree->SetDirectory(outputFile);
+    pscanTree->SetAutoFlush(outputOptions.autoFlush);
+    return true;
+}
+
+void smxPscan::discardOutputFile() {
+    if (!outputFile) return;
+    SMX_LOG_WARNING("Output file " << outputFile->GetName() << " was not written, it is left incomplete.");
+    if (pscanTree->GetDirectory() == outputFile) {
+        delete pscanTree;
+        pscanTree = new TTree("pscanTree", "Tree for pulse scan data");
+        pscanTree->SetDirectory(nullptr);
+    }
+    outputFile->Close();
+    delete outputFile;
+    outputFile = nullptr;
+}
+
+void smxPscan::measureOutputOptions(const std::string& filename,
+                                    const std::vector<std::pair<std::string, smxRootOutputOptions>>& configurations) {
+    std::error_code ec;
+    double inputMegaBytes = std::filesystem::file_size(filename, ec) / 1e6;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(ec);
+
+    struct Row {
+        std::string label;
+        double parseSeconds;
+        double writeSeconds;
+        double megaBytes;
+    };
+    std::vector<Row> rows;
+    for (const auto& [label, options] : configurations) {
+        smxPscan pscan;
+        smxRootOutputOptions measured = options;
+        measured.fileName = (directory / ("smx_output_" + label + ".root")).string();
+        pscan.setOutputOptions(measured);
+
+        auto start = std::chrono::steady_clock::now();
+        pscan.readAsciiFile(filename);
+        double parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        start = std::chrono::steady_clock::now();
+        pscan.writeRootFile();
+        double writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        rows.push_back({label, parseSeconds, writeSeconds, std::filesystem::file_size(measured.fileName, ec) / 1e6});
+        std::filesystem::remove(measured.fileName, ec);
+        std::filesystem::remove(pscan.getSummaryFileName(measured.fileName), ec);
+    }
+
+    SMX_LOG_INFO("Output configuration      parse+fill s   write s   total s   size MB   MB/s (of " << inputMegaBytes << " MB input)");
+    for (const Row& row : rows) {
+        double total = row.parseSeconds + row.writeSeconds;
+        SMX_LOG_INFO(std::left << std::setw(24) << row.label << std::right
+                     << std::setw(14) << row.parseSeconds << std::setw(10) << row.writeSeconds
+                     << std::setw(10) << total << std::setw(10) << row.megaBytes
+                     << std::setw(10) << (total > 0 ? inputMegaBytes / total : 0.));
+    }
+}
+
+void smxPscan::setResultCache(smxResultCache* cache) {
+    resultCache = cache;
+}
+
+void smxPscan::setParseMode(smxParseMode mode) {
+    parseMode = mode;
+}
+
+smxParseMode smxPscan::getParseMode() const {
+    return parseMode;
+}
+
+smxFitResultTable& smxPscan::getFitResults() {
+    return fitResults;
+}
+
+int smxPscan::classifyCurves() {
+    SMX_TIMER("classifyCurves");
+    smxCurveClassifier classifier(nPulses);
+    int nLabelled[5] = {0};
+    for (int ch = 0; ch < smxNCh; ++ch) {
+        for (size_t j = 0; j < readDiscList.size(); ++j) {
+            std::span<const uint16_t> counts = getComparatorCounts(ch, static_cast<int>(j));
+            if (counts.empty()) continue;
+            smxCurveLabel label = classifier.classify(counts);
+            fitResults.setLabel(ch, readDiscList[j], static_cast<int>(label));
+            nLabelled[static_cast<int>(label)]++;
+        }
+    }
+
+    int nRejected = 0;
+    std::ostringstream summary;
+    for (int label = 1; label < 5; ++label) {
+        nRejected += nLabelled[label];
+        summary << ", " << nLabelled[label] << " " << smxCurveClassifier::labelName(static_cast<smxCurveLabel>(label));
+    }
+    SMX_LOG_INFO("Classified S-curves: " << nLabelled[0] << " fittable" << summary.str() << ".");
+    return nRejected;
+}
 
 // Getter to access the internal TTree
 TTree* smxPscan::getDataTree() const {
@@ -232,11 +1013,80 @@ std::string smxPscan::getAsciiFileAddress() const {
     return asciiFileAddress;
 }
 
+std::string smxPscan::getOutputFileName() const {
+    return outputOptions.fileName.empty() ? generateDefaultOutputFileName() : outputOptions.fileName;
+}
+
+std::string smxPscan::getSummaryFileName(const std::string& rootFileName) const {
+    std::filesystem::path path(rootFileName.empty() ? generateDefaultOutputFileName() : rootFileName);
+    return path.replace_extension(".stats.json").string();
+}
+
 // Getter for read DISC_LIST positions
 const std::vector<int>& smxPscan::getReadDiscList() const {
     return readDiscList;
 }
 
+int smxPscan::getDiscIndex(int comparator) const {
+    auto it = std::find(readDiscList.begin(), readDiscList.end(), comparator);
+    return it == readDiscList.end() ? -1 : static_cast<int>(it - readDiscList.begin());
+}
+
+int smxPscan::getNVp() const {
+    return nVp;
+}
+
+int smxPscan::getPulseAmplitude(int vpIndex) const {
+    return vpMin + vpIndex * vpStep;
+}
+
+std::span<const uint16_t> smxPscan::cubeCounts() const {
+    return binaryFile ? binaryFile->getCounts() : std::span<const uint16_t>(countCube);
+}
+
+std::span<const uint16_t> smxPscan::getChannelCounts(int channelN) const {
+    std::span<const uint16_t> counts = cubeCounts();
+    if (channelN < 0 || channelN >= smxNCh || counts.empty()) return {};
+    size_t channelSize = readDiscList.size() * vpStride;
+    return counts.subspan(channelN * channelSize, channelSize);
+}
+
+std::span<const uint16_t> smxPscan::getComparatorCounts(int channelN, int discIndex) const {
+    if (discIndex < 0 || static_cast<size_t>(discIndex) >= readDiscList.size()) return {};
+    std::span<const uint16_t> channelCounts = getChannelCounts(channelN);
+    if (channelCounts.empty()) return {};
+    return channelCounts.subspan(static_cast<size_t>(discIndex) * vpStride, nVp);
+}
+
+size_t smxPscan::getComparatorPoints(int channelN, int discIndex, std::vector<double>& x, std::vector<double>& y,
+                                     std::vector<double>& yErrLo, std::vector<double>& yErrHi) const {
+    x.clear();
+    y.clear();
+    yErrLo.clear();
+    yErrHi.clear();
+    std::span<const uint16_t> counts = getComparatorCounts(channelN, discIndex);
+    if (counts.empty() || nPulses <= 0) return 0;
+    int compIndex = readDiscList[discIndex];
+    if (compIndex >= smxNAdc) return 0; // time comp to be handled separately
+
+    // Same arithmetic as the countNorm points of buildDataSets()
+    float norm = 1.0 / nPulses;
+    float visSepar = 0.02;
+    const size_t n = counts.size();
+    x.resize(n);
+    y.resize(n);
+    yErrLo.resize(n);
+    yErrHi.resize(n);
+    smxCountErrors(nPulses, *std::max_element(counts.begin(), counts.end())).compute(counts, yErrLo.data(), yErrHi.data());
+    for (size_t v = 0; v < n; ++v) {
+        x[v] = getPulseAmplitude(static_cast<int>(v));
+        y[v] = counts[v] * norm - visSepar * (smxNAdc - 1 - compIndex);
+        yErrLo[v] *= norm;
+        yErrHi[v] *= norm;
+    }
+    return n;
+}
+
 // Setter for the ASIC settings
 void smxPscan::setAsicSettings(const smxAsicSettings& settings) {
     asicSettings = settings;
@@ -253,6 +1103,39 @@ TString smxPscan::getAsicId() const {
 
 
 RooDataSet* smxPscan::toRooDataSet(int channelN) const {
+    if (channelN < 0 || channelN >= smxNCh) {
+        logError(Form("Channel %d out of range.", channelN));
+        return nullptr;
+    }
+    std::vector<RooDataSet*> datasets = buildDataSets(channelN, false);
+    return datasets.empty() ? nullptr : datasets.front();
+}
+
+std::vector<RooDataSet*> smxPscan::toRooDataSets(bool splitComparators) const {
+    return buildDataSets(-1, splitComparators);
+}
+
+RooDataSet* smxPscan::getRooDataSet(int channelN) {
+    if (channelN < 0 || channelN >= smxNCh) {
+        logError(Form("Channel %d out of range.", channelN));
+        return nullptr;
+    }
+    if (dataSetCache.empty()) {
+        dataSetCache = buildDataSets(-1, false);
+        if (dataSetCache.empty()) return nullptr;
+    }
+    return dataSetCache[channelN];
+}
+
+void smxPscan::clearDataSetCache() {
+    for (RooDataSet* dataset : dataSetCache) {
+        delete dataset;
+    }
+    dataSetCache.clear();
+}
+
+std::vector<RooDataSet*> smxPscan::buildDataSets(int channelN, bool splitComparators) const {
+    SMX_TIMER("buildDataSets");
     // Step 1: Define RooRealVars for pulse amplitude, count number, normalized count, and RooCategory for adcComp
     RooRealVar pulseAmp("pulseAmp", "Pulse amplitude", 0, 256, "a.u."); // Range of pulse amplitudes
     RooRealVar countN("countN", "Comparator counts", 0, 300);           // Range of counts
@@ -260,111 +1143,141 @@ RooDataSet* smxPscan::toRooDataSet(int channelN) const {
     RooCategory adcComp("adcComp", "ADC Comparator");
 
     // Define adcComp categories for the comparators in readDiscList
-    for (size_t i = 0; i < readDiscList.size(); ++i) {
-        int compIndex = readDiscList.at(i);
+    for (int compIndex : readDiscList) {
         adcComp.defineType(Form("Comp%02d", compIndex), compIndex);
-        std::cout << compIndex << std::endl;
     }
 
     // Combine variables into an ArgSet
     RooArgSet variables(pulseAmp, countN, countNorm, adcComp);
 
-    // Step 2: Create a new RooDataSet
-    std::cout << "Creating RooDataSet for channel: " << channelN << " and specified comparators in readDiscList." << std::endl;
-
-    RooDataSet* dataset = new RooDataSet("pscanData", "Pulse vs Comparator Data", variables, RooFit::StoreAsymError(variables));
-
-    // Step 3: Check for required branches
-    if (!pscanTree->GetBranch("pulse") || !pscanTree->GetBranch("channel") ||
-        !pscanTree->GetBranch("ADC") || !pscanTree->GetBranch("tcomp")) {
-        std::cerr << "Error: Required branches are missing from pscanTree." << std::endl;
-        return nullptr;
+    // Step 2: Check the data source, the count cube or the required branches of pscanTree
+    bool fromCube = !cubeCounts().empty();
+    if (!fromCube && !hasDataBranches()) {
+        SMX_LOG_ERROR("Required branches are missing from pscanTree.");
+        return {};
     }
 
-    std::cout << "Branches found: pulse, channel, ADC, tcomp." << std::endl;
+    if (nPulses <= 0) {
+        SMX_LOG_ERROR("Total number of trials (nPulses) cannot be zero.");
+        return {};
+    }
 
-    // Step 4: Set up branches for reading TTree data
-    int pulse, channel, tcomp;
-    int adc[smxNAdc] = {0}; // Ensures no garbage values
-    pscanTree->SetBranchAddress("pulse", &pulse);
-    pscanTree->SetBranchAddress("channel", &channel);
-    pscanTree->SetBranchAddress("ADC", adc);
-    pscanTree->SetBranchAddress("tcomp", &tcomp);
+    // Step 3: Create the datasets
+    int firstChannel = channelN < 0 ? 0 : channelN;
+    int nChannels = channelN < 0 ? smxNCh : 1;
+    size_t nDisc = readDiscList.size();
+    size_t setsPerChannel = splitComparators ? nDisc : 1;
+
+    std::vector<RooDataSet*> datasets(nChannels * setsPerChannel);
+    for (int ch = 0; ch < nChannels; ++ch) {
+        for (size_t j = 0; j < setsPerChannel; ++j) {
+            const char* name = splitComparators
+                ? Form("pscanData_ch%03d_comp%02d", firstChannel + ch, readDiscList[j])
+                : "pscanData";
+            datasets[ch * setsPerChannel + j] =
+                new RooDataSet(name, "Pulse vs Comparator Data", variables, RooFit::StoreAsymError(variables));
+        }
+    }
 
     float norm = 1.0 / nPulses;
-
-    std::cout << "Branch addresses set. Looping through TTree entries..." << std::endl;
-
     float visSepar = 0.02; // Hardcoded control variable
 
-    // Step 5: Loop over TTree entries and filter for the specified channel
-    for (Long64_t i = 0; i < pscanTree->GetEntries(); ++i) {
-        pscanTree->GetEntry(i);
-
-        // Filter for the specified channel
-        if (channel == channelN) {
-            pulseAmp.setVal(pulse);
-
-            // Loop over comparators specified in readDiscList
-            for (size_t j = 0; j < readDiscList.size(); ++j) {
-                int compIndex = readDiscList.at(j);
-                if (compIndex == 31) continue; // time comp to be handled separately 
-                countN.setVal(adc[compIndex]);
-                applyWillsonErrors(&countN);
-
-                countNorm.setVal(countN.getVal() * norm - visSepar * (smxNAdc - 1 - compIndex));
-                countNorm.setAsymError(countN.getAsymErrorLo() * norm, countN.getAsymErrorHi() * norm);
-
-                adcComp.setIndex(compIndex); // Set the adcComp value
-                dataset->add(variables);
+    // The errors of all counts come from one table, nPulses is fixed for the scan
+    std::span<const uint16_t> cube = cubeCounts();
+    smxCountErrors countErrors(nPulses, fromCube ? *std::max_element(cube.begin(), cube.end()) : -1);
+
+    // Adds one (pulse, comparator) point with the errors of its count to the dataset of its channel
+    auto addPoint = [&](int ch, int pulse, size_t j, int count, double errLo, double errHi) {
+        int compIndex = readDiscList[j];
+        if (compIndex >= smxNAdc) return; // time comp to be handled separately
+
+        pulseAmp.setVal(pulse);
+        countN.setVal(count);
+        countN.setAsymError(errLo, errHi);
+
+        countNorm.setVal(static_cast<double>(count) * norm - visSepar * (smxNAdc - 1 - compIndex));
+        countNorm.setAsymError(errLo * norm, errHi * norm);
+
+        adcComp.setIndex(compIndex); // Set the adcComp value
+        datasets[(ch - firstChannel) * setsPerChannel + (splitComparators ? j : 0)]->add(variables);
+        SMX_COUNT("datasetPoints", 1);
+    };
+
+    // Step 4: Single pass over the data, points are added in file order (pulse, then comparator)
+    if (fromCube) {
+        // Errors of a whole channel in one batch, attached to the points afterwards
+        std::vector<double> errLo, errHi;
+        for (int ch = firstChannel; ch < firstChannel + nChannels; ++ch) {
+            std::span<const uint16_t> counts = getChannelCounts(ch);
+            errLo.resize(counts.size());
+            errHi.resize(counts.size());
+            countErrors.compute(counts, errLo.data(), errHi.data());
+            for (int v = 0; v < nVp; ++v) {
+                for (size_t j = 0; j < nDisc; ++j) {
+                    size_t k = j * vpStride + v;
+                    addPoint(ch, getPulseAmplitude(v), j, counts[k], errLo[k], errHi[k]);
+                }
+            }
+        }
+    } else {
+        int pulse, channel, tcomp;
+        int adc[smxNAdc] = {0}; // Ensures no garbage values
+        setDataBranchAddresses(pulse, channel, adc, tcomp);
+
+        for (Long64_t i = 0; i < pscanTree->GetEntries(); ++i) {
+            pscanTree->GetEntry(i);
+            if (channel < firstChannel || channel >= firstChannel + nChannels) continue;
+            for (size_t j = 0; j < nDisc; ++j) {
+                if (readDiscList[j] >= smxNAdc) continue;
+                double errLo, errHi;
+                countErrors.compute(adc[readDiscList[j]], errLo, errHi);
+                addPoint(channel, pulse, j, adc[readDiscList[j]], errLo, errHi);
             }
         }
     }
 
-    std::cout << "Finished creating RooDataSet. Total entries: " << dataset->numEntries() << std::endl;
+    SMX_LOG_DEBUG("Created " << datasets.size() << " RooDataSet(s) for "
+                  << (channelN < 0 ? std::string("all channels") : "channel " + std::to_string(channelN))
+                  << " in a single pass over the " << (fromCube ? "count cube" : "pscanTree") << ".");
 
-
-    return dataset;
+    return datasets;
 }
 
 
 void smxPscan::showTreeEntries() const {
     // Step 1: Check if required branches exist
-    if (!pscanTree->GetBranch("pulse") || !pscanTree->GetBranch("channel") ||
-        !pscanTree->GetBranch("ADC") || !pscanTree->GetBranch("tcomp")) {
-        std::cerr << "Error: Required branches are missing from pscanTree." << std::endl;
+    if (!hasDataBranches()) {
+        SMX_LOG_ERROR("Required branches are missing from pscanTree.");
         return;
     }
 
-    std::cout << "Branches found: pulse, channel, ADC, tcomp." << std::endl;
+    SMX_LOG_INFO("Branches found: pulse, channel, ADC, tcomp.");
 
     // Step 2: Set up branches for reading TTree data
     int pulse, channel, tcomp;
     int adc[smxNAdc] = {0}; // Array for ADC comparators
-    pscanTree->SetBranchAddress("pulse", &pulse);
-    pscanTree->SetBranchAddress("channel", &channel);
-    pscanTree->SetBranchAddress("ADC", adc);
-    pscanTree->SetBranchAddress("tcomp", &tcomp);
+    setDataBranchAddresses(pulse, channel, adc, tcomp);
 
-    std::cout << "Branch addresses set. Looping through TTree entries..." << std::endl;
+    SMX_LOG_INFO("Branch addresses set. Looping through TTree entries...");
 
     // Step 3: Loop over all TTree entries and print their contents
     for (Long64_t i = 0; i < pscanTree->GetEntries(); ++i) {
         pscanTree->GetEntry(i);
 
         // Print all variables for the current entry
-        std::cout << "Entry: " << i
-                  << " Channel: " << channel
-                  << " Pulse: " << pulse
-                  << " TComp: " << tcomp
-                  << " ADC: ";
+        std::ostringstream entry;
+        entry << "Entry: " << i
+              << " Channel: " << channel
+              << " Pulse: " << pulse
+              << " TComp: " << tcomp
+                     << " ADC: ";
         for (int j = 0; j < smxNAdc; ++j) {
-            std::cout << adc[j] << " ";
+            entry << adc[j] << " ";
         }
-        std::cout << std::endl;
+        SMX_LOG_INFO(entry.str());
     }
 
-    std::cout << "Finished dumping all TTree entries." << std::endl;
+    SMX_LOG_INFO("Finished dumping all TTree entries.");
 }
 
 TTree* smxPscan::settingsToTree() const {
@@ -377,74 +1290,20 @@ TTree* smxPscan::settingsToTree() const {
 
     // Create a non-const copy of readDiscList to pass to TTree::Branch
     std::vector<int> discListVec = readDiscList;
+    int vpMinCopy = vpMin;
+    int vpMaxCopy = vpMax;
+    int vpStepCopy = vpStep;
 
     // Create branches
     tree->Branch("readTime", &readTimeLong, "readTime/L");
     tree->Branch("nPulses", &nPulsesCopy, "nPulses/I");
     tree->Branch("asicId", &asicIdCopy);
     tree->Branch("readDiscList", &discListVec); // Pass the non-const vector
+    tree->Branch("vpMin", &vpMinCopy, "vpMin/I");
+    tree->Branch("vpMax", &vpMaxCopy, "vpMax/I");
+    tree->Branch("vpStep", &vpStepCopy, "vpStep/I");
 
     // Fill the tree
     tree->Fill();
     return tree;
 }
-
-void smxPscan::applyAsymmetricPoissonianErrors(RooRealVar* countN) const {
-    if (!countN) {
-        std::cerr << "Error: Null pointer passed to applyAsymmetricPoissonianErrors." << std::endl;
-        return;
-    }
-    double count = countN->getVal(); // Proportion of successes
-    double lowerError = 0;
-    double upperError = 1.841;
-    if(count != 0) {
-        lowerError = -TMath::Sqrt(count -.25);   // Lower error approximation
-        upperError = TMath::Sqrt(count + .75);   // Upper error approximation
-    }
-    countN->setAsymError(lowerError, upperError);  // Relative to the central value
-}
-
-void smxPscan::applyWillsonErrors(RooRealVar* countN) const {
-    // Ensure the input pointer is valid
-    if (!countN) {
-        std::cerr << "Error: Null pointer passed to applyWillsonErrors." << std::endl;
-        return;
-    }
-
-    int n = nPulses; // Total number of trials (or pulses)
-    if (n == 0) {
-        std::cerr << "Error: Total number of trials (nPulses) cannot be zero." << std::endl;
-        return;
-    }
-
-    double p_hat = countN->getVal() / n; // Proportion of successes
-    if (p_hat < 0 || p_hat > 1) {
-        applyAsymmetricPoissonianErrors(countN); // Handle invalid probabilities
-        return;
-    }
-
-    double z = 1.0; // z-value for confidence interval
-    double z2 = z * z; // Precompute z-squared for efficiency
-
-    // Compute the Wilson score interval with continuity correction
-    double sqrtTermMinus = p_hat != 0 
-        ? z * sqrt(z2 - 2 - (1.0 / n) + 4 * p_hat * (n * (1 - p_hat) + 1)) 
-        : 0.0;
-    double sqrtTermPlus = p_hat != 1 
-        ? z * sqrt(z2 + 2 - (1.0 / n) + 4 * p_hat * (n * (1 - p_hat) - 1)) 
-        : 0.0;
-
-    double w_cc_minus = p_hat != 0 
-        ? std::max(0.0, (2 * n * p_hat + z2 - 1 - sqrtTermMinus) / (2 * (n + z2))) 
-        : 0.0;
-    double w_cc_plus = p_hat < 1 
-        ? std::min(1.0, (2 * n * p_hat + z2 + 1 + sqrtTermPlus) / (2 * (n + z2))) 
-        : 1.0;
-
-    // Update the RooRealVar object with the calculated asymmetric errors
-    countN->setAsymError(n * w_cc_minus - n * p_hat -.5, n * w_cc_plus - n * p_hat +.5);
-}
-
-
-
-
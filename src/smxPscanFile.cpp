@@ -0,0 +1,168 @@
+#include "smxPscanFile.h"
+#include "smxLog.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+// Counts start on a cache-line boundary after the header
+constexpr uint64_t cubeAlignment = 64;
+
+// Checks the header fields that describe the counts
+bool consistentHeader(const smxPscanFileHeader& fileHeader, std::size_t nCounts) {
+    if (fileHeader.nChannels < 0 || fileHeader.nVp < 0 ||
+        fileHeader.nDisc < 0 || fileHeader.nDisc > smxPscanFileMaxDisc) {
+        SMX_LOG_ERROR("Invalid dimensions in the pulse scan header.");
+        return false;
+    }
+    uint64_t expected = static_cast<uint64_t>(fileHeader.nChannels) * fileHeader.nDisc * fileHeader.nVp;
+    if (expected != nCounts) {
+        SMX_LOG_ERROR("Pulse scan holds " << nCounts << " counts, the header describes " << expected << ".");
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool smxPscanFile::open(const std::string& filename) {
+    close();
+    if (!file.open(filename)) {
+        SMX_LOG_ERROR("Failed to map file: " << filename);
+        return false;
+    }
+
+    // The mapping is page-aligned, so the header can be used in place
+    const auto* candidate = reinterpret_cast<const smxPscanFileHeader*>(file.data());
+    if (file.size() < sizeof(smxPscanFileHeader) ||
+        std::memcmp(candidate->magic, smxPscanFileMagic, sizeof(smxPscanFileMagic)) != 0) {
+        SMX_LOG_ERROR("Not a binary pulse scan file: " << filename);
+        close();
+        return false;
+    }
+    if (candidate->byteOrder != smxPscanFileByteOrder) {
+        SMX_LOG_ERROR("Pulse scan file written with a different byte order: " << filename);
+        close();
+        return false;
+    }
+    if (candidate->version != smxPscanFileVersion || candidate->headerSize != sizeof(smxPscanFileHeader)) {
+        SMX_LOG_ERROR("Unsupported pulse scan file version " << candidate->version << ": " << filename);
+        close();
+        return false;
+    }
+    if (candidate->cubeOffset % alignof(uint16_t) != 0 || candidate->cubeOffset < sizeof(smxPscanFileHeader) ||
+        candidate->cubeOffset + candidate->cubeCount * sizeof(uint16_t) > file.size() ||
+        !consistentHeader(*candidate, candidate->cubeCount)) {
+        SMX_LOG_ERROR("Truncated or corrupt pulse scan file: " << filename);
+        close();
+        return false;
+    }
+
+    header = candidate;
+    counts = std::span<const uint16_t>(reinterpret_cast<const uint16_t*>(file.data() + header->cubeOffset),
+                                       header->cubeCount);
+    return true;
+}
+
+void smxPscanFile::close() {
+    header = nullptr;
+    counts = {};
+    file.close();
+}
+
+bool smxPscanFile::isOpen() const {
+    return header != nullptr;
+}
+
+const smxPscanFileHeader& smxPscanFile::getHeader() const {
+    return *header;
+}
+
+std::span<const uint16_t> smxPscanFile::getCounts() const {
+    return counts;
+}
+
+bool smxPscanFile::isPscanFile(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    char magic[sizeof(smxPscanFileMagic)] = {};
+    in.read(magic, sizeof(magic));
+    return in && std::memcmp(magic, smxPscanFileMagic, sizeof(magic)) == 0;
+}
+
+smxPscanFileHeader smxPscanFile::makeHeader() {
+    smxPscanFileHeader fileHeader;
+    std::memset(&fileHeader, 0, sizeof(fileHeader));
+    std::memcpy(fileHeader.magic, smxPscanFileMagic, sizeof(smxPscanFileMagic));
+    fileHeader.version = smxPscanFileVersion;
+    fileHeader.headerSize = sizeof(smxPscanFileHeader);
+    fileHeader.byteOrder = smxPscanFileByteOrder;
+    return fileHeader;
+}
+
+bool smxPscanFile::write(const std::string& filename, const smxPscanFileHeader& fileHeader,
+                         std::span<const uint16_t> cubeCounts) {
+    if (!consistentHeader(fileHeader, cubeCounts.size())) return false;
+
+    smxPscanFileHeader outHeader = fileHeader;
+    outHeader.headerSize = sizeof(smxPscanFileHeader);
+    outHeader.cubeOffset = (sizeof(smxPscanFileHeader) + cubeAlignment - 1) / cubeAlignment * cubeAlignment;
+    outHeader.cubeCount = cubeCounts.size();
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        SMX_LOG_ERROR("Failed to create file: " << filename);
+        return false;
+    }
+    char padding[cubeAlignment] = {};
+    out.write(reinterpret_cast<const char*>(&outHeader), sizeof(outHeader));
+    out.write(padding, outHeader.cubeOffset - sizeof(outHeader));
+    out.write(reinterpret_cast<const char*>(cubeCounts.data()), cubeCounts.size_bytes());
+    if (!out) {
+        SMX_LOG_ERROR("Failed to write file: " << filename);
+        return false;
+    }
+    return true;
+}
+
+bool smxPscanFile::writeAscii(const std::string& filename, const smxPscanFileHeader& fileHeader,
+                              std::span<const uint16_t> cubeCounts) {
+    if (!consistentHeader(fileHeader, cubeCounts.size())) return false;
+
+    std::ofstream out(filename, std::ios::trunc);
+    if (!out) {
+        SMX_LOG_ERROR("Failed to create file: " << filename);
+        return false;
+    }
+
+    // Header line as written by the DAQ
+    out << "# VP: \t CH: \t DISC_LIST:[";
+    for (int j = 0; j < fileHeader.nDisc; ++j) {
+        out << (j > 0 ? ", " : "") << fileHeader.discList[j];
+    }
+    out << "] \t POL: " << fileHeader.pol << " \n";
+
+    // Data lines sorted by pulse amplitude, then by channel
+    const int nDisc = fileHeader.nDisc;
+    const int nVp = fileHeader.nVp;
+    std::vector<char> line(32 + 12 * static_cast<std::size_t>(nDisc));
+    for (int v = 0; v < nVp; ++v) {
+        int pulse = fileHeader.vpMin + v * fileHeader.vpStep;
+        for (int ch = 0; ch < fileHeader.nChannels; ++ch) {
+            const uint16_t* curves = cubeCounts.data() + static_cast<std::size_t>(ch) * nDisc * nVp + v;
+            int length = std::snprintf(line.data(), line.size(), "vp %3d   ch %4d: ", pulse, ch);
+            for (int j = 0; j < nDisc; ++j) {
+                length += std::snprintf(line.data() + length, line.size() - length, "%6d", curves[j * nVp]);
+            }
+            line[length++] = '\n';
+            out.write(line.data(), length);
+        }
+    }
+    if (!out) {
+        SMX_LOG_ERROR("Failed to write file: " << filename);
+        return false;
+    }
+    return true;
+}
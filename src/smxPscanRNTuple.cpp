@@ -0,0 +1,387 @@
+#include "smxPscan.h"
+#include <TFile.h>
+#include <TKey.h>
+#include <RVersion.h>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <memory>
+#include "smxInstrument.h"
+#include "smxLog.h"
+
+/**
+ * @file smxPscanRNTuple.cpp
+ * @brief RNTuple writer and reader of smxPscan.
+ *
+ * Kept apart from smxPscan.cpp so that only this file depends on the RNTuple
+ * API, which left ROOT::Experimental in ROOT 6.36.
+ */
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 36, 0)
+namespace rnt = ROOT;
+#else
+namespace rnt = ROOT::Experimental;
+#endif
+
+namespace {
+
+// Name of the column of one discriminator, like the branches of the split TTree layout
+std::string adcColumnName(int disc) {
+    char name[16];
+    std::snprintf(name, sizeof(name), "ADC_%02d", disc);
+    return name;
+}
+
+// Columns of the fitResults RNTuple, named like the branches of fitResultsTree
+constexpr std::pair<const char*, int smxFitResult::*> fitIntColumns[] = {
+    {"channel", &smxFitResult::channel},
+    {"comparator", &smxFitResult::comparator},
+    {"status", &smxFitResult::status},
+    {"retries", &smxFitResult::retries},
+    {"label", &smxFitResult::label},
+};
+
+constexpr std::pair<const char*, double smxFitResult::*> fitDoubleColumns[] = {
+    {"threshold", &smxFitResult::threshold},
+    {"thresholdErrLo", &smxFitResult::thresholdErrLo},
+    {"thresholdErrHi", &smxFitResult::thresholdErrHi},
+    {"sigma", &smxFitResult::sigma},
+    {"sigmaErrLo", &smxFitResult::sigmaErrLo},
+    {"sigmaErrHi", &smxFitResult::sigmaErrHi},
+    {"offset", &smxFitResult::offset},
+    {"offsetErrLo", &smxFitResult::offsetErrLo},
+    {"offsetErrHi", &smxFitResult::offsetErrHi},
+    {"chi2", &smxFitResult::chi2},
+    {"wallTime", &smxFitResult::wallTime},
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+bool smxPscan::writeRNTupleFile(const std::string& outputFileName) const {
+    std::span<const uint16_t> counts = cubeCounts();
+    if (counts.empty()) {
+        logError("No counts to write.");
+        return false;
+    }
+    std::string outputName = !outputFileName.empty() ? outputFileName
+                           : !outputOptions.fileName.empty() ? outputOptions.fileName
+                           : generateDefaultOutputFileName();
+    std::unique_ptr<TFile> file(openOutputFile(outputName));
+    if (!file) {
+        logError("Failed to create output file: " + outputName);
+        return false;
+    }
+
+    rnt::RNTupleWriteOptions writeOptions;
+    int settings = compressionSettings();
+    if (settings >= 0) {
+        writeOptions.SetCompression(settings);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        SMX_TIMER("writeRootFile");
+        // Each writer commits its RNTuple to the file when it goes out of scope
+        {
+            auto model = rnt::RNTupleModel::Create();
+            auto pulse = model->MakeField<int>("pulse");
+            auto channel = model->MakeField<int>("channel");
+            std::vector<std::shared_ptr<std::uint16_t>> adc;
+            for (int disc : readDiscList) {
+                adc.push_back(model->MakeField<std::uint16_t>(adcColumnName(disc)));
+            }
+            auto writer = rnt::RNTupleWriter::Append(std::move(model), "pscan", *file, writeOptions);
+
+            // Same entry order as the ASCII file: pulse amplitude, then channel
+            size_t nDisc = readDiscList.size();
+            for (int v = 0; v < nVp; ++v) {
+                for (int ch = 0; ch < smxNCh; ++ch) {
+                    *pulse = getPulseAmplitude(v);
+                    *channel = ch;
+                    for (size_t j = 0; j < nDisc; ++j) {
+                        *adc[j] = counts[(ch * nDisc + j) * vpStride + v];
+                    }
+                    writer->Fill();
+                }
+            }
+        }
+        {
+            auto model = rnt::RNTupleModel::Create();
+            *model->MakeField<std::string>("sourceName") = asciiFileName;
+            *model->MakeField<std::int64_t>("readTime") = static_cast<std::int64_t>(readTime);
+            *model->MakeField<int>("nPulses") = nPulses;
+            *model->MakeField<std::string>("asicId") = asicId.Data();
+            *model->MakeField<std::vector<int>>("readDiscList") = readDiscList;
+            *model->MakeField<int>("vpMin") = vpMin;
+            *model->MakeField<int>("vpMax") = vpMax;
+            *model->MakeField<int>("vpStep") = vpStep;
+            rnt::RNTupleWriter::Append(std::move(model), "pscanSettings", *file, writeOptions)->Fill();
+        }
+        {
+            auto model = rnt::RNTupleModel::Create();
+            *model->MakeField<int>("Pol") = asicSettings.getPol();
+            *model->MakeField<int>("Vref_p") = asicSettings.getVref_p();
+            *model->MakeField<int>("Vref_n") = asicSettings.getVref_n();
+            *model->MakeField<int>("Thr2_glb") = asicSettings.getThr2_glb();
+            *model->MakeField<int>("Vref_t") = asicSettings.getVref_t();
+            *model->MakeField<int>("Vref_t_range") = asicSettings.getVref_t_range();
+            rnt::RNTupleWriter::Append(std::move(model), "asicSettings", *file, writeOptions)->Fill();
+        }
+        if (fitResults.getNFilled() > 0) {
+            auto model = rnt::RNTupleModel::Create();
+            std::vector<std::shared_ptr<int>> intFields;
+            for (const auto& [name, member] : fitIntColumns) intFields.push_back(model->MakeField<int>(name));
+            std::vector<std::shared_ptr<double>> doubleFields;
+            for (const auto& [name, member] : fitDoubleColumns) doubleFields.push_back(model->MakeField<double>(name));
+            auto writer = rnt::RNTupleWriter::Append(std::move(model), "fitResults", *file, writeOptions);
+
+            for (const smxFitResult& row : fitResults.getRows()) {
+                if (!smxFitResultTable::isFilled(row)) continue;
+                for (size_t i = 0; i < intFields.size(); ++i) *intFields[i] = row.*fitIntColumns[i].second;
+                for (size_t i = 0; i < doubleFields.size(); ++i) *doubleFields[i] = row.*fitDoubleColumns[i].second;
+                writer->Fill();
+            }
+        }
+        file->Close();
+    } catch (const std::exception& e) {
+        logError("Failed to write RNTuple file " + outputName + ": " + e.what());
+        return false;
+    }
+    double seconds = secondsSince(start);
+
+    std::error_code ec;
+    double megaBytes = std::filesystem::file_size(outputName, ec) / 1e6;
+    SMX_LOG_INFO("File written successfully to: " << outputName << " (" << megaBytes << " MB in " << seconds * 1e3
+                 << " ms, RNTuple)");
+    SMX_WRITE_SUMMARY(getSummaryFileName(outputName));
+    return true;
+}
+
+bool smxPscan::isRNTupleFile(const std::string& filename) {
+    std::unique_ptr<TFile> file(TFile::Open(filename.c_str(), "READ"));
+    return file && !file->IsZombie() && file->GetKey("pscan") != nullptr;
+}
+
+TTree* smxPscan::readRNTupleFile(const std::string& filename) {
+    SMX_TIMER("readRNTupleFile");
+    std::filesystem::path filePath(filename);
+    SMX_LOG_INFO("Processing file: " << filePath.filename().string() << " at path: " << filePath.parent_path().string());
+
+    auto start = std::chrono::steady_clock::now();
+    bool hasFitResults = false;
+    {
+        std::unique_ptr<TFile> file(TFile::Open(filename.c_str(), "READ"));
+        if (!file || file->IsZombie()) {
+            logError("Failed to open file: " + filename);
+            return pscanTree;
+        }
+        hasFitResults = file->GetKey("fitResults") != nullptr;
+    }
+
+    clearDataSetCache();
+    binaryFile.reset();
+    pscanTree->Reset();
+    try {
+        auto settingsReader = rnt::RNTupleReader::Open("pscanSettings", filename);
+        if (settingsReader->GetNEntries() == 0) {
+            logError("No scan settings in " + filename);
+            return pscanTree;
+        }
+        asciiFileName = settingsReader->GetView<std::string>("sourceName")(0);
+        if (asciiFileName.empty()) asciiFileName = filePath.filename().string();
+        asciiFileAddress = filePath.parent_path().string();
+        outputSuffix = "_refit"; // the default <source>_output.root may be the input itself
+        channelSubset = false;
+        readTime = static_cast<std::time_t>(settingsReader->GetView<std::int64_t>("readTime")(0));
+        nPulses = settingsReader->GetView<int>("nPulses")(0);
+        asicId = settingsReader->GetView<std::string>("asicId")(0);
+        readDiscList = settingsReader->GetView<std::vector<int>>("readDiscList")(0);
+        vpMin = settingsReader->GetView<int>("vpMin")(0);
+        vpMax = settingsReader->GetView<int>("vpMax")(0);
+        vpStep = std::max(1, settingsReader->GetView<int>("vpStep")(0));
+
+        auto asicReader = rnt::RNTupleReader::Open("asicSettings", filename);
+        if (asicReader->GetNEntries() > 0) {
+            asicSettings = smxAsicSettings(asicReader->GetView<int>("Pol")(0), asicReader->GetView<int>("Vref_p")(0),
+                                           asicReader->GetView<int>("Vref_n")(0), asicReader->GetView<int>("Thr2_glb")(0),
+                                           asicReader->GetView<int>("Vref_t")(0), asicReader->GetView<int>("Vref_t_range")(0));
+        }
+
+        // Only the columns are read, the entries go straight into the count cube
+        auto dataReader = rnt::RNTupleReader::Open("pscan", filename);
+        auto pulseView = dataReader->GetView<int>("pulse");
+        auto channelView = dataReader->GetView<int>("channel");
+        std::vector<decltype(dataReader->GetView<std::uint16_t>(""))> adcViews;
+        for (int disc : readDiscList) {
+            adcViews.push_back(dataReader->GetView<std::uint16_t>(adcColumnName(disc)));
+        }
+        allocateCountCube();
+        std::vector<int> values(readDiscList.size());
+        for (auto entry : dataReader->GetEntryRange()) {
+            for (size_t j = 0; j < adcViews.size(); ++j) {
+                values[j] = adcViews[j](entry);
+            }
+            fillCountCube(pulseView(entry), channelView(entry), values.data(), static_cast<int>(values.size()));
+        }
+        finalizeCountCube();
+
+        fitResults.reset(readDiscList);
+        if (hasFitResults) {
+            auto fitReader = rnt::RNTupleReader::Open("fitResults", filename);
+            std::vector<std::pair<int smxFitResult::*, decltype(fitReader->GetView<int>(""))>> intViews;
+            for (const auto& [name, member] : fitIntColumns) {
+                try {
+                    intViews.emplace_back(member, fitReader->GetView<int>(name));
+                } catch (const std::exception&) {
+                    // Columns added later, like label, are missing in older files
+                }
+            }
+            std::vector<decltype(fitReader->GetView<double>(""))> doubleViews;
+            for (const auto& [name, member] : fitDoubleColumns) doubleViews.push_back(fitReader->GetView<double>(name));
+
+            smxFitResult row;
+            for (auto entry : fitReader->GetEntryRange()) {
+                for (auto& [member, view] : intViews) row.*member = view(entry);
+                for (size_t i = 0; i < doubleViews.size(); ++i) row.*fitDoubleColumns[i].second = doubleViews[i](entry);
+                if (!fitResults.set(row)) {
+                    SMX_LOG_WARNING("Fit result of channel " << row.channel << " comparator " << row.comparator
+                                    << " does not belong to the scan, skipped.");
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        logError("Failed to read RNTuple file " + filename + ": " + e.what());
+        countCube.clear();
+        nVp = 0;
+        vpStride = 0;
+        return pscanTree;
+    }
+
+    double seconds = secondsSince(start);
+    SMX_LOG_INFO("Read " << countCube.size() << " counts and " << fitResults.getNFilled() << " fit results of "
+                 << asicId << " in " << seconds * 1e3 << " ms");
+    SMX_LOG_INFO("Count cube: " << smxNCh << " channels x " << readDiscList.size() << " discriminators x "
+                 << nVp << " pulses");
+    return pscanTree;
+}
+
+void smxPscan::measureReadThroughput(const std::string& filename, int repeats) {
+    std::error_code ec;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(ec);
+    std::string treeFile = (directory / "smx_read_ttree.root").string();
+    std::string ntupleFile = (directory / "smx_read_rntuple.root").string();
+
+    smxPscan source;
+    source.readAsciiFile(filename);
+    if (source.getNVp() == 0) return;
+    smxRootOutputOptions options;
+    options.fileName = treeFile;
+    source.setOutputOptions(options);
+    source.writeRootFile();
+    options.format = smxOutputFormat::RNTuple;
+    options.fileName = ntupleFile;
+    source.setOutputOptions(options);
+    source.writeRootFile();
+
+    struct Row {
+        std::string label;
+        double megaBytes;
+        double seconds = 0;
+        uint64_t entries = 0;
+    };
+    Row treeRow{"TTree branches", std::filesystem::file_size(treeFile, ec) / 1e6};
+    Row ntupleRow{"RNTuple columns", std::filesystem::file_size(ntupleFile, ec) / 1e6};
+    Row loaderRow{"readRNTupleFile", ntupleRow.megaBytes};
+    uint64_t treeSum = 0;
+    uint64_t ntupleSum = 0;
+    bool identical = true;
+
+    smxLogLevel level = smxLog::getLevel();
+    smxLog::setLevel(smxLogLevel::Warning); // the loader reports every file
+    for (int repeat = 0; repeat < repeats; ++repeat) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::unique_ptr<TFile> file(TFile::Open(treeFile.c_str(), "READ"));
+            TTree* tree = file ? file->Get<TTree>("pscanTree") : nullptr;
+            if (!tree) break;
+            int pulse = 0, channel = 0, tcomp = 0;
+            int adc[smxNAdc] = {0};
+            tree->SetBranchAddress("pulse", &pulse);
+            tree->SetBranchAddress("channel", &channel);
+            tree->SetBranchAddress("ADC", adc);
+            tree->SetBranchAddress("tcomp", &tcomp);
+            treeSum = 0;
+            for (Long64_t i = 0; i < tree->GetEntries(); ++i) {
+                tree->GetEntry(i);
+                for (int disc : source.readDiscList) {
+                    if (disc < smxNAdc) treeSum += adc[disc];
+                }
+            }
+            treeRow.entries += tree->GetEntries();
+        }
+        treeRow.seconds += secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        try {
+            auto reader = rnt::RNTupleReader::Open("pscan", ntupleFile);
+            auto pulseView = reader->GetView<int>("pulse");
+            auto channelView = reader->GetView<int>("channel");
+            std::vector<decltype(reader->GetView<std::uint16_t>(""))> adcViews;
+            for (int disc : source.readDiscList) {
+                adcViews.push_back(reader->GetView<std::uint16_t>(adcColumnName(disc)));
+            }
+            ntupleSum = 0;
+            for (auto entry : reader->GetEntryRange()) {
+                // All columns are read like all branches of the tree, the checksum covers the ADC ones
+                pulseView(entry);
+                channelView(entry);
+                for (size_t j = 0; j < adcViews.size(); ++j) {
+                    uint16_t count = adcViews[j](entry);
+                    if (source.readDiscList[j] < smxNAdc) ntupleSum += count;
+                }
+            }
+            ntupleRow.entries += reader->GetNEntries();
+        } catch (const std::exception& e) {
+            SMX_LOG_ERROR("Failed to read " << ntupleFile << ": " << e.what());
+            break;
+        }
+        ntupleRow.seconds += secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        smxPscan loaded;
+        loaded.readRNTupleFile(ntupleFile);
+        loaderRow.seconds += secondsSince(start);
+        loaderRow.entries += static_cast<uint64_t>(loaded.getNVp()) * smxNCh;
+        std::span<const uint16_t> original = source.cubeCounts();
+        std::span<const uint16_t> restored = loaded.cubeCounts();
+        identical = identical && std::equal(original.begin(), original.end(), restored.begin(), restored.end());
+    }
+    smxLog::setLevel(level);
+    std::filesystem::remove(treeFile, ec);
+    std::filesystem::remove(ntupleFile, ec);
+    std::filesystem::remove(source.getSummaryFileName(treeFile), ec);
+    std::filesystem::remove(source.getSummaryFileName(ntupleFile), ec);
+
+    SMX_LOG_INFO("Read path                 size MB   mean ms   Mentries/s   MB/s (of the file)");
+    for (const Row& row : {treeRow, ntupleRow, loaderRow}) {
+        double mean = repeats > 0 ? row.seconds / repeats : 0.;
+        SMX_LOG_INFO(std::left << std::setw(24) << row.label << std::right
+                     << std::setw(10) << row.megaBytes << std::setw(10) << mean * 1e3
+                     << std::setw(13) << (row.seconds > 0 ? row.entries / row.seconds / 1e6 : 0.)
+                     << std::setw(10) << (mean > 0 ? row.megaBytes / mean : 0.));
+    }
+    if (treeSum != ntupleSum || !identical) {
+        SMX_LOG_ERROR("The layouts read back different counts.");
+    }
+}
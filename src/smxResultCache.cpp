@@ -0,0 +1,229 @@
+#include "smxResultCache.h"
+#include "smxConstants.h"
+#include "smxMappedFile.h"
+#include "smxPscan.h"
+#include "smxLog.h"
+#include <RooRealVar.h>
+#include <RooCategory.h>
+#include <RooArgSet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+// Header of a cached fit result array
+struct FitsHeader {
+    char magic[8];          // "SMXFITS"
+    uint32_t version;       // 1
+    uint32_t recordSize;    // sizeof(smxFitResult) of the writer
+    uint64_t count;         // number of results
+};
+
+constexpr char fitsMagic[8] = {'S', 'M', 'X', 'F', 'I', 'T', 'S', '\0'};
+
+// Temporary name next to the final entry, unique per process
+std::string temporaryPath(const std::string& path) {
+    return path + ".tmp." + std::to_string(::getpid());
+}
+
+bool isEntry(const std::filesystem::directory_entry& entry) {
+    std::string extension = entry.path().extension().string();
+    return entry.is_regular_file() && (extension == ".pscan" || extension == ".fits");
+}
+
+} // namespace
+
+smxResultCache::smxResultCache(const std::string& cacheDirectory, uint64_t maxMegaBytes)
+    : directory(cacheDirectory.empty() ? defaultDirectory() : cacheDirectory),
+      maxBytes(maxMegaBytes * 1024 * 1024) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        SMX_LOG_ERROR("Failed to create cache directory " << directory << ": " << ec.message());
+    }
+    currentBytes = directorySize();
+}
+
+std::string smxResultCache::defaultDirectory() {
+    if (const char* env = std::getenv("SMX_CACHE_DIR")) return env;
+    if (const char* home = std::getenv("HOME")) return std::string(home) + "/.cache/smx_pscan";
+    return "/tmp/smx_pscan_cache";
+}
+
+uint64_t smxResultCache::scanKey(const std::string& filename) {
+    smxMappedFile file(filename);
+    if (!file.isOpen()) return 0;
+    smxHash hash;
+    hash.add("scan").add(smxLibVersion);
+    hash.add(std::filesystem::path(filename).filename().string()); // the name carries settings and time
+    hash.add(file.data(), file.size());
+    return hash.value();
+}
+
+void smxResultCache::addDataSet(smxHash& hash, RooDataSet* dataset) {
+    if (!dataset) {
+        hash.add(-1);
+        return;
+    }
+    const RooArgSet* row = dataset->get();
+    auto* pulseAmp = dynamic_cast<RooRealVar*>(row->find("pulseAmp"));
+    auto* countNorm = dynamic_cast<RooRealVar*>(row->find("countNorm"));
+    auto* adcComp = dynamic_cast<RooCategory*>(row->find("adcComp"));
+    hash.add(dataset->numEntries());
+    if (!pulseAmp || !countNorm || !adcComp) return;
+
+    for (int i = 0; i < dataset->numEntries(); ++i) {
+        dataset->get(i);
+        hash.add(pulseAmp->getVal()).add(countNorm->getVal());
+        hash.add(countNorm->getAsymErrorLo()).add(countNorm->getAsymErrorHi());
+        hash.add(adcComp->getIndex());
+    }
+}
+
+std::string smxResultCache::entryPath(uint64_t key, const char* extension) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return directory + "/" + name + extension;
+}
+
+bool smxResultCache::lookup(const std::string& path) {
+    std::error_code ec;
+    bool found = std::filesystem::is_regular_file(path, ec);
+    if (found) {
+        // Mark as recently used for the eviction order
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    (found ? hits : misses)++;
+    return found;
+}
+
+void smxResultCache::commit(const std::string& path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    std::lock_guard<std::mutex> lock(mutex);
+    stores++;
+    currentBytes += ec ? 0 : size;
+    if (currentBytes <= maxBytes) return;
+
+    // Delete the least recently used entries down to 90% of the limit
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (isEntry(entry)) entries.emplace_back(entry.last_write_time(ec), entry.path());
+    }
+    std::sort(entries.begin(), entries.end());
+    currentBytes = directorySize();
+    for (const auto& [time, entryPath] : entries) {
+        if (currentBytes <= maxBytes / 10 * 9) break;
+        uint64_t entrySize = std::filesystem::file_size(entryPath, ec);
+        if (!ec && std::filesystem::remove(entryPath, ec)) {
+            currentBytes -= std::min(currentBytes, entrySize);
+            evictions++;
+        }
+    }
+}
+
+uint64_t smxResultCache::directorySize() const {
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (isEntry(entry)) total += entry.file_size(ec);
+    }
+    return total;
+}
+
+std::string smxResultCache::lookupScan(uint64_t key) {
+    if (key == 0) return "";
+    std::string path = entryPath(key, ".pscan");
+    return lookup(path) ? path : "";
+}
+
+bool smxResultCache::storeScan(uint64_t key, const smxPscan& pscan) {
+    if (key == 0) return false;
+    std::string path = entryPath(key, ".pscan");
+    std::string temporary = temporaryPath(path);
+    std::error_code ec;
+    if (!pscan.writeBinaryFile(temporary) || (std::filesystem::rename(temporary, path, ec), ec)) {
+        std::filesystem::remove(temporary, ec);
+        SMX_LOG_ERROR("Failed to store scan in the cache: " << path);
+        return false;
+    }
+    commit(path);
+    return true;
+}
+
+bool smxResultCache::loadFits(uint64_t key, std::vector<smxFitResult>& results) {
+    std::string path = entryPath(key, ".fits");
+    if (!lookup(path)) return false;
+
+    std::ifstream in(path, std::ios::binary);
+    FitsHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, fitsMagic, sizeof(fitsMagic)) != 0 ||
+        header.version != 1 || header.recordSize != sizeof(smxFitResult)) {
+        SMX_LOG_ERROR("Invalid fit results in the cache: " << path);
+        return false;
+    }
+    std::vector<smxFitResult> cached(header.count);
+    in.read(reinterpret_cast<char*>(cached.data()), cached.size() * sizeof(smxFitResult));
+    if (!in) {
+        SMX_LOG_ERROR("Truncated fit results in the cache: " << path);
+        return false;
+    }
+    results = std::move(cached);
+    return true;
+}
+
+bool smxResultCache::storeFits(uint64_t key, const std::vector<smxFitResult>& results) {
+    std::string path = entryPath(key, ".fits");
+    std::string temporary = temporaryPath(path);
+    {
+        FitsHeader header;
+        std::memcpy(header.magic, fitsMagic, sizeof(fitsMagic));
+        header.version = 1;
+        header.recordSize = sizeof(smxFitResult);
+        header.count = results.size();
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(results.data()), results.size() * sizeof(smxFitResult));
+        if (!out) {
+            SMX_LOG_ERROR("Failed to store fit results in the cache: " << path);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) {
+        std::filesystem::remove(temporary, ec);
+        SMX_LOG_ERROR("Failed to store fit results in the cache: " << path);
+        return false;
+    }
+    commit(path);
+    return true;
+}
+
+long smxResultCache::getHits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+long smxResultCache::getMisses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
+
+long smxResultCache::getEvictions() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return evictions;
+}
+
+void smxResultCache::printStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    SMX_LOG_INFO("Result cache " << directory << ": " << hits << " hits, " << misses << " misses, "
+                 << stores << " stores, " << evictions << " evictions, "
+                 << currentBytes / 1048576. << " of " << maxBytes / 1048576. << " MB used.");
+}
@@ -1,8 +1,16 @@
 #include "smxScurveFit.h"
 #include "smxConstants.h"
+#include "smxErfcFitter.h"
+#include "smxErfcSimFitter.h"
+#include "smxErfcModel.h"
+#include "smxResultCache.h"
+#include "smxInstrument.h"
+#include "smxLog.h"
 #include <RooPlot.h>
 #include <RooArgSet.h>
 #include <RooMinimizer.h>
+#include <RooAddition.h>
+#include <RVersion.h>
 #include <TGaxis.h>
 #include <TCanvas.h>
 #include <TMath.h>
@@ -10,6 +18,9 @@
 #include <TPaveText.h>
 #include "TROOT.h" // Include general ROOT functionality
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
 
 smxScurveFit::smxScurveFit(RooDataSet* dataset, int ch, int comp)
     : data(dataset),
@@ -22,22 +33,27 @@ smxScurveFit::smxScurveFit(RooDataSet* dataset, int ch, int comp)
       offset(nullptr),
       threshold(nullptr),
       sigma(nullptr),
-      fitModel(nullptr),
-      fitResults(nullptr) {
+      fitModel(nullptr) {
     if (!data) {
-        std::cerr << "Error: Null dataset passed to smxScurveFit constructor!" << std::endl;
+        SMX_LOG_ERROR("Null dataset passed to smxScurveFit constructor!");
         return;
     }
 
     // Initialize variables and the fit model
     initializeVariables();
     setupFitModel();
+    partitionData();
 }
 
 
 smxScurveFit::~smxScurveFit() {
+    for (ComparatorPartition& partition : partitions) {
+        delete partition.dataSet;
+    }
     delete fitModel;
-    delete fitResults;
+    delete offset;
+    delete threshold;
+    delete sigma;
 }
 
 void smxScurveFit::initializeVariables() {
@@ -48,7 +64,7 @@ void smxScurveFit::initializeVariables() {
     adcComp = dynamic_cast<RooCategory*>(data->get()->find("adcComp"));
 
     if (!pulseAmp || !countN || !countNorm || !adcComp) {
-        std::cerr << "Error: Required variables not found in dataset!" << std::endl;
+        SMX_LOG_ERROR("Required variables not found in dataset!");
         return;
     }
 
@@ -65,76 +81,619 @@ void smxScurveFit::initializeVariables() {
     sigma = new RooRealVar("sigma", "Sigma", 1.0, .1, 15.0);
 }
 
+void smxScurveFit::resetParameters() {
+    offset->setRange(-1., .5);
+    offset->setVal(0);
+    threshold->setRange(-1.0, 256.0);
+    threshold->setVal(60.0);
+    sigma->setRange(.1, 15.0);
+    sigma->setVal(1.0);
+}
+
+bool smxScurveFit::seedParameters(int selectedDisc) {
+    const ComparatorPartition* partition = getPartition(selectedDisc);
+    if (!partition) {
+        return false;
+    }
+
+    smxErfcFitter fitter;
+    fitter.setData(partition->x.data(), partition->y.data(), partition->yErrLo.data(), partition->yErrHi.data(),
+                   partition->x.size());
+    fitter.setLimits(smxErfcFitter::kOffset, offset->getMin(), offset->getMax());
+    fitter.setLimits(smxErfcFitter::kThreshold, threshold->getMin(), threshold->getMax());
+    fitter.setLimits(smxErfcFitter::kSigma, sigma->getMin(), sigma->getMax());
+    if (!fitter.seedFromMoments()) {
+        return false;
+    }
+
+    sigma->setRange(fitter.getLower(smxErfcFitter::kSigma), fitter.getUpper(smxErfcFitter::kSigma));
+    sigma->setVal(fitter.getStart(smxErfcFitter::kSigma));
+    threshold->setRange(fitter.getLower(smxErfcFitter::kThreshold), fitter.getUpper(smxErfcFitter::kThreshold));
+    threshold->setVal(fitter.getStart(smxErfcFitter::kThreshold));
+    offset->setVal(fitter.getStart(smxErfcFitter::kOffset));
+    return true;
+}
+
+bool smxScurveFit::warmStartParameters(int selectedDisc) {
+    auto converged = [](const smxFitResult& result) { return result.status >= 0 && result.status <= 1; };
+    double offsetStart, thresholdStart, sigmaStart;
+    auto start = std::find_if(startValues.begin(), startValues.end(), [&](const smxFitResult& result) {
+        return result.comparator == selectedDisc && converged(result);
+    });
+    if (start != startValues.end()) {
+        offsetStart = start->offset;
+        thresholdStart = start->threshold;
+        sigmaStart = start->sigma;
+    } else {
+        if (!startValues.empty()) {
+            // Neighbouring channel or previous scan without a converged fit of this comparator
+            SMX_COUNT("warmStartFallbacks", 1);
+            SMX_LOG_DEBUG("No converged start value for comparator " << selectedDisc << " of channel " << channel
+                          << ", extrapolating from the previous comparators.");
+        }
+        // The thresholds of neighbouring comparators lie on a line in the comparator number
+        const smxFitResult* last = nullptr;
+        const smxFitResult* beforeLast = nullptr;
+        for (auto it = results.rbegin(); it != results.rend() && !beforeLast; ++it) {
+            if (!converged(*it)) continue;
+            if (last) {
+                beforeLast = &*it;
+            } else {
+                last = &*it;
+            }
+        }
+        if (!last) return false;
+        offsetStart = last->offset;
+        thresholdStart = last->threshold;
+        sigmaStart = last->sigma;
+        if (beforeLast && beforeLast->comparator != last->comparator) {
+            double slope = (last->threshold - beforeLast->threshold) / (last->comparator - beforeLast->comparator);
+            thresholdStart += slope * (selectedDisc - last->comparator);
+        }
+    }
+
+    offset->setVal(std::clamp(offsetStart, offset->getMin(), offset->getMax()));
+    threshold->setVal(std::clamp(thresholdStart, threshold->getMin(), threshold->getMax()));
+    sigma->setVal(std::clamp(sigmaStart, sigma->getMin(), sigma->getMax()));
+    return true;
+}
+
+void smxScurveFit::partitionData() {
+    for (ComparatorPartition& partition : partitions) {
+        delete partition.dataSet;
+    }
+    partitions.assign(readDiscList.size(), ComparatorPartition());
+    if (!pulseAmp || !countNorm || !adcComp) return;
+
+    // Position of every comparator in readDiscList, found without evaluating a cut per entry
+    std::vector<int> position;
+    for (size_t j = 0; j < readDiscList.size(); ++j) {
+        int disc = readDiscList[j];
+        if (disc < 0) continue;
+        if (static_cast<size_t>(disc) >= position.size()) position.resize(disc + 1, -1);
+        position[disc] = static_cast<int>(j);
+    }
+
+    for (int i = 0; i < data->numEntries(); ++i) {
+        data->get(i);
+        int disc = adcComp->getIndex();
+        if (disc < 0 || static_cast<size_t>(disc) >= position.size() || position[disc] < 0) continue;
+        ComparatorPartition& partition = partitions[position[disc]];
+        partition.x.push_back(pulseAmp->getVal());
+        partition.y.push_back(countNorm->getVal());
+        partition.yErrLo.push_back(countNorm->getAsymErrorLo());
+        partition.yErrHi.push_back(countNorm->getAsymErrorHi());
+    }
+    applyFitWindow();
+}
+
+void smxScurveFit::applyFitWindow() {
+    droppedPoints = 0;
+    if (fitWindowMargin < 0) return;
+
+    for (ComparatorPartition& partition : partitions) {
+        const size_t n = partition.x.size();
+        if (n < 3 || !std::is_sorted(partition.x.begin(), partition.x.end())) continue;
+
+        // Plateaus: the runs of points equal to the first and to the last point
+        constexpr double tolerance = 1e-9;
+        size_t first = 0;
+        while (first < n && std::fabs(partition.y[first] - partition.y.front()) <= tolerance) ++first;
+        if (first == n) continue; // flat curve, nothing to fit against
+        size_t last = n - 1;
+        while (last > first && std::fabs(partition.y[last] - partition.y.back()) <= tolerance) --last;
+
+        size_t margin = static_cast<size_t>(fitWindowMargin);
+        size_t begin = first > margin ? first - margin : 0;
+        size_t end = std::min(n, last + 1 + margin);
+        if (begin == 0 && end == n) continue;
+
+        for (std::vector<double>* values : {&partition.x, &partition.y, &partition.yErrLo, &partition.yErrHi}) {
+            values->erase(values->begin() + end, values->end());
+            values->erase(values->begin(), values->begin() + begin);
+        }
+        droppedPoints += static_cast<int>(n - (end - begin));
+    }
+    SMX_COUNT("fitWindowDroppedPoints", droppedPoints);
+}
+
+const smxScurveFit::ComparatorPartition* smxScurveFit::getPartition(int selectedDisc) const {
+    auto it = std::find(readDiscList.begin(), readDiscList.end(), selectedDisc);
+    if (it == readDiscList.end() || partitions.size() != readDiscList.size()) return nullptr;
+    return &partitions[it - readDiscList.begin()];
+}
+
+RooDataSet* smxScurveFit::getPartitionDataSet(int selectedDisc) {
+    if (!getPartition(selectedDisc)) return nullptr;
+    auto it = std::find(readDiscList.begin(), readDiscList.end(), selectedDisc);
+    ComparatorPartition* partition = &partitions[it - readDiscList.begin()];
+    if (partition->dataSet) return partition->dataSet;
+
+    // Only the columns the chi2 fit reads; the values go through the dataset's own variables
+    RooArgSet variables(*pulseAmp, *countNorm);
+    partition->dataSet = new RooDataSet(Form("%s_comp%02d", data->GetName(), selectedDisc), "Comparator data",
+                                        variables, RooFit::StoreAsymError(RooArgSet(*countNorm)));
+    for (size_t i = 0; i < partition->x.size(); ++i) {
+        pulseAmp->setVal(partition->x[i]);
+        countNorm->setVal(partition->y[i]);
+        countNorm->setAsymError(partition->yErrLo[i], partition->yErrHi[i]);
+        partition->dataSet->add(variables);
+    }
+    return partition->dataSet;
+}
+
+namespace {
+
+// Copies value and errors of a fitted parameter, symmetric errors are used if MINOS did not run
+void storeParameter(const RooRealVar* var, double& value, double& errLo, double& errHi) {
+    value = var->getVal();
+    if (var->hasAsymError()) {
+        errLo = var->getAsymErrorLo();
+        errHi = var->getAsymErrorHi();
+    } else {
+        errLo = -var->getError();
+        errHi = var->getError();
+    }
+}
+
+// RooFit evaluation backend of the fits; ROOT before 6.30 has only its built-in one
+RooCmdArg evalBackendArg(smxEvalBackend backend) {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 30, 0)
+    switch (backend) {
+        case smxEvalBackend::Legacy: return RooFit::EvalBackend("legacy");
+        case smxEvalBackend::Codegen: return RooFit::EvalBackend("codegen");
+        default: return RooFit::EvalBackend("cpu");
+    }
+#else
+    (void)backend;
+    return RooCmdArg::none();
+#endif
+}
+
+} // namespace
+
 void smxScurveFit::setupFitModel() {
     // Create the error function model
-    fitModel = new RooFormulaVar(
-        "fitModel",
-        "offset + 0.5 * TMath::Erfc((threshold - pulseAmp) / (TMath::Sqrt(2) * sigma))",
-        RooArgList(*pulseAmp, *offset, *threshold, *sigma)
-    );
+    delete fitModel;
+    fitModel = createModel("fitModel", *offset, *threshold, *sigma);
+}
+
+RooAbsReal* smxScurveFit::createModel(const char* name, RooAbsReal& offsetVar, RooAbsReal& thresholdVar,
+                                      RooAbsReal& sigmaVar) const {
+    if (evalBackend != smxEvalBackend::Codegen) {
+        return new smxErfcModel(name, "S-curve model", *pulseAmp, offsetVar, thresholdVar, sigmaVar);
+    }
+    // The codegen backend translates the formula, smxErfcModel has no code generation
+    return new RooFormulaVar(name, "@1 + 0.5 * TMath::Erfc((@2 - @0) / (TMath::Sqrt(2) * @3))",
+                             RooArgList(*pulseAmp, offsetVar, thresholdVar, sigmaVar));
 }
 
 double smxScurveFit::fitScurvesSeq() {
+    SMX_TIMER("fitScurvesSeq");
     if (!data || !fitModel) {
-        std::cerr << "Error: Dataset or model not initialized for fitting!" << std::endl;
+        SMX_LOG_ERROR("Dataset or model not initialized for fitting!");
         return -1.0;
     }
 
-    RooArgSet variables(*offset, *threshold, *sigma, *adcComp);
-    RooDataSet* fitResults = new RooDataSet("fitResults", "Fit results", variables, RooFit::StoreAsymError(variables));
     double totalChi2 = 0.0; // To accumulate chi2 values across all comparators
-    int maxRetries = 5;
+    results.clear();
 
-    for (int selectedDisc : readDiscList) {
-        std::cout << "Fitting for comparator: " << selectedDisc << std::endl;
+    // Unchanged data fitted with the same configuration is taken from the cache
+    uint64_t key = resultCache ? cacheKey() : 0;
+    if (resultCache && resultCache->loadFits(key, results)) {
+        for (const smxFitResult& fitResult : results) {
+            if (fitResult.status >= 0 && fitResult.status <= 1) totalChi2 += fitResult.chi2;
+        }
+        if (!results.empty()) applyResult(results.back());
+        SMX_COUNT("cachedFits", results.size());
+        SMX_LOG_DEBUG("Fit results of channel " << channel << " taken from the result cache, total Chi2: " << totalChi2);
+        return totalChi2;
+    }
 
-        RooDataSet* dataReduced = dynamic_cast<RooDataSet*>(data->reduce(Form("adcComp==%d", selectedDisc)));
-        if (!dataReduced) {
-            std::cerr << "Error: Failed to reduce dataset for comparator " << selectedDisc << "!" << std::endl;
-            continue;
+    std::vector<int> fitDiscs;
+    for (int disc : readDiscList) {
+        if (std::find(skippedComparators.begin(), skippedComparators.end(), disc) == skippedComparators.end()) {
+            fitDiscs.push_back(disc);
+        }
+    }
+    SMX_COUNT("skippedFits", readDiscList.size() - fitDiscs.size());
+
+    // All comparators of the channel in one minimization, independent fits if that fails
+    bool fitted = false;
+    std::vector<int> simDiscs;
+    if (fitMode != smxFitMode::Independent && comparator < 0) {
+        // Comparators without points (e.g. the tcomp) take no part and keep status -1
+        for (int disc : fitDiscs) {
+            const ComparatorPartition* partition = getPartition(disc);
+            if (partition && !partition->x.empty()) simDiscs.push_back(disc);
         }
+    }
+    if (simDiscs.size() > 1) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<smxFitResult> simResults = (backend == smxFitBackend::Native) ? fitSimultaneousNative(simDiscs)
+                                                                                 : fitSimultaneousRooFit(simDiscs);
+        double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!simResults.empty() && simResults.front().status >= 0 && simResults.front().status <= 1) {
+            auto simResult = simResults.begin();
+            for (int disc : fitDiscs) {
+                if (simResult != simResults.end() && simResult->comparator == disc) {
+                    simResult->wallTime = wallTime / simResults.size();
+                    totalChi2 += simResult->chi2;
+                    results.push_back(*simResult++);
+                } else {
+                    smxFitResult emptyResult;
+                    emptyResult.channel = channel;
+                    emptyResult.comparator = disc;
+                    results.push_back(emptyResult);
+                }
+            }
+            fitted = true;
+            SMX_COUNT("fits", simResults.size());
+            SMX_COUNT("simultaneousFits", 1);
+        } else {
+            SMX_COUNT("simultaneousFallbacks", 1);
+            SMX_LOG_DEBUG("Simultaneous fit of channel " << channel << " failed, fitting the comparators independently.");
+        }
+    }
+
+    for (int selectedDisc : fitDiscs) {
+        if (fitted) break;
+        if (comparator >= 0 && selectedDisc != comparator) continue;
+        SMX_LOG_DEBUG("Fitting for comparator: " << selectedDisc);
+
+        auto start = std::chrono::steady_clock::now();
+        resetParameters();
+        bool warm = warmStart && warmStartParameters(selectedDisc);
+        if (!warm && momentSeeding) seedParameters(selectedDisc);
+        smxFitResult fitResult = (backend == smxFitBackend::Native) ? fitComparatorNative(selectedDisc)
+                                                                    : fitComparatorRooFit(selectedDisc);
+        if (warm) {
+            SMX_COUNT("warmStarts", 1);
+            if (fitResult.status < 0 || fitResult.status > 1) {
+                // Repeat from the seeds, counting the attempts and iterations of both
+                SMX_COUNT("warmStartRefits", 1);
+                SMX_LOG_DEBUG("Warm-started fit of comparator " << selectedDisc << " failed, refitting from the seeds.");
+                resetParameters();
+                if (momentSeeding) seedParameters(selectedDisc);
+                smxFitResult warmResult = fitResult;
+                fitResult = (backend == smxFitBackend::Native) ? fitComparatorNative(selectedDisc)
+                                                               : fitComparatorRooFit(selectedDisc);
+                fitResult.retries += warmResult.retries;
+                fitResult.iterations += warmResult.iterations;
+            }
+        }
+        fitResult.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        results.push_back(fitResult);
+        SMX_COUNT("fits", 1);
 
-        RooFitResult* result = nullptr;
-        int retryCount = 0;
+        if (fitResult.status >= 0 && fitResult.status <= 1) {
+            totalChi2 += fitResult.chi2; // Accumulate chi2
+        } else {
+            SMX_COUNT("failedFits", 1);
+            SMX_LOG_WARNING("Fit failed for comparator " << selectedDisc << " after " << fitResult.retries << " retries!");
+        }
+    }
+
+    if (resultCache) {
+        resultCache->storeFits(key, results);
+    }
+    SMX_LOG_DEBUG("Total Chi2: " << totalChi2);
+    return totalChi2;
+}
+
+uint64_t smxScurveFit::cacheKey() const {
+    smxHash hash;
+    hash.add("fitScurvesSeq").add(smxLibVersion);
+    hash.add(channel).add(comparator).add(static_cast<int>(backend)).add(momentSeeding).add(static_cast<int>(fitMode))
+        .add(static_cast<int>(evalBackend)).add(fitWindowMargin);
+    for (int disc : readDiscList) hash.add(disc);
+    for (int disc : skippedComparators) hash.add(-1 - disc);
+    hash.add(warmStart);
+    for (const smxFitResult& start : startValues) {
+        hash.add(start.comparator).add(start.status).add(start.offset).add(start.threshold).add(start.sigma);
+    }
+    smxResultCache::addDataSet(hash, data);
+    return hash.value();
+}
 
-        do {
-            int strategy = (retryCount == 0) ? 0 : (retryCount == 1) ? 1 : 2; // Strategy adjustment
-            std::cout << "Retry #" << retryCount << " with strategy " << strategy << "..." << std::endl;
+void smxScurveFit::setResultCache(smxResultCache* cache) {
+    resultCache = cache;
+}
 
-            result = fitModel->chi2FitTo(
-                *dataReduced,
-                RooFit::YVar(*countNorm),
-                RooFit::Save(),
-                RooFit::Strategy(strategy),
-                RooFit::PrintLevel(-1)
-            );
+smxFitResult smxScurveFit::fitComparatorRooFit(int selectedDisc) {
+    smxFitResult fitResult;
+    fitResult.channel = channel;
+    fitResult.comparator = selectedDisc;
+    int maxRetries = 5;
 
-            retryCount++;
-        } while ((result && result->status() > 1) && retryCount < maxRetries);
+    RooDataSet* comparatorData = getPartitionDataSet(selectedDisc);
+    if (!comparatorData) {
+        SMX_LOG_ERROR("No data for comparator " << selectedDisc << "!");
+        return fitResult;
+    }
 
-        if (result && result->status() <= 1) {
-            std::cout << "Fit Results for comparator " << selectedDisc << ":" << std::endl;
+    RooFitResult* result = nullptr;
+    int retryCount = 0;
+
+    do {
+        int strategy = (retryCount == 0) ? 0 : (retryCount == 1) ? 1 : 2; // Strategy adjustment
+        SMX_LOG_DEBUG("Retry #" << retryCount << " with strategy " << strategy << "...");
+
+        delete result;
+        SMX_COUNT_AT("fitsPerStrategy", strategy, 1);
+        SMX_COUNT("minimizerCalls", 1);
+        SMX_TIMER("minimize");
+        result = fitModel->chi2FitTo(
+            *comparatorData,
+            RooFit::YVar(*countNorm),
+            RooFit::Save(),
+            RooFit::Strategy(strategy),
+            RooFit::PrintLevel(-1),
+            evalBackendArg(evalBackend)
+        );
+
+        retryCount++;
+    } while ((result && result->status() > 1) && retryCount < maxRetries);
+
+    fitResult.retries = retryCount;
+    if (result) {
+        storeParameter(offset, fitResult.offset, fitResult.offsetErrLo, fitResult.offsetErrHi);
+        storeParameter(threshold, fitResult.threshold, fitResult.thresholdErrLo, fitResult.thresholdErrHi);
+        storeParameter(sigma, fitResult.sigma, fitResult.sigmaErrLo, fitResult.sigmaErrHi);
+        fitResult.chi2 = result->minNll();
+        fitResult.status = result->status();
+
+        if (result->status() <= 1 && SMX_LOG_ENABLED(Debug)) {
+            SMX_LOG_DEBUG("Fit Results for comparator " << selectedDisc << ":");
+            smxLog::flush(); // RooFit prints directly to std::cout
             result->Print("v");
-            fitResults->add(variables);
-            totalChi2 += result->minNll(); // Accumulate chi2
-            delete result; // Clean up after each fit
+        }
+        delete result; // Clean up after each fit
+    }
+
+    return fitResult;
+}
+
+std::vector<smxScurveFit::ComparatorSeed> smxScurveFit::seedComparators(const std::vector<int>& discs, double& sigmaStart,
+                                                                        double& sigmaLow, double& sigmaHigh) {
+    std::vector<ComparatorSeed> seeds;
+    std::vector<double> sigmas;
+    for (int selectedDisc : discs) {
+        resetParameters();
+        if (momentSeeding) seedParameters(selectedDisc);
+        ComparatorSeed seed;
+        seed.offset = offset->getVal();
+        seed.threshold = threshold->getVal();
+        seed.thresholdLow = threshold->getMin();
+        seed.thresholdHigh = threshold->getMax();
+        seed.sigma = sigma->getVal();
+        seed.sigmaLow = sigma->getMin();
+        seed.sigmaHigh = sigma->getMax();
+        seeds.push_back(seed);
+        sigmas.push_back(seed.sigma);
+    }
+
+    // The shared sigma starts at the median and may take any value allowed for one comparator
+    std::sort(sigmas.begin(), sigmas.end());
+    sigmaStart = sigmas.empty() ? 1.0 : sigmas[sigmas.size() / 2];
+    sigmaLow = sigmaHigh = sigmaStart;
+    for (const ComparatorSeed& seed : seeds) {
+        sigmaLow = std::min(sigmaLow, seed.sigmaLow);
+        sigmaHigh = std::max(sigmaHigh, seed.sigmaHigh);
+    }
+    return seeds;
+}
+
+std::vector<smxFitResult> smxScurveFit::fitSimultaneousNative(const std::vector<int>& discs) {
+    double sigmaStart, sigmaLow, sigmaHigh;
+    std::vector<ComparatorSeed> seeds = seedComparators(discs, sigmaStart, sigmaLow, sigmaHigh);
+
+    smxErfcSimFitter fitter;
+    fitter.setThresholdModel(fitMode == smxFitMode::LinearThresholds ? smxErfcSimFitter::kLinearThresholds
+                                                                     : smxErfcSimFitter::kFreeThresholds);
+    fitter.setSigma(sigmaStart, sigmaLow, sigmaHigh);
+    fitter.setOffsetLimits(offset->getMin(), offset->getMax());
+    for (size_t j = 0; j < discs.size(); ++j) {
+        const ComparatorPartition* partition = getPartition(discs[j]);
+        if (!partition || partition->x.empty()) return {};
+        fitter.addCurve(discs[j], partition->x.data(), partition->y.data(), partition->yErrLo.data(),
+                        partition->yErrHi.data(), partition->x.size(), seeds[j].offset, seeds[j].threshold,
+                        seeds[j].thresholdLow, seeds[j].thresholdHigh);
+    }
+
+    std::vector<smxFitResult> simResults;
+    {
+        SMX_TIMER("minimize");
+        fitter.fit(simResults);
+    }
+    SMX_COUNT("minimizerCalls", 1);
+    SMX_COUNT("nativeIterations", fitter.getIterations());
+    for (size_t j = 0; j < simResults.size(); ++j) {
+        simResults[j].channel = channel;
+        simResults[j].comparator = discs[j];
+    }
+
+    // Keep the RooFit parameters in sync, e.g. for drawPlot()
+    const smxFitResult& last = simResults.back();
+    applyResult(last);
+    offset->setAsymError(last.offsetErrLo, last.offsetErrHi);
+    threshold->setAsymError(last.thresholdErrLo, last.thresholdErrHi);
+    sigma->setAsymError(last.sigmaErrLo, last.sigmaErrHi);
+
+    SMX_LOG_DEBUG("Simultaneous native fit of channel " << channel << ": status " << last.status
+                  << ", sigma " << last.sigma << " +- " << last.sigmaErrHi << ", " << fitter.getIterations() << " iterations");
+    return simResults;
+}
+
+std::vector<smxFitResult> smxScurveFit::fitSimultaneousRooFit(const std::vector<int>& discs) {
+    double sigmaStart, sigmaLow, sigmaHigh;
+    std::vector<ComparatorSeed> seeds = seedComparators(discs, sigmaStart, sigmaLow, sigmaHigh);
+    const bool linear = fitMode == smxFitMode::LinearThresholds;
+    const size_t nComp = discs.size();
+
+    std::vector<RooDataSet*> comparatorData;
+    for (int selectedDisc : discs) {
+        RooDataSet* dataSet = getPartitionDataSet(selectedDisc);
+        if (!dataSet || dataSet->numEntries() == 0) return {};
+        comparatorData.push_back(dataSet);
+    }
+    sigma->setRange(sigmaLow, sigmaHigh);
+    sigma->setVal(sigmaStart);
+
+    // Linear threshold model, started on the line through the first and last seed
+    double slopeStart = (seeds.back().threshold - seeds.front().threshold) /
+                        std::max(1, discs.back() - discs.front());
+    RooRealVar thresholdSlope("thresholdSlope", "Threshold slope", slopeStart, -256., 256.);
+    RooRealVar thresholdIntercept("thresholdIntercept", "Threshold intercept",
+                                  seeds.front().threshold - slopeStart * discs.front(), -1000., 1000.);
+
+    // One model and chi-square per comparator, sharing sigma
+    std::vector<RooRealVar*> offsets(nComp, nullptr);
+    std::vector<RooAbsReal*> thresholds(nComp, nullptr);
+    std::vector<RooAbsReal*> models(nComp, nullptr);
+    std::vector<RooAbsReal*> chi2s(nComp, nullptr);
+    RooArgList chi2List;
+    for (size_t j = 0; j < nComp; ++j) {
+        int disc = discs[j];
+        offsets[j] = new RooRealVar(Form("offset%02d", disc), "Offset", seeds[j].offset, offset->getMin(), offset->getMax());
+        if (linear) {
+            thresholds[j] = new RooFormulaVar(Form("threshold%02d", disc), Form("@0 + %d * @1", disc),
+                                              RooArgList(thresholdIntercept, thresholdSlope));
         } else {
-            std::cerr << "Fit failed for comparator " << selectedDisc << " after " << retryCount << " retries!" << std::endl;
-            delete result;
+            thresholds[j] = new RooRealVar(Form("threshold%02d", disc), "Threshold", seeds[j].threshold,
+                                           seeds[j].thresholdLow, seeds[j].thresholdHigh);
         }
+        models[j] = createModel(Form("fitModel%02d", disc), *offsets[j], *thresholds[j], *sigma);
+        chi2s[j] = models[j]->createChi2(*comparatorData[j], RooFit::YVar(*countNorm), evalBackendArg(evalBackend));
+        chi2List.add(*chi2s[j]);
+    }
+    RooAddition totalChi2("totalChi2", "Sum of the comparator chi-squares", chi2List);
 
-        delete dataReduced; // Clean up reduced dataset
+    RooFitResult* result = nullptr;
+    int maxRetries = 5;
+    int retryCount = 0;
+    do {
+        int strategy = (retryCount == 0) ? 0 : (retryCount == 1) ? 1 : 2;
+        delete result;
+        SMX_COUNT_AT("fitsPerStrategy", strategy, 1);
+        SMX_COUNT("minimizerCalls", 1);
+        SMX_TIMER("minimize");
+        RooMinimizer minimizer(totalChi2);
+        minimizer.setErrorLevel(1.0);
+        minimizer.setPrintLevel(-1);
+        minimizer.setStrategy(strategy);
+        minimizer.migrad();
+        minimizer.hesse();
+        result = minimizer.save();
+        retryCount++;
+    } while ((result && result->status() > 1) && retryCount < maxRetries);
+
+    std::vector<smxFitResult> simResults(nComp);
+    for (size_t j = 0; j < nComp && result; ++j) {
+        smxFitResult& fitResult = simResults[j];
+        fitResult.channel = channel;
+        fitResult.comparator = discs[j];
+        fitResult.retries = retryCount;
+        fitResult.status = result->status();
+        fitResult.chi2 = chi2s[j]->getVal();
+        storeParameter(offsets[j], fitResult.offset, fitResult.offsetErrLo, fitResult.offsetErrHi);
+        storeParameter(sigma, fitResult.sigma, fitResult.sigmaErrLo, fitResult.sigmaErrHi);
+        if (linear) {
+            fitResult.threshold = thresholds[j]->getVal();
+            fitResult.thresholdErrHi = thresholds[j]->getPropagatedError(*result);
+            fitResult.thresholdErrLo = -fitResult.thresholdErrHi;
+        } else {
+            storeParameter(static_cast<RooRealVar*>(thresholds[j]), fitResult.threshold, fitResult.thresholdErrLo,
+                           fitResult.thresholdErrHi);
+        }
+    }
+    if (result && result->status() <= 1 && SMX_LOG_ENABLED(Debug)) {
+        SMX_LOG_DEBUG("Simultaneous fit results of channel " << channel << ":");
+        smxLog::flush(); // RooFit prints directly to std::cout
+        result->Print("v");
+    }
+    bool saved = result != nullptr;
+    delete result;
+
+    for (size_t j = 0; j < nComp; ++j) {
+        delete chi2s[j];
+        delete models[j];
+        delete thresholds[j];
+        delete offsets[j];
     }
+    if (!saved) return {};
 
-    std::cout << "Total Chi2: " << totalChi2 << std::endl;
-    return totalChi2;
+    // Keep the RooFit parameters in sync, e.g. for drawPlot()
+    applyResult(simResults.back());
+    return simResults;
+}
+
+smxFitResult smxScurveFit::fitComparatorNative(int selectedDisc) {
+    smxFitResult fitResult;
+    fitResult.channel = channel;
+    fitResult.comparator = selectedDisc;
+
+    const ComparatorPartition* partition = getPartition(selectedDisc);
+    if (!partition) {
+        SMX_LOG_ERROR("No data for comparator " << selectedDisc << "!");
+        return fitResult;
+    }
+
+    smxErfcFitter fitter;
+    fitter.setStart(offset->getVal(), threshold->getVal(), sigma->getVal());
+    fitter.setLimits(smxErfcFitter::kOffset, offset->getMin(), offset->getMax());
+    fitter.setLimits(smxErfcFitter::kThreshold, threshold->getMin(), threshold->getMax());
+    fitter.setLimits(smxErfcFitter::kSigma, sigma->getMin(), sigma->getMax());
+    fitter.setData(partition->x.data(), partition->y.data(), partition->yErrLo.data(), partition->yErrHi.data(),
+                   partition->x.size());
+    {
+        SMX_TIMER("minimize");
+        fitter.fit(fitResult);
+    }
+    SMX_COUNT("minimizerCalls", 1);
+    SMX_COUNT("nativeIterations", fitter.getIterations());
+    fitResult.iterations = fitter.getIterations();
+
+    // Keep the RooFit parameters in sync, e.g. for drawPlot()
+    applyResult(fitResult);
+    offset->setAsymError(fitResult.offsetErrLo, fitResult.offsetErrHi);
+    threshold->setAsymError(fitResult.thresholdErrLo, fitResult.thresholdErrHi);
+    sigma->setAsymError(fitResult.sigmaErrLo, fitResult.sigmaErrHi);
+
+    SMX_LOG_DEBUG("Native fit for comparator " << selectedDisc << ": status " << fitResult.status
+                  << ", threshold " << fitResult.threshold << " (" << fitResult.thresholdErrLo << ", +" << fitResult.thresholdErrHi << ")"
+                  << ", sigma " << fitResult.sigma << " (" << fitResult.sigmaErrLo << ", +" << fitResult.sigmaErrHi << ")"
+                  << ", offset " << fitResult.offset << ", chi2 " << fitResult.chi2
+                  << ", " << fitter.getIterations() << " iterations");
+    return fitResult;
 }
 
 TCanvas* smxScurveFit::drawPlot() const {
+    SMX_TIMER("drawPlot");
     TCanvas* canvas = new TCanvas("canvas", "S-Curve Fit", 1000, 400);
 
     if (!data || !pulseAmp || !countNorm || !fitModel) {
-        std::cerr << "Error: Missing dataset, variables, or model for plotting." << std::endl;
+        SMX_LOG_ERROR("Missing dataset, variables, or model for plotting.");
 
         // Draw a dummy frame to indicate an error
         canvas->cd();
@@ -149,8 +708,7 @@ TCanvas* smxScurveFit::drawPlot() const {
     }
 
     RooPlot* frame = pulseAmp->frame(RooFit::Title(" "));
-    RooDataSet* dataReduced = dynamic_cast<RooDataSet*>(data->reduce("1"));
-    dataReduced->plotOnXY(frame, RooFit::YVar(*countNorm), RooFit::DrawOption("PZ"), RooFit::MarkerStyle(7));
+    data->plotOnXY(frame, RooFit::YVar(*countNorm), RooFit::DrawOption("PZ"), RooFit::MarkerStyle(7));
     fitModel->plotOn(frame, RooFit::LineWidth(1));
 
     // Customize axes
@@ -173,6 +731,70 @@ TCanvas* smxScurveFit::drawPlot() const {
 }
 
 
+void smxScurveFit::setFitWindow(int marginPoints) {
+    int margin = marginPoints < 0 ? -1 : marginPoints;
+    if (margin == fitWindowMargin) return;
+    fitWindowMargin = margin;
+    if (data) partitionData();
+}
+
+int smxScurveFit::getDroppedPoints() const {
+    return droppedPoints;
+}
+
+void smxScurveFit::setSkippedComparators(const std::vector<int>& comparators) {
+    skippedComparators = comparators;
+}
+
+void smxScurveFit::setWarmStart(bool enable) {
+    warmStart = enable;
+}
+
+void smxScurveFit::setStartValues(const std::vector<smxFitResult>& starts) {
+    startValues = starts;
+}
+
+void smxScurveFit::setEvalBackend(smxEvalBackend backendType) {
+    if (backendType == evalBackend) return;
+    evalBackend = backendType;
+    if (fitModel) setupFitModel();
+}
+
+smxEvalBackend smxScurveFit::getEvalBackend() const {
+    return evalBackend;
+}
+
+void smxScurveFit::setFitMode(smxFitMode mode) {
+    fitMode = mode;
+}
+
+smxFitMode smxScurveFit::getFitMode() const {
+    return fitMode;
+}
+
+void smxScurveFit::setMomentSeeding(bool enable) {
+    momentSeeding = enable;
+}
+
+void smxScurveFit::setBackend(smxFitBackend fitBackend) {
+    backend = fitBackend;
+}
+
+smxFitBackend smxScurveFit::getBackend() const {
+    return backend;
+}
+
+const std::vector<smxFitResult>& smxScurveFit::getResults() const {
+    return results;
+}
+
+void smxScurveFit::applyResult(const smxFitResult& result) {
+    if (!offset || !threshold || !sigma) return;
+    offset->setVal(result.offset);
+    threshold->setVal(result.threshold);
+    sigma->setVal(result.sigma);
+}
+
 int smxScurveFit::getChannel() const {
     return channel;
 }
@@ -0,0 +1,354 @@
+#include "smxWatchFolder.h"
+#include "smxConstants.h"
+#include "smxErfcFitter.h"
+#include "smxPipeline.h"
+#include "smxWorkStealingPool.h"
+#include "smxLog.h"
+#include <RooArgSet.h>
+#include <RooDataSet.h>
+#include <RooRealVar.h>
+#include <TROOT.h>
+#include <TTree.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+std::atomic<bool> smxWatchFolder::stopRequested{false};
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Escapes a string for a JSON value
+std::string jsonString(const std::string& text) {
+    std::string escaped = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+} // namespace
+
+smxWatchFolder::smxWatchFolder(const std::string& watchDirectory, int threads)
+    : directory(watchDirectory), pool(std::make_unique<smxWorkStealingPool>(threads)) {}
+
+smxWatchFolder::~smxWatchFolder() = default;
+
+void smxWatchFolder::warmUp() {
+    auto start = std::chrono::steady_clock::now();
+    ROOT::EnableThreadSafety();
+    gROOT->SetBatch(true);
+
+    // Loads the RooFit and tree libraries and their dictionaries
+    RooRealVar pulseAmp("pulseAmp", "Pulse amplitude", 0, 256);
+    RooRealVar countNorm("countNorm", "Normalized count", 0, 2);
+    RooDataSet dataset("warmUp", "warm-up", RooArgSet(pulseAmp, countNorm));
+    TTree tree("warmUpTree", "warm-up");
+    tree.SetDirectory(nullptr);
+    int value = 0;
+    tree.Branch("value", &value, "value/I");
+
+    // One fit of a synthetic S-curve pages in the fitter
+    std::vector<double> x, y, errLo, errHi;
+    for (int vp = 0; vp < 256; vp += 2) {
+        double p = 0.5 * std::erfc((120. - vp) / (std::sqrt(2.) * 3.));
+        pulseAmp.setVal(vp);
+        countNorm.setVal(p);
+        dataset.add(RooArgSet(pulseAmp, countNorm));
+        value = vp;
+        tree.Fill();
+        x.push_back(vp);
+        y.push_back(p);
+        errLo.push_back(0.02);
+        errHi.push_back(0.02);
+    }
+    smxErfcFitter fitter;
+    fitter.setData(x.data(), y.data(), errLo.data(), errHi.data(), x.size());
+    fitter.seedFromMoments();
+    smxFitResult result;
+    fitter.fit(result);
+    SMX_LOG_INFO("Warm-up finished in " << secondsSince(start) * 1e3 << " ms (synthetic threshold "
+                 << result.threshold << ")");
+}
+
+void smxWatchFolder::requestStop() {
+    stopRequested.store(true);
+}
+
+void smxWatchFolder::setSettleTime(int milliseconds) {
+    settleTime = std::chrono::milliseconds(std::max(0, milliseconds));
+}
+
+void smxWatchFolder::setSummarySize(size_t scans) {
+    summarySize = std::max<size_t>(1, scans);
+}
+
+void smxWatchFolder::setParseMode(smxParseMode mode) {
+    parseMode = mode;
+}
+
+void smxWatchFolder::setMomentSeeding(bool enable) {
+    momentSeeding = enable;
+}
+
+void smxWatchFolder::setClassify(bool enable) {
+    classify = enable;
+}
+
+void smxWatchFolder::setWriteOutput(bool enable) {
+    writeOutput = enable;
+}
+
+void smxWatchFolder::setOutputOptions(const smxRootOutputOptions& options) {
+    outputOptions = options;
+    outputOptions.fileName.clear();
+    outputOptions.directToFile = false; // the tree of a scan still being written must not replace its output
+}
+
+void smxWatchFolder::setSummaryFile(const std::string& fileName) {
+    summaryFileName = fileName;
+}
+
+const std::deque<smxWatchSummaryEntry>& smxWatchFolder::getSummary() const {
+    return summary;
+}
+
+bool smxWatchFolder::isScanFileName(const std::string& name) {
+    return name.rfind("pscan_", 0) == 0 && name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0;
+}
+
+bool smxWatchFolder::endsWithNewline(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in || in.tellg() <= 0) return false;
+    in.seekg(-1, std::ios::end);
+    return in.get() == '\n';
+}
+
+void smxWatchFolder::notePending(const std::string& name, bool closed) {
+    if (!isScanFileName(name)) return;
+    PendingFile& file = pending[name];
+    file.lastEvent = std::chrono::steady_clock::now();
+    file.closed = file.closed || closed;
+}
+
+void smxWatchFolder::rescanDirectory() {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (!entry.is_regular_file(ec) || !isScanFileName(name)) continue;
+        auto it = processed.find(name);
+        if (it != processed.end() && it->second == entry.last_write_time(ec)) continue;
+        notePending(name, true);
+    }
+}
+
+void smxWatchFolder::processCompleteFiles() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = pending.begin(); it != pending.end();) {
+        std::string path = (std::filesystem::path(directory) / it->first).string();
+        PendingFile& file = it->second;
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            it = pending.erase(it); // deleted or renamed away
+            continue;
+        }
+        if (size != file.lastSize) {
+            file.lastSize = size;
+            file.lastEvent = now;
+        }
+        auto idle = now - file.lastEvent;
+        bool complete = (file.closed && idle >= settleTime) || idle >= 10 * settleTime;
+        if (!complete || !endsWithNewline(path)) {
+            ++it;
+            continue;
+        }
+        auto modified = std::filesystem::last_write_time(path, ec);
+        processFile(path, file.lastEvent);
+        processed[it->first] = modified;
+        it = pending.erase(it);
+    }
+}
+
+bool smxWatchFolder::processFile(const std::string& path, std::chrono::steady_clock::time_point completed) {
+    smxPscan pscan;
+    pscan.setParseMode(parseMode);
+    pscan.setOutputOptions(outputOptions);
+    pscan.readFile(path);
+    if (pscan.getNVp() == 0) {
+        SMX_LOG_ERROR("No data read from " << path << ", skipping it.");
+        nFailed++;
+        return false;
+    }
+
+    // All channels at once on the warm pool; the scan outlives the tasks
+    size_t nDisc = pscan.getReadDiscList().size();
+    std::vector<smxFitResult> results(smxNCh * nDisc);
+    for (int ch = 0; ch < smxNCh; ++ch) {
+        pool->submit([&pscan, &results, ch, nDisc, this] {
+            smxPipeline::fitChannel(pscan, ch, momentSeeding, classify, results.data() + ch * nDisc);
+        });
+    }
+    pool->wait();
+
+    smxWatchSummaryEntry entry;
+    entry.fileName = std::filesystem::path(path).filename().string();
+    entry.asicId = pscan.getAsicId().Data();
+    entry.readTime = pscan.getReadTime();
+    std::map<int, std::pair<double, int>> thresholds;
+    double sigmaSum = 0;
+    int nGood = 0;
+    std::vector<smxFitResult> filled;
+    for (const smxFitResult& result : results) {
+        if (!smxFitResultTable::isFilled(result)) continue;
+        filled.push_back(result);
+        if (result.retries == 0) continue; // labelled by the classifier, not fitted
+        entry.nFits++;
+        if (result.status > 1) {
+            entry.nFailedFits++;
+            continue;
+        }
+        thresholds[result.comparator].first += result.threshold;
+        thresholds[result.comparator].second++;
+        sigmaSum += result.sigma;
+        nGood++;
+    }
+    for (const auto& [comparator, sum] : thresholds) {
+        entry.meanThresholds.emplace_back(comparator, sum.first / sum.second);
+    }
+    entry.meanSigma = nGood > 0 ? sigmaSum / nGood : 0;
+
+    if (writeOutput) {
+        pscan.getFitResults().set(filled);
+        pscan.writeRootFile();
+    }
+    entry.latency = secondsSince(completed);
+    nProcessed++;
+    addToSummary(std::move(entry));
+    return true;
+}
+
+void smxWatchFolder::addToSummary(smxWatchSummaryEntry entry) {
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1) << entry.asicId << " " << entry.fileName << ":";
+    for (const auto& [comparator, threshold] : entry.meanThresholds) {
+        line << " thr[" << comparator << "]=" << threshold;
+    }
+    line << " sigma=" << std::setprecision(2) << entry.meanSigma << ", " << entry.nFailedFits << " of "
+         << entry.nFits << " fits failed, ready " << entry.latency << " s after the file was complete";
+    SMX_LOG_INFO(line.str());
+
+    summary.push_front(std::move(entry));
+    if (summary.size() > summarySize) summary.pop_back();
+    writeSummary();
+}
+
+bool smxWatchFolder::writeSummary() const {
+    std::string fileName = summaryFileName.empty()
+                         ? (std::filesystem::path(directory) / "pscan_watch_summary.json").string()
+                         : summaryFileName;
+    std::string temporary = fileName + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << "{\n  \"directory\": " << jsonString(directory) << ",\n";
+        out << "  \"processed\": " << nProcessed << ",\n  \"failed\": " << nFailed << ",\n";
+        out << "  \"scans\": [\n";
+        for (size_t i = 0; i < summary.size(); ++i) {
+            const smxWatchSummaryEntry& entry = summary[i];
+            out << "    {\"file\": " << jsonString(entry.fileName) << ", \"asic\": " << jsonString(entry.asicId)
+                << ", \"read_time\": " << entry.readTime << ", \"fits\": " << entry.nFits
+                << ", \"failed_fits\": " << entry.nFailedFits << ", \"mean_sigma\": " << entry.meanSigma
+                << ", \"latency_s\": " << entry.latency << ", \"mean_threshold\": {";
+            for (size_t j = 0; j < entry.meanThresholds.size(); ++j) {
+                out << (j > 0 ? ", " : "") << "\"" << entry.meanThresholds[j].first << "\": "
+                    << entry.meanThresholds[j].second;
+            }
+            out << "}}" << (i + 1 < summary.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        if (!out) {
+            SMX_LOG_ERROR("Failed to write summary: " << temporary);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, fileName, ec);
+    if (ec) {
+        SMX_LOG_ERROR("Failed to write summary " << fileName << ": " << ec.message());
+        return false;
+    }
+    return true;
+}
+
+int smxWatchFolder::run(bool processExisting) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        SMX_LOG_ERROR("inotify_init1 failed: " << std::strerror(errno));
+        return 1;
+    }
+    int watch = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE);
+    if (watch < 0) {
+        SMX_LOG_ERROR("Failed to watch " << directory << ": " << std::strerror(errno));
+        close(fd);
+        return 1;
+    }
+    SMX_LOG_INFO("Watching " << directory << " for pscan_*.txt files (settle time " << settleTime.count()
+                 << " ms, " << pool->getNThreads() << " fit threads)");
+
+    if (processExisting) {
+        rescanDirectory();
+    } else {
+        // Files already complete are not ours; files still growing are picked up by their events
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            processed[entry.path().filename().string()] = entry.last_write_time(ec);
+        }
+    }
+
+    alignas(inotify_event) char buffer[64 * 1024];
+    stopRequested.store(false);
+    while (!stopRequested.load()) {
+        // Wake up at least every settle time to check the pending files
+        pollfd descriptor{fd, POLLIN, 0};
+        int timeout = pending.empty() ? 1000 : static_cast<int>(std::max<long>(50, settleTime.count() / 2));
+        int ready = poll(&descriptor, 1, timeout);
+        if (ready < 0 && errno != EINTR) {
+            SMX_LOG_ERROR("poll failed: " << std::strerror(errno));
+            break;
+        }
+        if (ready > 0) {
+            ssize_t length;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+                for (char* p = buffer; p < buffer + length;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        SMX_LOG_WARNING("inotify queue overflow, rescanning " << directory);
+                        rescanDirectory();
+                    } else if (event->len > 0) {
+                        notePending(event->name, event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO));
+                    }
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+        processCompleteFiles();
+    }
+
+    inotify_rm_watch(fd, watch);
+    close(fd);
+    SMX_LOG_INFO("Stopped watching " << directory << ": " << nProcessed << " scan(s) processed, "
+                 << nFailed << " failed.");
+    return 0;
+}
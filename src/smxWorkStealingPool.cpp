@@ -0,0 +1,112 @@
+#include "smxWorkStealingPool.h"
+#include <algorithm>
+
+namespace {
+
+// Worker index of the calling thread and the pool it belongs to
+thread_local const smxWorkStealingPool* workerPool = nullptr;
+thread_local int workerIndex = -1;
+
+} // namespace
+
+smxWorkStealingPool::smxWorkStealingPool(int nThreads) {
+    int n = nThreads > 0 ? nThreads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int i = 0; i < n; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < n; ++i) {
+        workers.emplace_back(&smxWorkStealingPool::workerLoop, this, i);
+    }
+}
+
+smxWorkStealingPool::~smxWorkStealingPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    taskAdded.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+int smxWorkStealingPool::currentWorker() const {
+    return workerPool == this ? workerIndex : -1;
+}
+
+void smxWorkStealingPool::submit(std::function<void()> task) {
+    int worker = currentWorker();
+    size_t index = worker >= 0 ? static_cast<size_t>(worker) : nextQueue.fetch_add(1) % queues.size();
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Taken under the state lock so a worker cannot miss it between its check and its wait
+        std::lock_guard<std::mutex> lock(stateMutex);
+        queued.fetch_add(1);
+    }
+    taskAdded.notify_one();
+}
+
+bool smxWorkStealingPool::takeTask(int worker, std::function<void()>& task) {
+    // Own deque: newest first
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    // Other deques: oldest first, starting at the next worker
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue& victim = *queues[(worker + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1);
+            steals.fetch_add(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void smxWorkStealingPool::workerLoop(int worker) {
+    workerPool = this;
+    workerIndex = worker;
+    std::function<void()> task;
+    while (true) {
+        if (takeTask(worker, task)) {
+            task();
+            task = nullptr;
+            if (pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                allDone.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(stateMutex);
+        taskAdded.wait(lock, [this] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) return;
+    }
+}
+
+void smxWorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this] { return pending.load() == 0; });
+}
+
+int smxWorkStealingPool::getNThreads() const {
+    return static_cast<int>(workers.size());
+}
+
+long smxWorkStealingPool::getSteals() const {
+    return steals.load();
+}
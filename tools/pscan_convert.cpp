@@ -0,0 +1,41 @@
+#include "smxPscan.h"
+#include "smxPscanFile.h"
+#include "smxLog.h"
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+/**
+ * @file pscan_convert.cpp
+ * @brief Converts pulse scan files between the ASCII format of the DAQ and the binary .pscan format.
+ *
+ * The direction follows the input: binary files (recognized by their magic bytes)
+ * are written as ASCII, ASCII files as binary. Without an output name the input
+ * name is used with the extension .pscan or .txt, next to the input file; an
+ * existing file is only overwritten if it is named explicitly.
+ */
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.txt|input.pscan> [output]" << std::endl;
+        return 1;
+    }
+    std::string input = argv[1];
+    bool toAscii = smxPscanFile::isPscanFile(input);
+    std::string output = argc > 2 ? argv[2]
+                       : std::filesystem::path(input).replace_extension(toAscii ? ".txt" : ".pscan").string();
+    if (std::filesystem::exists(output)) {
+        if (argc < 3 || std::filesystem::equivalent(input, output)) {
+            SMX_LOG_ERROR("Output file exists: " << output);
+            return 1;
+        }
+    }
+
+    smxPscan pscan;
+    pscan.readFile(input);
+    if (pscan.getNVp() == 0) {
+        SMX_LOG_ERROR("No data read from " << input);
+        return 1;
+    }
+    bool ok = toAscii ? pscan.writeAsciiFile(output) : pscan.writeBinaryFile(output);
+    return ok ? 0 : 1;
+}